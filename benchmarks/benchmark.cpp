@@ -0,0 +1,323 @@
+/*!
+ * \file benchmark.cpp
+ * \brief Times every stage of make_base and process_requests on a synthetic
+ * city and prints JSON report
+ */
+
+#include "city_generator.h"
+#include "json_reader.h"
+#include "json_writer.h"
+#include "serialization.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+//! Duration of callable execution (in milliseconds)
+double Measure(const std::function<void()> &action) {
+  const auto start = Clock::now();
+  action();
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+//! Nearest-rank percentile of sorted values
+double Percentile(const std::vector<double> &sorted, double percent) {
+  const size_t rank = static_cast<size_t>(
+      std::ceil(percent / 100 * static_cast<double>(sorted.size())));
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+void PrintUsage(const std::string &filename, std::ostream &stream = std::cerr) {
+  stream << "Usage: " << filename
+         << " [generate_base|generate_requests|run] [--option=value...]\n"
+            "Options: stops, buses, route_length, roundtrip_ratio, requests, "
+            "algorithm,\n"
+            "seed, file, mix (e.g. "
+            "bus:30,stop:30,route:30,map:1,nearest_stops:5,stops_in_box:4)\n";
+}
+
+void ParseMix(std::string_view value, benchmark::RequestMix &mix) {
+  const std::map<std::string_view, unsigned *> weights{
+      {"bus", &mix.bus},
+      {"stop", &mix.stop},
+      {"route", &mix.route},
+      {"map", &mix.map},
+      {"nearest_stops", &mix.nearest_stops},
+      {"stops_in_box", &mix.stops_in_box}};
+  for (auto &[_, weight] : weights) {
+    *weight = 0;
+  }
+  while (!value.empty()) {
+    const std::string_view item = value.substr(0, value.find(','));
+    value.remove_prefix(std::min(value.size(), item.size() + 1));
+    const size_t colon = item.find(':');
+    if (colon == std::string_view::npos) {
+      throw std::invalid_argument("Mix item must look like type:weight");
+    }
+    *weights.at(item.substr(0, colon)) =
+        static_cast<unsigned>(std::stoul(std::string{item.substr(colon + 1)}));
+  }
+}
+
+//! Reads --name=value options into parameters and database file name
+void ParseOptions(int argc, char *argv[], benchmark::CityParams &params,
+                  std::string &file) {
+  for (int i = 2; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    const size_t equals = arg.find('=');
+    if (arg.substr(0, 2) != "--" || equals == std::string_view::npos) {
+      throw std::invalid_argument("Options must look like --name=value");
+    }
+    const std::string_view name = arg.substr(2, equals - 2);
+    const std::string value{arg.substr(equals + 1)};
+    if (name == "stops") {
+      params.stops = std::stoul(value);
+    } else if (name == "buses") {
+      params.buses = std::stoul(value);
+    } else if (name == "route_length") {
+      params.route_length = std::stoul(value);
+    } else if (name == "roundtrip_ratio") {
+      params.roundtrip_ratio = std::stod(value);
+    } else if (name == "requests") {
+      params.requests = std::stoul(value);
+    } else if (name == "algorithm") {
+      params.algorithm = value;
+    } else if (name == "seed") {
+      params.seed = static_cast<uint32_t>(std::stoul(value));
+    } else if (name == "file") {
+      file = value;
+    } else if (name == "mix") {
+      ParseMix(value, params.mix);
+    } else {
+      throw std::invalid_argument("Unknown option: " + std::string{name});
+    }
+  }
+}
+
+/*!
+ * \brief Catalogue with everything needed to answer requests, in the same
+ * arrangement as in main executable
+ */
+struct Pipeline {
+  explicit Pipeline(std::ostream &output)
+      : router{database}, req_handler{output, database, renderer, router},
+        json_reader{database, req_handler} {}
+
+  core::TransportCatalogue database{};
+  core::TransportRouter router;
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler;
+  json::JsonReader json_reader;
+};
+
+//! Runs all stages and prints report
+void Run(const benchmark::CityGenerator &city, const std::string &file) {
+  std::vector<std::pair<std::string_view, double>> stages;
+  std::ostringstream base_stream, requests_stream;
+  stages.emplace_back("generate", Measure([&] {
+                        city.WriteBaseDocument(base_stream, file);
+                        city.WriteRequestsDocument(requests_stream, file);
+                      }));
+  const std::string base_json = base_stream.str();
+
+  stages.emplace_back("json_load", Measure([&] {
+                        json::Load(std::string_view{base_json});
+                      }));
+
+  std::ostringstream discard;
+  Pipeline build{discard};
+  std::string input = base_json;
+  std::optional<json::Document> document;
+  stages.emplace_back("read_input", Measure([&] {
+                        document = build.json_reader.ReadInput(input);
+                      }));
+  const json::Dict &doc_map = document->GetRoot().AsMap();
+  stages.emplace_back("insert_into_catalogue", Measure([&] {
+                        build.json_reader.InsertAllIntoCatalogue();
+                      }));
+  // applies render and routing settings
+  build.json_reader.ProcessInput(doc_map, input_info::OutputFormat::None);
+
+  // dijkstra engine needs no preprocessing, so it measures graph generation
+  core::TransportRouter graph_only{build.database};
+  json::Dict graph_settings = doc_map.at("routing_settings").AsMap();
+  graph_settings["routing_algorithm"] = json::Node{std::string{"dijkstra"}};
+  graph_only.LoadSettings(json::Node{graph_settings});
+  stages.emplace_back("generate_graph",
+                      Measure([&] { graph_only.PrepareRouting(); }));
+  stages.emplace_back("prepare_routing",
+                      Measure([&] { build.router.PrepareRouting(); }));
+
+  serialization::Serializer serializer{};
+  std::ostringstream proto_stream, flat_stream;
+  stages.emplace_back("export_state", Measure([&] {
+                        build.database.ExportDataBase(serializer);
+                        build.renderer.ExportRenderSettings(serializer);
+                        build.router.ExportState(serializer);
+                      }));
+  stages.emplace_back("write_proto", Measure([&] {
+                        serializer.SerializeToOstream(&proto_stream);
+                      }));
+  stages.emplace_back("write_flat", Measure([&] {
+                        serializer.SerializeToFlatOstream(&flat_stream);
+                      }));
+  const std::string proto_base = proto_stream.str();
+  const std::string flat_base = flat_stream.str();
+
+  {
+    std::ofstream out(file, std::ios::binary);
+    out << flat_base;
+  }
+  {
+    // mapping has to outlive the router that reads it
+    std::unique_ptr<serialization::FlatBase> base;
+    Pipeline flat{discard};
+    stages.emplace_back("import_flat", Measure([&] {
+                          base =
+                              std::make_unique<serialization::FlatBase>(file);
+                          flat.database.ImportDataBase(*base);
+                          flat.renderer.ImportRenderSettings(*base);
+                          flat.renderer.ImportMap(*base,
+                                                  flat.database.GetVersion());
+                          flat.router.ImportState(*base);
+                        }));
+  }
+  std::remove(file.c_str());
+
+  std::ostringstream answer;
+  Pipeline serve{answer};
+  stages.emplace_back("import_proto", Measure([&] {
+                        serialization::TrCatalogue sr_catalogue;
+                        sr_catalogue.ParseFromString(proto_base);
+                        serve.database.ImportDataBase(sr_catalogue);
+                        serve.renderer.ImportRenderSettings(sr_catalogue);
+                        serve.renderer.ImportMap(sr_catalogue,
+                                                 serve.database.GetVersion());
+                        serve.router.ImportState(sr_catalogue);
+                      }));
+
+  // every request is processed as a separate document, the way serve mode
+  // answers a line
+  const json::Document requests = json::Load(requests_stream.str());
+  std::map<std::string, std::vector<double>> latencies;
+  for (const json::Node &request :
+       requests.GetRoot().AsMap().at("stat_requests").AsArray()) {
+    const json::Dict single{{"stat_requests", json::Array{request}}};
+    answer.str({});
+    latencies[request.AsMap().at("type").AsString()].push_back(
+        Measure([&] {
+          serve.json_reader.ProcessInput(single,
+                                         input_info::OutputFormat::JsonLine);
+        }) *
+        1000);
+  }
+
+  const benchmark::CityParams &params = city.GetParams();
+  json::Writer writer{std::cout};
+  writer.StartDict()
+      .Key("parameters")
+      .StartDict()
+      .Key("algorithm")
+      .Value(params.algorithm)
+      .Key("buses")
+      .Value(static_cast<int>(params.buses))
+      .Key("requests")
+      .Value(static_cast<int>(params.requests))
+      .Key("roundtrip_ratio")
+      .Value(params.roundtrip_ratio)
+      .Key("route_length")
+      .Value(static_cast<int>(params.route_length))
+      .Key("seed")
+      .Value(static_cast<int>(params.seed))
+      .Key("stops")
+      .Value(static_cast<int>(params.stops))
+      .EndDict();
+  writer.Key("request_latency_us").StartDict();
+  for (auto &[type, values] : latencies) {
+    std::sort(values.begin(), values.end());
+    writer.Key(type)
+        .StartDict()
+        .Key("count")
+        .Value(static_cast<int>(values.size()))
+        .Key("max")
+        .Value(values.back())
+        .Key("p50")
+        .Value(Percentile(values, 50))
+        .Key("p90")
+        .Value(Percentile(values, 90))
+        .Key("p99")
+        .Value(Percentile(values, 99))
+        .EndDict();
+  }
+  writer.EndDict().Key("sizes_bytes").StartDict();
+  writer.Key("flat_base")
+      .Value(static_cast<int>(flat_base.size()))
+      .Key("input_json")
+      .Value(static_cast<int>(base_json.size()))
+      .Key("proto_base")
+      .Value(static_cast<int>(proto_base.size()))
+      .EndDict();
+  writer.Key("stages_ms").StartArray();
+  for (const auto &[name, time] : stages) {
+    writer.StartDict()
+        .Key("name")
+        .Value(name)
+        .Key("time")
+        .Value(time)
+        .EndDict();
+  }
+  writer.EndArray().EndDict();
+  std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const std::string filename{argc > 0 ? argv[0] : "benchmark"};
+  if (argc < 2) {
+    PrintUsage(filename);
+    return 1;
+  }
+  const std::string_view mode{argv[1]};
+  if (mode != "generate_base" && mode != "generate_requests" &&
+      mode != "run") {
+    PrintUsage(filename);
+    return 1;
+  }
+  try {
+    benchmark::CityParams params;
+    std::string file{"benchmark.db"};
+    ParseOptions(argc, argv, params, file);
+    const benchmark::CityGenerator city{params};
+    if (mode == "generate_base") {
+      city.WriteBaseDocument(std::cout, file);
+    } else if (mode == "generate_requests") {
+      city.WriteRequestsDocument(std::cout, file);
+    } else {
+      Run(city, file);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    PrintUsage(filename);
+    return 1;
+  }
+}
@@ -0,0 +1,322 @@
+#include "city_generator.h"
+
+#include "json_writer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+namespace benchmark {
+
+namespace {
+//! South-west corner of the lattice
+constexpr geo::Coordinates ORIGIN{55.5, 37.3};
+//! Lattice steps (in degrees), about 450 meters both
+constexpr double LAT_STEP = 0.004;
+constexpr double LNG_STEP = 0.007;
+//! Road distances exceed direct ones by this factor range
+constexpr double MIN_DETOUR = 1.1;
+constexpr double MAX_DETOUR = 1.6;
+//! Coordinates are written with enough digits to keep stops meters apart
+constexpr std::streamsize COORDINATES_PRECISION = 10;
+} // namespace
+
+CityGenerator::CityGenerator(CityParams params) : params_{std::move(params)} {
+  if (params_.stops < 2 || params_.route_length < 2) {
+    throw std::invalid_argument(
+        "City needs at least 2 stops and routes of at least 2 stops");
+  }
+  if (params_.roundtrip_ratio < 0 || params_.roundtrip_ratio > 1) {
+    throw std::invalid_argument("Roundtrip ratio must be within [0, 1]");
+  }
+  const RequestMix &mix = params_.mix;
+  if (params_.requests > 0 && mix.bus + mix.stop + mix.route + mix.map +
+                                      mix.nearest_stops + mix.stops_in_box ==
+                                  0) {
+    throw std::invalid_argument("Request mix has no request types");
+  }
+
+  std::mt19937 generator(params_.seed);
+  std::uniform_real_distribution<double> jitter(-0.3, 0.3);
+  std::uniform_real_distribution<double> detour(MIN_DETOUR, MAX_DETOUR);
+  side_ = static_cast<size_t>(std::ceil(std::sqrt(double(params_.stops))));
+
+  stops_.resize(params_.stops);
+  for (size_t i = 0; i < stops_.size(); ++i) {
+    stops_[i].name = "Stop " + std::to_string(i);
+    stops_[i].pos = {ORIGIN.lat + (i / side_ + jitter(generator)) * LAT_STEP,
+                     ORIGIN.lng + (i % side_ + jitter(generator)) * LNG_STEP};
+  }
+  // every lattice edge gets road distance in one direction, the other
+  // direction uses the same distance
+  for (size_t i = 0; i < stops_.size(); ++i) {
+    for (const size_t neighbour : {i + 1, i + side_}) {
+      if (neighbour >= stops_.size() ||
+          (neighbour == i + 1 && neighbour % side_ == 0)) {
+        continue;
+      }
+      const double direct =
+          geo::ComputeDistance(stops_[i].pos, stops_[neighbour].pos);
+      const long road = std::lround(direct * detour(generator));
+      stops_[i].roads.emplace_back(neighbour,
+                                   std::max(1, static_cast<int>(road)));
+    }
+  }
+
+  std::uniform_int_distribution<size_t> any_stop(0, stops_.size() - 1);
+  std::bernoulli_distribution is_roundtrip(params_.roundtrip_ratio);
+  // random walk that doesn't step right back unless it is a dead end
+  auto random_walk = [this, &generator, &any_stop](size_t length) {
+    std::vector<size_t> walk{any_stop(generator)};
+    while (walk.size() < length) {
+      std::vector<size_t> next = GetNeighbours(walk.back());
+      if (walk.size() > 1 && next.size() > 1) {
+        next.erase(std::find(next.begin(), next.end(), walk[walk.size() - 2]));
+      }
+      walk.push_back(
+          next[std::uniform_int_distribution<size_t>(0, next.size() - 1)(
+              generator)]);
+    }
+    return walk;
+  };
+  const size_t full_rows = stops_.size() / side_;
+  for (size_t i = 0; i < params_.buses; ++i) {
+    Bus &bus = buses_.emplace_back();
+    bus.name = "Bus " + std::to_string(i);
+    bus.is_roundtrip = is_roundtrip(generator);
+    if (!bus.is_roundtrip) {
+      bus.stops = random_walk(params_.route_length);
+      continue;
+    }
+    const size_t half_perimeter = std::max<size_t>(2, params_.route_length / 2);
+    if (side_ < 2 || full_rows < 2) {
+      // there is no lattice rectangle, route goes there and back
+      bus.stops = random_walk(half_perimeter);
+      bus.stops.insert(bus.stops.end(), std::next(bus.stops.rbegin()),
+                       bus.stops.rend());
+      continue;
+    }
+    // route goes around rectangle of width x height lattice steps
+    const size_t width = std::uniform_int_distribution<size_t>(
+        1, std::min(side_ - 1, half_perimeter - 1))(generator);
+    const size_t height =
+        std::clamp<size_t>(half_perimeter - width, 1, full_rows - 1);
+    const size_t row = std::uniform_int_distribution<size_t>(
+        0, full_rows - 1 - height)(generator);
+    const size_t col =
+        std::uniform_int_distribution<size_t>(0, side_ - 1 - width)(generator);
+    size_t stop = row * side_ + col;
+    bus.stops.push_back(stop);
+    const std::pair<size_t, size_t> forward_sides[] = {{width, 1},
+                                                       {height, side_}};
+    for (const bool backward : {false, true}) {
+      for (const auto &[steps, delta] : forward_sides) {
+        for (size_t step = 0; step < steps; ++step) {
+          stop = backward ? stop - delta : stop + delta;
+          bus.stops.push_back(stop);
+        }
+      }
+    }
+  }
+}
+
+void CityGenerator::WriteBaseDocument(std::ostream &out,
+                                      std::string_view file) const {
+  const std::streamsize precision = out.precision(COORDINATES_PRECISION);
+  json::Writer writer{out, 0, true};
+  writer.StartDict().Key("base_requests").StartArray();
+  for (const Stop &stop : stops_) {
+    writer.StartDict()
+        .Key("type")
+        .Value("Stop")
+        .Key("name")
+        .Value(stop.name)
+        .Key("latitude")
+        .Value(stop.pos.lat)
+        .Key("longitude")
+        .Value(stop.pos.lng)
+        .Key("road_distances")
+        .StartDict();
+    for (const auto &[neighbour, distance] : stop.roads) {
+      writer.Key(stops_[neighbour].name).Value(distance);
+    }
+    writer.EndDict().EndDict();
+  }
+  for (const Bus &bus : buses_) {
+    writer.StartDict()
+        .Key("type")
+        .Value("Bus")
+        .Key("name")
+        .Value(bus.name)
+        .Key("is_roundtrip")
+        .Value(bus.is_roundtrip)
+        .Key("stops")
+        .StartArray();
+    for (const size_t stop : bus.stops) {
+      writer.Value(stops_[stop].name);
+    }
+    writer.EndArray().EndDict();
+  }
+  writer.EndArray();
+
+  writer.Key("render_settings")
+      .StartDict()
+      .Key("width")
+      .Value(1200.0)
+      .Key("height")
+      .Value(1200.0)
+      .Key("padding")
+      .Value(50.0)
+      .Key("stop_radius")
+      .Value(3.0)
+      .Key("line_width")
+      .Value(4.0)
+      .Key("bus_label_font_size")
+      .Value(14)
+      .Key("bus_label_offset")
+      .StartArray()
+      .Value(7.0)
+      .Value(15.0)
+      .EndArray()
+      .Key("stop_label_font_size")
+      .Value(12)
+      .Key("stop_label_offset")
+      .StartArray()
+      .Value(7.0)
+      .Value(-3.0)
+      .EndArray()
+      .Key("underlayer_color")
+      .StartArray()
+      .Value(255)
+      .Value(255)
+      .Value(255)
+      .Value(0.85)
+      .EndArray()
+      .Key("underlayer_width")
+      .Value(3.0)
+      .Key("color_palette")
+      .StartArray()
+      .Value("green")
+      .StartArray()
+      .Value(255)
+      .Value(160)
+      .Value(0)
+      .EndArray()
+      .Value("red")
+      .EndArray()
+      .EndDict();
+
+  writer.Key("routing_settings")
+      .StartDict()
+      .Key("bus_wait_time")
+      .Value(6)
+      .Key("bus_velocity")
+      .Value(40)
+      .Key("routing_algorithm")
+      .Value(params_.algorithm)
+      .EndDict();
+
+  writer.Key("serialization_settings")
+      .StartDict()
+      .Key("file")
+      .Value(file)
+      .EndDict()
+      .EndDict();
+  out.precision(precision);
+}
+
+void CityGenerator::WriteRequestsDocument(std::ostream &out,
+                                          std::string_view file) const {
+  const std::streamsize precision = out.precision(COORDINATES_PRECISION);
+  std::mt19937 generator(params_.seed + 1);
+  const RequestMix &mix = params_.mix;
+  std::discrete_distribution<int> request_type{
+      double(mix.bus),           double(mix.stop),
+      double(mix.route),         double(mix.map),
+      double(mix.nearest_stops), double(mix.stops_in_box)};
+  std::uniform_int_distribution<size_t> any_stop(0, stops_.size() - 1);
+  std::uniform_int_distribution<size_t> any_bus(
+      0, std::max<size_t>(buses_.size(), 1) - 1);
+  const size_t rows = (stops_.size() + side_ - 1) / side_;
+  std::uniform_real_distribution<double> lat(ORIGIN.lat,
+                                             ORIGIN.lat + rows * LAT_STEP);
+  std::uniform_real_distribution<double> lng(ORIGIN.lng,
+                                             ORIGIN.lng + side_ * LNG_STEP);
+
+  json::Writer writer{out, 0, true};
+  writer.StartDict().Key("stat_requests").StartArray();
+  for (size_t i = 0; i < params_.requests; ++i) {
+    writer.StartDict().Key("id").Value(static_cast<int>(i + 1)).Key("type");
+    switch (request_type(generator)) {
+    case 0:
+      writer.Value("Bus").Key("name").Value(
+          buses_.empty() ? std::string_view{"No bus"}
+                         : std::string_view{buses_[any_bus(generator)].name});
+      break;
+    case 1:
+      writer.Value("Stop").Key("name").Value(stops_[any_stop(generator)].name);
+      break;
+    case 2:
+      writer.Value("Route")
+          .Key("from")
+          .Value(stops_[any_stop(generator)].name)
+          .Key("to")
+          .Value(stops_[any_stop(generator)].name);
+      break;
+    case 3:
+      writer.Value("Map");
+      break;
+    case 4:
+      writer.Value("NearestStops")
+          .Key("latitude")
+          .Value(lat(generator))
+          .Key("longitude")
+          .Value(lng(generator))
+          .Key("count")
+          .Value(5);
+      break;
+    default: {
+      const geo::Coordinates min{lat(generator), lng(generator)};
+      writer.Value("StopsInBox")
+          .Key("min_latitude")
+          .Value(min.lat)
+          .Key("min_longitude")
+          .Value(min.lng)
+          .Key("max_latitude")
+          .Value(min.lat + 3 * LAT_STEP)
+          .Key("max_longitude")
+          .Value(min.lng + 3 * LNG_STEP);
+    }
+    }
+    writer.EndDict();
+  }
+  writer.EndArray()
+      .Key("serialization_settings")
+      .StartDict()
+      .Key("file")
+      .Value(file)
+      .EndDict()
+      .EndDict();
+  out.precision(precision);
+}
+
+std::vector<size_t> CityGenerator::GetNeighbours(size_t stop) const {
+  std::vector<size_t> result;
+  if (stop % side_ > 0) {
+    result.push_back(stop - 1);
+  }
+  if (stop % side_ + 1 < side_ && stop + 1 < stops_.size()) {
+    result.push_back(stop + 1);
+  }
+  if (stop >= side_) {
+    result.push_back(stop - side_);
+  }
+  if (stop + side_ < stops_.size()) {
+    result.push_back(stop + side_);
+  }
+  return result;
+}
+
+} // namespace benchmark
@@ -0,0 +1,95 @@
+/*!
+ * \file city_generator.h
+ * \brief Synthetic cities of configurable size for benchmarks
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "geo.h"
+
+//! Performance measurement of the whole pipeline on synthetic data
+namespace benchmark {
+
+//! Relative weights of stat request types in generated requests
+struct RequestMix {
+  unsigned bus{30};
+  unsigned stop{30};
+  unsigned route{30};
+  unsigned map{1};
+  unsigned nearest_stops{5};
+  unsigned stops_in_box{4};
+};
+
+//! Parameters of generated city
+struct CityParams {
+  size_t stops{1000};
+  size_t buses{100};
+  //! Amount of stops in every route description
+  size_t route_length{20};
+  //! Share of buses with roundtrip (circular) routes
+  double roundtrip_ratio{0.5};
+  //! Amount of stat requests
+  size_t requests{1000};
+  RequestMix mix{};
+  //! Value of "routing_algorithm" routing setting
+  std::string algorithm{"all_pairs"};
+  uint32_t seed{1};
+};
+
+/*!
+ * \brief Generates stops, routes and requests of a city, deterministically
+ * for given parameters
+ *
+ * Stops are placed on a jittered square lattice and every pair of lattice
+ * neighbours has road distance, so routes are random walks along the lattice
+ * (roundtrip routes go around lattice rectangles).
+ */
+class CityGenerator {
+public:
+  //! \throw std::invalid_argument if parameters describe no valid city
+  explicit CityGenerator(CityParams params);
+
+  const CityParams &GetParams() const { return params_; }
+
+  /*!
+   * Writes make_base document: "base_requests", "render_settings",
+   * "routing_settings" and "serialization_settings"
+   * \param[in] file database file name used in "serialization_settings"
+   */
+  void WriteBaseDocument(std::ostream &out, std::string_view file) const;
+
+  //! Writes process_requests document: "stat_requests" mixed by
+  //! CityParams::mix and "serialization_settings"
+  void WriteRequestsDocument(std::ostream &out, std::string_view file) const;
+
+private:
+  struct Stop {
+    std::string name;
+    geo::Coordinates pos;
+    //! Indexes of lattice neighbours (right and upper) and road distances
+    std::vector<std::pair<size_t, int>> roads;
+  };
+  struct Bus {
+    std::string name;
+    std::vector<size_t> stops;
+    bool is_roundtrip;
+  };
+
+  CityParams params_;
+  //! Stops per lattice row
+  size_t side_{};
+  std::vector<Stop> stops_;
+  std::vector<Bus> buses_;
+
+  //! Lattice neighbours of stop (existing ones only)
+  std::vector<size_t> GetNeighbours(size_t stop) const;
+};
+
+} // namespace benchmark
@@ -3,11 +3,22 @@
 #include "../transport-catalogue/domain.h"
 #include "../transport-catalogue/json.h"
 #include "../transport-catalogue/json_reader.h"
+#include "../transport-catalogue/json_writer.h"
+#include "../transport-catalogue/profiler.h"
+#include "../transport-catalogue/snapshot.h"
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
 #include <cmath>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 
 std::optional<double> FindTime(int req_id, const json::Array &source) {
   for (const auto &el : source) {
@@ -22,25 +33,20 @@ std::optional<double> FindTime(int req_id, const json::Array &source) {
   return std::nullopt;
 }
 
-BOOST_AUTO_TEST_CASE(total_time_test) {
-  std::ifstream input_data_json_file, correct_output_json_file;
-  std::ostringstream out_str_stream;
+json::Dict WithRoutingAlgorithm(json::Dict doc_map, const std::string &name) {
+  json::Dict settings = doc_map.at("routing_settings").AsMap();
+  settings["routing_algorithm"] = name;
+  doc_map["routing_settings"] = std::move(settings);
+  return doc_map;
+}
+
+void CheckTotalTimes(const std::string &output) {
+  std::ifstream correct_output_json_file;
   std::string curr_dir = CURR_TEST_DIR;
 
-  input_data_json_file.open(curr_dir + "/timetest_input.json");
   correct_output_json_file.open(curr_dir + "/timetest_output.json");
 
-  core::TransportCatalogue database{};
-  core::TransportRouter router{database};
-  graphics::MapRenderer renderer{};
-  core::RequestHandler req_handler{out_str_stream, database, renderer, router};
-  json::JsonReader json_reader{database, req_handler};
-
-  const json::Document doc = json::Load(input_data_json_file);
-  const auto &doc_map = doc.GetRoot().AsMap();
-
-  json_reader.ProcessInput(doc_map);
-  std::istringstream questionable_output_json{out_str_stream.str()};
+  std::istringstream questionable_output_json{output};
 
   const auto json_correct = json::Load(correct_output_json_file);
   const auto json_testing = json::Load(questionable_output_json);
@@ -63,4 +69,967 @@ BOOST_AUTO_TEST_CASE(total_time_test) {
                             "request_id " << req_id << " total_time mismatch");
     }
   }
-}
\ No newline at end of file
+}
+
+void CheckTotalTimes(const json::Dict &doc_map) {
+  std::ostringstream out_str_stream;
+
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out_str_stream, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+
+  json_reader.ProcessInput(doc_map);
+  CheckTotalTimes(out_str_stream.str());
+}
+
+json::Document LoadTimeTestInput() {
+  std::ifstream input_data_json_file;
+  std::string curr_dir = CURR_TEST_DIR;
+  input_data_json_file.open(curr_dir + "/timetest_input.json");
+  return json::Load(input_data_json_file);
+}
+
+BOOST_AUTO_TEST_CASE(total_time_test) {
+  const json::Document doc = LoadTimeTestInput();
+  CheckTotalTimes(doc.GetRoot().AsMap());
+}
+
+BOOST_AUTO_TEST_CASE(dijkstra_total_time_test) {
+  const json::Document doc = LoadTimeTestInput();
+  CheckTotalTimes(WithRoutingAlgorithm(doc.GetRoot().AsMap(), "dijkstra"));
+}
+
+BOOST_AUTO_TEST_CASE(contraction_hierarchies_total_time_test) {
+  const json::Document doc = LoadTimeTestInput();
+  CheckTotalTimes(
+      WithRoutingAlgorithm(doc.GetRoot().AsMap(), "contraction_hierarchies"));
+}
+
+BOOST_AUTO_TEST_CASE(lazy_all_pairs_total_time_test) {
+  const json::Document doc = LoadTimeTestInput();
+  // limit is way below amount of origins, so rows are evicted and recomputed
+  json::Dict doc_map =
+      WithRoutingAlgorithm(doc.GetRoot().AsMap(), "lazy_all_pairs");
+  json::Dict settings = doc_map.at("routing_settings").AsMap();
+  settings["lazy_cache_rows"] = 4;
+  doc_map["routing_settings"] = std::move(settings);
+  CheckTotalTimes(doc_map);
+}
+
+BOOST_AUTO_TEST_CASE(flat_base_total_time_test) {
+  const json::Document doc = LoadTimeTestInput();
+  const auto &doc_map = doc.GetRoot().AsMap();
+  const std::string file =
+      (std::filesystem::temp_directory_path() / "flat_base_test.db").string();
+
+  {
+    std::ostringstream out_str_stream;
+    core::TransportCatalogue database{};
+    core::TransportRouter router{database};
+    graphics::MapRenderer renderer{};
+    core::RequestHandler req_handler{out_str_stream, database, renderer,
+                                     router};
+    json::JsonReader json_reader{database, req_handler};
+    json_reader.ProcessInput(doc_map, input_info::OutputFormat::None);
+
+    serialization::Serializer serializer{};
+    database.ExportDataBase(serializer);
+    renderer.ExportRenderSettings(serializer);
+    router.ExportState(serializer);
+    std::ofstream out(file, std::ios::binary);
+    serializer.SerializeToFlatOstream(&out);
+  }
+  BOOST_REQUIRE(serialization::FlatBase::IsFlatFile(file));
+
+  std::ostringstream out_str_stream;
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out_str_stream, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+  {
+    const serialization::FlatBase base(file);
+    database.ImportDataBase(base);
+    renderer.ImportRenderSettings(base);
+    router.ImportState(base);
+    json_reader.ProcessInput(
+        json::Dict{{"stat_requests", doc_map.at("stat_requests")}});
+  }
+  CheckTotalTimes(out_str_stream.str());
+
+  // ranges stored inside of sections are checked as well as sections
+  {
+    using serialization::flat::Header;
+    using serialization::flat::Section;
+    std::fstream stream(file, std::ios::binary | std::ios::in | std::ios::out);
+    Header header{};
+    stream.read(reinterpret_cast<char *>(&header), sizeof(header));
+    const auto &stops =
+        header.sections[static_cast<size_t>(Section::Stops)];
+    serialization::flat::Stop stop{};
+    stream.seekg(static_cast<std::streamoff>(stops.offset));
+    stream.read(reinterpret_cast<char *>(&stop), sizeof(stop));
+    stop.links_end = UINT32_MAX;
+    stream.seekp(static_cast<std::streamoff>(stops.offset));
+    stream.write(reinterpret_cast<const char *>(&stop), sizeof(stop));
+  }
+  {
+    const serialization::FlatBase base(file);
+    core::TransportCatalogue corrupted{};
+    BOOST_REQUIRE_THROW(corrupted.ImportDataBase(base), std::runtime_error);
+  }
+  std::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(blocked_all_pairs_test) {
+  // a few 64 x 64 tiles with partial last one
+  const size_t vertex_count = 150;
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<size_t> vertex_dist(0, vertex_count - 1);
+  std::uniform_real_distribution<double> weight_dist(0.0, 100.0);
+  graph::DirectedWeightedGraph<double> builder(vertex_count);
+  for (size_t i = 0; i < vertex_count * 4; ++i) {
+    builder.AddEdge(graph::Edge<double>{}
+                        .SetFromVertex(vertex_dist(generator))
+                        .SetToVertex(vertex_dist(generator))
+                        .SetWeight(weight_dist(generator))
+                        .SetBus(nullptr)
+                        .SetStopCount(1));
+  }
+  const graph::CsrGraph<double> graph(builder);
+
+  const graph::Router<double> single(graph, 1), parallel(graph, 4);
+  const graph::DijkstraRouter<double> dijkstra(graph);
+  for (graph::VertexId from = 0; from < vertex_count; ++from) {
+    for (graph::VertexId to = 0; to < vertex_count; ++to) {
+      const auto expected = dijkstra.BuildRoute(from, to);
+      const auto single_route = single.BuildRoute(from, to);
+      const auto parallel_route = parallel.BuildRoute(from, to);
+      BOOST_REQUIRE_EQUAL(expected.has_value(), single_route.has_value());
+      BOOST_REQUIRE_EQUAL(expected.has_value(), parallel_route.has_value());
+      if (expected) {
+        BOOST_REQUIRE_CLOSE(expected->weight + 1, single_route->weight + 1,
+                            1e-9);
+        BOOST_REQUIRE_EQUAL(single_route->weight, parallel_route->weight);
+        BOOST_REQUIRE(single_route->edges == parallel_route->edges);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(json_parse_test) {
+  const std::string text =
+      R"({"a": [0, -2.5e1, 3000000000, true, null], )"
+      R"("s": "x\ny\u00e9\ud83d\ude00\/", "d": {}})";
+  const json::Document doc = json::Load(text);
+  const auto &root = doc.GetRoot().AsMap();
+  const auto &arr = root.at("a").AsArray();
+  BOOST_REQUIRE_EQUAL(arr.size(), 5);
+  BOOST_REQUIRE(arr[0].IsInt() && arr[0].AsInt() == 0);
+  BOOST_REQUIRE(arr[1].IsPureDouble() && arr[1].AsDouble() == -25.0);
+  // does not fit into int
+  BOOST_REQUIRE(arr[2].IsPureDouble() && arr[2].AsDouble() == 3e9);
+  BOOST_REQUIRE(arr[3].AsBool());
+  BOOST_REQUIRE(arr[4].IsNull());
+  BOOST_REQUIRE_EQUAL(root.at("s").AsString(),
+                      "x\ny\xC3\xA9\xF0\x9F\x98\x80/");
+  BOOST_REQUIRE(root.at("d").AsMap().empty());
+
+  std::string buffer = text;
+  json::NodeHandler handler;
+  json::ParseInPlace(buffer, handler);
+  BOOST_REQUIRE(handler.Extract() == doc.GetRoot());
+
+  for (const std::string bad : {"", "[1,]", "{\"a\" 1}", "01", "[1] 2",
+                                "\"\\x\"", "tru", "{\"a\": 1"}) {
+    BOOST_REQUIRE_THROW(json::Load(bad), json::ParsingError);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(streamed_input_total_time_test) {
+  std::ifstream input_data_json_file(std::string(CURR_TEST_DIR) +
+                                     "/timetest_input.json");
+  std::string input{std::istreambuf_iterator<char>(input_data_json_file),
+                    std::istreambuf_iterator<char>()};
+
+  std::ostringstream out_str_stream;
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out_str_stream, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+
+  const json::Document doc = json_reader.ReadInput(input);
+  const json::Dict &doc_map = doc.GetRoot().AsMap();
+  BOOST_REQUIRE(!doc_map.count("base_requests"));
+  json_reader.ProcessInput(doc_map);
+  CheckTotalTimes(out_str_stream.str());
+}
+
+BOOST_AUTO_TEST_CASE(json_writer_test) {
+  const json::Node expected = json::Array{
+      json::Dict{{"a", json::Array{}},
+                 {"b", json::Dict{{"c", 1.5}, {"d", nullptr}}},
+                 {"e", "quote \" slash \\ line\n"}},
+      json::Array{json::Array{1, true}, json::Dict{}}, 42};
+  std::ostringstream printed;
+  json::Print(json::Document{expected}, printed);
+
+  std::ostringstream written;
+  json::Writer writer{written};
+  writer.StartArray()
+      .StartDict()
+      .Key("a")
+      .StartArray()
+      .EndArray()
+      .Key("b")
+      .StartDict()
+      .Key("c")
+      .Value(1.5)
+      .Key("d")
+      .Value(nullptr)
+      .EndDict()
+      .Key("e")
+      .Value("quote \" slash \\ line\n")
+      .EndDict()
+      .StartArray()
+      .StartArray()
+      .Value(1)
+      .Value(true)
+      .EndArray()
+      .StartDict()
+      .EndDict()
+      .EndArray()
+      .Value(42)
+      .EndArray();
+  BOOST_REQUIRE_EQUAL(written.str(), printed.str());
+  BOOST_REQUIRE_THROW(json::Writer{written}.StartDict().Value(1),
+                      std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_stat_requests_test) {
+  const json::Document doc = LoadTimeTestInput();
+  // settings updates go first, map answer is added among route answers
+  json::Dict doc_map = doc.GetRoot().AsMap();
+  json::Array requests = doc_map.at("stat_requests").AsArray();
+  requests.insert(requests.begin() + requests.size() / 2,
+                  json::Dict{{"id", 0}, {"type", "Map"}});
+  doc_map["stat_requests"] = std::move(requests);
+
+  auto process = [&doc_map](int threads) {
+    json::Dict input = doc_map;
+    input["execution_settings"] = json::Dict{{"threads", threads}};
+    std::ostringstream out_str_stream;
+    core::TransportCatalogue database{};
+    core::TransportRouter router{database};
+    graphics::MapRenderer renderer{};
+    core::RequestHandler req_handler{out_str_stream, database, renderer,
+                                     router};
+    json::JsonReader json_reader{database, req_handler};
+    json_reader.ProcessInput(input);
+    return out_str_stream.str();
+  };
+  const std::string sequential = process(1);
+  BOOST_REQUIRE_EQUAL(process(4), sequential);
+  CheckTotalTimes(sequential);
+}
+
+BOOST_AUTO_TEST_CASE(map_cache_test) {
+  const json::Document doc = LoadTimeTestInput();
+  const auto &doc_map = doc.GetRoot().AsMap();
+
+  std::ostringstream out_str_stream;
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out_str_stream, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+  json_reader.ProcessInput(
+      json::Dict{{"base_requests", doc_map.at("base_requests")},
+                 {"render_settings", doc_map.at("render_settings")}},
+      input_info::OutputFormat::None);
+  size_t render_count = 0;
+  auto get_data = [&req_handler, &render_count] {
+    ++render_count;
+    return req_handler.GetCatalogueData();
+  };
+
+  const auto first = renderer.GetMap(database.GetVersion(), get_data);
+  BOOST_REQUIRE(renderer.GetMap(database.GetVersion(), get_data) == first);
+  BOOST_REQUIRE_EQUAL(render_count, 1);
+
+  renderer.LoadSettings(doc_map.at("render_settings"));
+  BOOST_REQUIRE_EQUAL(*renderer.GetMap(database.GetVersion(), get_data),
+                      *first);
+  BOOST_REQUIRE_EQUAL(render_count, 2);
+
+  // stored map is adopted on import instead of being rendered
+  serialization::Serializer serializer{};
+  database.ExportDataBase(serializer);
+  renderer.ExportRenderSettings(serializer);
+  renderer.ExportMap(serializer, database.GetVersion(), get_data);
+  std::stringstream stream;
+  serializer.SerializeToOstream(&stream);
+  serialization::TrCatalogue sr_catalogue;
+  BOOST_REQUIRE(sr_catalogue.ParseFromIstream(&stream));
+
+  core::TransportCatalogue imported{};
+  graphics::MapRenderer imported_renderer{};
+  imported.ImportDataBase(sr_catalogue);
+  imported_renderer.ImportRenderSettings(sr_catalogue);
+  imported_renderer.ImportMap(sr_catalogue, imported.GetVersion());
+  BOOST_REQUIRE_EQUAL(*imported_renderer.GetMap(imported.GetVersion(),
+                                                get_data),
+                      *first);
+  BOOST_REQUIRE_EQUAL(render_count, 2);
+
+  imported.AddStop({"New stop", {55.0, 37.0}});
+  imported_renderer.GetMap(imported.GetVersion(), get_data);
+  BOOST_REQUIRE_EQUAL(render_count, 3);
+}
+
+BOOST_AUTO_TEST_CASE(svg_writer_test) {
+  using namespace graphics;
+  svg::Polyline line;
+  line.AddPoint({0.1, 1e6}).AddPoint({-3.25, 123.4567891});
+  line.SetStrokeColor(svg::Rgba{1, 2, 3, 0.5})
+      .SetFillColor(svg::NoneColor)
+      .SetStrokeLineCap(svg::StrokeLineCap::ROUND);
+  svg::Text text;
+  text.SetData(R"(<"Tom" & 'Jerry'>)")
+      .SetFontFamily("Verdana")
+      .SetPosition({2.0 / 3, 0})
+      .SetFillColor(svg::Rgb{255, 0, 10});
+  svg::Circle circle;
+  circle.SetCenter({1, 2}).SetRadius(5).SetFillColor("white");
+
+  svg::Document document;
+  document.Add(line);
+  document.Add(text);
+  document.Add(circle);
+  std::ostringstream expected;
+  document.Render(expected);
+
+  // objects are written right away, so they can be reused
+  std::string result;
+  svg::DocumentWriter writer{result};
+  writer.Add(line).Add(text);
+  line.ClearPoints().AddPoint({5, 5});
+  writer.Add(circle);
+  writer.Finish();
+  BOOST_REQUIRE_EQUAL(result, expected.str());
+  BOOST_REQUIRE(result.find(R"(points="0.1,1e+06 -3.25,123.457")") !=
+                std::string::npos);
+  BOOST_REQUIRE(result.find("&lt;&quot;Tom&quot; &amp; &apos;Jerry&apos;&gt;"
+                            "</text>") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(grid_index_test) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> offset(-0.05, 0.05);
+  std::vector<geo::Coordinates> points;
+  geo::GridIndex index;
+  // extent keeps growing and some points repeat, so grid is rebuilt
+  geo::PointSet point_set;
+  for (int i = 0; i < 600; ++i) {
+    const double spread = 1 + i / 100.0;
+    points.push_back(i % 50 == 49 ? points[i / 2]
+                                  : geo::Coordinates{
+                                        55.7 + offset(generator) * spread,
+                                        37.6 + offset(generator) * spread});
+    index.Add(points.back());
+    point_set.Add(points.back());
+  }
+
+  for (int query = 0; query < 50; ++query) {
+    const geo::Coordinates pos{55.7 + offset(generator) * 10,
+                               37.6 + offset(generator) * 10};
+    std::vector<double> distances;
+    geo::ComputeDistances(pos, point_set, distances,
+                          geo::DistanceFormula::Haversine);
+    std::vector<std::pair<double, size_t>> expected;
+    for (size_t i = 0; i < points.size(); ++i) {
+      expected.emplace_back(distances[i], i);
+    }
+    std::sort(expected.begin(), expected.end());
+    const auto nearest = index.FindNearest(pos, 7);
+    BOOST_REQUIRE_EQUAL(nearest.size(), 7u);
+    for (size_t i = 0; i < nearest.size(); ++i) {
+      BOOST_REQUIRE_EQUAL(nearest[i].first, expected[i].second);
+    }
+
+    const geo::Coordinates max{pos.lat + 0.03, pos.lng + 0.05};
+    std::vector<size_t> inside;
+    for (size_t i = 0; i < points.size(); ++i) {
+      if (points[i].lat >= pos.lat && points[i].lat <= max.lat &&
+          points[i].lng >= pos.lng && points[i].lng <= max.lng) {
+        inside.push_back(i);
+      }
+    }
+    const auto found = index.FindInBox(pos, max);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(found.begin(), found.end(), inside.begin(),
+                                    inside.end());
+  }
+  BOOST_REQUIRE_EQUAL(index.FindNearest({0, 0}, 1000).size(), points.size());
+}
+
+BOOST_AUTO_TEST_CASE(batch_distance_test) {
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<double> lat(-80, 80), lng(-180, 180);
+  std::vector<geo::Coordinates> path;
+  geo::PointSet point_set;
+  // odd amount of points leaves scalar tail after vector lanes
+  for (int i = 0; i < 37; ++i) {
+    path.push_back(i % 9 == 8 ? path.back()
+                              : geo::Coordinates{lat(generator),
+                                                 lng(generator)});
+    point_set.Add(path.back());
+  }
+
+  std::vector<double> cosines, haversine;
+  geo::ComputePathDistances(point_set, cosines);
+  geo::ComputePathDistances(point_set, haversine,
+                            geo::DistanceFormula::Haversine);
+  BOOST_REQUIRE_EQUAL(cosines.size(), path.size() - 1);
+  BOOST_REQUIRE_EQUAL(haversine.size(), path.size() - 1);
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    const double expected = geo::ComputeDistance(path[i], path[i + 1]);
+    if (path[i] == path[i + 1]) {
+      BOOST_CHECK_EQUAL(haversine[i], 0.0);
+      BOOST_CHECK_SMALL(cosines[i], 1.0);
+    } else {
+      BOOST_CHECK_CLOSE(cosines[i], expected, 1e-6);
+      BOOST_CHECK_CLOSE(haversine[i], expected, 1e-6);
+    }
+  }
+
+  std::vector<double> from_first;
+  geo::ComputeDistances(path.front(), point_set, from_first);
+  BOOST_REQUIRE_EQUAL(from_first.size(), path.size());
+  BOOST_CHECK_CLOSE(from_first.back(),
+                    geo::ComputeDistance(path.front(), path.back()), 1e-6);
+
+  // a meter apart: law of cosines is off by centimeters, haversine is not
+  geo::PointSet close;
+  close.Add({55.7, 37.6});
+  close.Add({55.7 + 1 / (geo::DEG_TO_RAD * geo::EARTH_RADIUS), 37.6});
+  geo::ComputePathDistances(close, haversine,
+                            geo::DistanceFormula::Haversine);
+  BOOST_CHECK_CLOSE(haversine.front(), 1.0, 1e-6);
+
+  geo::ComputePathDistances(geo::PointSet{}, haversine);
+  BOOST_CHECK(haversine.empty());
+}
+
+BOOST_AUTO_TEST_CASE(spatial_stat_requests_test) {
+  std::string input = R"({
+    "base_requests": [
+      {"type": "Stop", "name": "A", "latitude": 55.60, "longitude": 37.60,
+       "road_distances": {}},
+      {"type": "Stop", "name": "B", "latitude": 55.61, "longitude": 37.60,
+       "road_distances": {}},
+      {"type": "Stop", "name": "C", "latitude": 55.70, "longitude": 37.70,
+       "road_distances": {}}
+    ],
+    "stat_requests": [
+      {"id": 1, "type": "NearestStops", "latitude": 55.6051,
+       "longitude": 37.60, "count": 2},
+      {"id": 2, "type": "StopsInBox", "min_latitude": 55.605,
+       "min_longitude": 37.0, "max_latitude": 56.0, "max_longitude": 38.0}
+    ]
+  })";
+  std::ostringstream out;
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+  const json::Document doc = json_reader.ReadInput(input);
+  const json::Dict &doc_map = doc.GetRoot().AsMap();
+  json_reader.ProcessInput(doc_map);
+
+  const auto answers = json::Load(out.str()).GetRoot().AsArray();
+  const auto &nearest = answers.at(0).AsMap().at("stops").AsArray();
+  BOOST_REQUIRE_EQUAL(nearest.size(), 2u);
+  BOOST_REQUIRE_EQUAL(nearest.at(0).AsMap().at("name").AsString(), "B");
+  BOOST_REQUIRE_EQUAL(nearest.at(1).AsMap().at("name").AsString(), "A");
+  // distances are printed with 6 significant digits
+  BOOST_REQUIRE_CLOSE(nearest.at(0).AsMap().at("distance").AsDouble(),
+                      geo::ComputeDistance({55.6051, 37.60}, {55.61, 37.60}),
+                      1e-3);
+  const auto &in_box = answers.at(1).AsMap().at("stops").AsArray();
+  BOOST_REQUIRE_EQUAL(in_box.size(), 2u);
+  BOOST_REQUIRE_EQUAL(in_box.at(0).AsString(), "B");
+  BOOST_REQUIRE_EQUAL(in_box.at(1).AsString(), "C");
+
+  // saved index is restored instead of being rebuilt
+  serialization::Serializer serializer{};
+  database.ExportDataBase(serializer);
+  std::stringstream stream;
+  serializer.SerializeToOstream(&stream);
+  serialization::TrCatalogue sr_catalogue;
+  BOOST_REQUIRE(sr_catalogue.ParseFromIstream(&stream));
+  BOOST_REQUIRE_GT(sr_catalogue.stop_index().rows(), 0u);
+  core::TransportCatalogue imported{};
+  imported.ImportDataBase(sr_catalogue);
+  const auto imported_nearest = imported.GetNearestStops({55.69, 37.69}, 3);
+  BOOST_REQUIRE_EQUAL(imported_nearest.size(), 3u);
+  BOOST_REQUIRE_EQUAL(imported_nearest.front().first->name, "C");
+  BOOST_REQUIRE_EQUAL(imported.GetStopsInBox({55.0, 37.0}, {56.0, 38.0}).size(),
+                      3u);
+}
+
+BOOST_AUTO_TEST_CASE(point_route_test) {
+  const json::Document doc = LoadTimeTestInput();
+  json::Dict doc_map = doc.GetRoot().AsMap();
+  doc_map.erase("stat_requests");
+  std::ostringstream out;
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+  json_reader.ProcessInput(doc_map);
+
+  const auto stops = database.GetAllStops();
+  const core::TransportRouter::Walking walking{4.0, 3};
+  auto walk_time = [&walking](geo::Coordinates from, geo::Coordinates to) {
+    return geo::ComputeDistance(from, to, geo::DistanceFormula::Haversine) /
+           (walking.velocity * 1000.0 / 60.0);
+  };
+  std::mt19937 generator(3);
+  std::uniform_int_distribution<size_t> stop_index(0, stops.size() - 1);
+  std::uniform_real_distribution<double> shift(-0.01, 0.01);
+  for (int i = 0; i < 30; ++i) {
+    const geo::Coordinates stop_pos = stops[stop_index(generator)]->pos;
+    const geo::Coordinates from{stop_pos.lat + shift(generator),
+                                stop_pos.lng + shift(generator)};
+    const data::Stop *to = stops[stop_index(generator)];
+
+    // single search must match the best of separate stop to stop searches
+    double expected = std::numeric_limits<double>::infinity();
+    for (const auto &[stop, distance] :
+         database.GetNearestStops(from, walking.stops_count)) {
+      if (auto route = router.FindFastestRoute(stop->name, to->name)) {
+        expected = std::min(expected,
+                             walk_time(from, stop->pos) + route->total_time);
+      }
+    }
+    const auto answer = router.FindFastestRoute(from, to->name, walking);
+    if (std::isinf(expected)) {
+      BOOST_REQUIRE(!answer);
+      continue;
+    }
+    BOOST_REQUIRE(answer);
+    BOOST_REQUIRE_CLOSE(answer->total_time, expected, 1e-9);
+    const auto &walk = std::get<data::RouteAnswer::Walk>(answer->items.front());
+    BOOST_REQUIRE(!walk.from && walk.to);
+    double items_time = 0;
+    for (const auto &item : answer->items) {
+      items_time += std::visit([](const auto &leg) { return leg.time; }, item);
+    }
+    BOOST_REQUIRE_CLOSE(items_time, answer->total_time, 1e-9);
+  }
+
+  // close points are connected by walking alone
+  const geo::Coordinates point = stops.front()->pos;
+  const geo::Coordinates near{point.lat + 0.0001, point.lng};
+  const auto walk_answer = router.FindFastestRoute(point, near, walking);
+  BOOST_REQUIRE(walk_answer);
+  BOOST_REQUIRE_EQUAL(walk_answer->items.size(), 1u);
+  BOOST_REQUIRE_CLOSE(walk_answer->total_time, walk_time(point, near), 1e-9);
+  BOOST_REQUIRE(!router.FindFastestRoute("No such stop", stops.front()->name));
+}
+
+BOOST_AUTO_TEST_CASE(profiler_test) {
+  // disabled instrumentation collects nothing
+  profile::Reset();
+  {
+    profile::ScopedTimer timer{"test_phase"};
+    profile::Count("test_counter", 5);
+  }
+  std::ostringstream empty;
+  profile::WriteReport(empty);
+  const json::Document empty_report = json::Load(empty.str());
+  BOOST_REQUIRE(empty_report.GetRoot().AsMap().at("phases").AsMap().empty());
+
+  profile::SetEnabled(true);
+  for (int i = 0; i < 3; ++i) {
+    profile::ScopedTimer timer{"test_phase"};
+    profile::Count("test_counter", 5);
+    const auto allocated = std::make_unique<int>(i);
+  }
+  profile::SetEnabled(false);
+  std::ostringstream out;
+  profile::WriteReport(out);
+  profile::Reset();
+
+  const json::Document report = json::Load(out.str());
+  const auto &counters = report.GetRoot().AsMap().at("counters").AsMap();
+  BOOST_CHECK_EQUAL(counters.at("test_counter").AsInt(), 15);
+  BOOST_CHECK_GE(counters.at("allocations").AsInt(), 3);
+  const auto &phase =
+      report.GetRoot().AsMap().at("phases").AsMap().at("test_phase").AsMap();
+  BOOST_CHECK_EQUAL(phase.at("calls").AsInt(), 3);
+  BOOST_CHECK_GE(phase.at("allocations").AsInt(), 3);
+  BOOST_CHECK_GE(phase.at("total_ms").AsDouble(),
+                 phase.at("max_ms").AsDouble());
+}
+
+BOOST_AUTO_TEST_CASE(incremental_all_pairs_test) {
+  using Router = graph::Router<double>;
+  const size_t vertex_count = 120;
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> weight_dist(0.0, 100.0);
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  auto random_edges = [&generator, &weight_dist](size_t count,
+                                                 size_t vertices) {
+    std::uniform_int_distribution<size_t> vertex_dist(0, vertices - 1);
+    std::vector<graph::Edge<double>> edges;
+    for (size_t i = 0; i < count; ++i) {
+      edges.push_back(graph::Edge<double>{}
+                          .SetFromVertex(vertex_dist(generator))
+                          .SetToVertex(vertex_dist(generator))
+                          .SetWeight(weight_dist(generator))
+                          .SetBus(nullptr)
+                          .SetStopCount(1));
+    }
+    return edges;
+  };
+  graph::DirectedWeightedGraph<double> previous_builder(vertex_count);
+  for (const auto &edge : random_edges(vertex_count * 3, vertex_count)) {
+    previous_builder.AddEdge(edge);
+  }
+  const graph::CsrGraph<double> previous_graph(previous_builder);
+  const Router previous(previous_graph);
+
+  // vertex 0 is removed and 10 vertices are added, some edges are removed,
+  // reweighted or added
+  const size_t updated_count = vertex_count - 1 + 10;
+  std::vector<uint32_t> vertex_ids{Router::NO_VERTEX};
+  for (uint32_t id = 0; id + 1 < vertex_count; ++id) {
+    vertex_ids.push_back(id);
+  }
+  // previous edge id of every updated edge, if it is kept
+  std::vector<std::pair<graph::Edge<double>, uint32_t>> edges;
+  for (graph::EdgeId id = 0; id < previous_graph.GetEdgeCount(); ++id) {
+    auto edge = previous_graph.GetEdge(id);
+    if (edge.from == 0 || edge.to == 0 || chance(generator) < 0.05) {
+      continue;
+    }
+    edge.SetFromVertex(edge.from - 1).SetToVertex(edge.to - 1);
+    if (chance(generator) < 0.05) {
+      edges.emplace_back(edge.SetWeight(weight_dist(generator)),
+                         Router::NO_EDGE);
+    } else {
+      edges.emplace_back(edge, static_cast<uint32_t>(id));
+    }
+  }
+  for (const auto &edge : random_edges(40, updated_count)) {
+    edges.emplace_back(edge, Router::NO_EDGE);
+  }
+  // builder edges grouped by source keep their ids in CSR graph
+  std::stable_sort(edges.begin(), edges.end(),
+                   [](const auto &lhs, const auto &rhs) {
+                     return lhs.first.from < rhs.first.from;
+                   });
+  graph::DirectedWeightedGraph<double> builder(updated_count);
+  std::vector<uint32_t> edge_ids(previous_graph.GetEdgeCount(),
+                                 Router::NO_EDGE);
+  for (const auto &[edge, previous_id] : edges) {
+    const graph::EdgeId id = builder.AddEdge(edge);
+    if (previous_id != Router::NO_EDGE) {
+      edge_ids[previous_id] = static_cast<uint32_t>(id);
+    }
+  }
+  const graph::CsrGraph<double> graph(builder);
+
+  const auto &table = previous.GetRoutesTable();
+  const Router updated(graph,
+                       graph::RouterView<double>(previous_graph,
+                                                 table.weights.data(),
+                                                 table.prev_edges.data()),
+                       vertex_ids, edge_ids);
+  const graph::DijkstraRouter<double> dijkstra(graph);
+  for (graph::VertexId from = 0; from < updated_count; ++from) {
+    for (graph::VertexId to = 0; to < updated_count; ++to) {
+      const auto expected = dijkstra.BuildRoute(from, to);
+      const auto route = updated.BuildRoute(from, to);
+      BOOST_REQUIRE_EQUAL(expected.has_value(), route.has_value());
+      if (!expected) {
+        continue;
+      }
+      BOOST_REQUIRE_CLOSE(expected->weight + 1, route->weight + 1, 1e-9);
+      // carried over routes must consist of updated edges
+      double weight = 0;
+      graph::VertexId vertex = from;
+      for (const graph::EdgeId edge_id : route->edges) {
+        BOOST_REQUIRE_EQUAL(graph.GetEdgeSource(edge_id), vertex);
+        weight += graph.GetEdgeWeight(edge_id);
+        vertex = graph.GetEdgeTarget(edge_id);
+      }
+      BOOST_REQUIRE_EQUAL(vertex, to);
+      BOOST_REQUIRE_CLOSE(weight + 1, route->weight + 1, 1e-9);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(base_update_test) {
+  const json::Document doc = LoadTimeTestInput();
+  const auto &doc_map = doc.GetRoot().AsMap();
+  const auto &requests = doc_map.at("base_requests").AsArray();
+
+  // base misses one of the buses and has extra stop (which shifts ids of
+  // the others) and bus, update restores original contents
+  const std::string stop_name =
+      std::find_if(requests.begin(), requests.end(), [](const auto &request) {
+        return request.AsMap().at("type").AsString() == "Stop";
+      })->AsMap().at("name").AsString();
+  json::Array base_requests{json::Dict{
+      {"type", "Stop"},
+      {"name", "Extra stop"},
+      {"latitude", 55.0},
+      {"longitude", 37.0},
+      {"road_distances", json::Dict{{stop_name, 1000}}}}};
+  base_requests.push_back(
+      json::Dict{{"type", "Bus"},
+                 {"name", "Extra bus"},
+                 {"is_roundtrip", false},
+                 {"stops", json::Array{"Extra stop", stop_name}}});
+  json::Array update_requests{
+      json::Dict{{"type", "RemoveBus"}, {"name", "Extra bus"}},
+      json::Dict{{"type", "RemoveStop"}, {"name", "Extra stop"}}};
+  for (const auto &request : requests) {
+    if (update_requests.size() == 2 &&
+        request.AsMap().at("type").AsString() == "Bus") {
+      update_requests.push_back(request);
+    } else {
+      base_requests.push_back(request);
+    }
+  }
+
+  std::stringstream stream;
+  {
+    std::ostringstream out_str_stream;
+    core::TransportCatalogue database{};
+    core::TransportRouter router{database};
+    graphics::MapRenderer renderer{};
+    core::RequestHandler req_handler{out_str_stream, database, renderer,
+                                     router};
+    json::JsonReader json_reader{database, req_handler};
+    json_reader.ProcessInput(
+        json::Dict{{"base_requests", base_requests},
+                   {"render_settings", doc_map.at("render_settings")},
+                   {"routing_settings", doc_map.at("routing_settings")}},
+        input_info::OutputFormat::None);
+    serialization::Serializer serializer{};
+    database.ExportDataBase(serializer);
+    renderer.ExportRenderSettings(serializer);
+    router.ExportState(serializer);
+    serializer.SerializeToOstream(&stream);
+  }
+  serialization::TrCatalogue sr_catalogue;
+  BOOST_REQUIRE(sr_catalogue.ParseFromIstream(&stream));
+  core::TransportCatalogue previous{};
+  core::TransportRouter previous_router{previous};
+  previous.ImportDataBase(sr_catalogue);
+  previous_router.ImportState(sr_catalogue);
+
+  std::ostringstream out_str_stream;
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out_str_stream, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+  renderer.ImportRenderSettings(sr_catalogue);
+  for (const auto &request : update_requests) {
+    json_reader.ParseSingleCommand(request);
+  }
+  json_reader.InsertUpdateIntoCatalogue(previous);
+  BOOST_REQUIRE(!database.GetStopInfo("Extra stop"));
+  BOOST_REQUIRE(!database.GetBusInfo("Extra bus"));
+  router.PrepareRouting(previous_router);
+  json_reader.ProcessInput(
+      json::Dict{{"stat_requests", doc_map.at("stat_requests")}});
+  CheckTotalTimes(out_str_stream.str());
+
+  // stop can't be removed while some bus uses it
+  core::TransportCatalogue rejected{};
+  json::JsonReader rejecting_reader{rejected, req_handler};
+  rejecting_reader.ParseSingleCommand(
+      json::Dict{{"type", "RemoveStop"}, {"name", stop_name}});
+  BOOST_REQUIRE_THROW(rejecting_reader.InsertUpdateIntoCatalogue(database),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_reload_test) {
+  const json::Document doc = LoadTimeTestInput();
+  const auto &doc_map = doc.GetRoot().AsMap();
+  const std::string file =
+      (std::filesystem::temp_directory_path() / "snapshot_test.db").string();
+  {
+    std::ostringstream out_str_stream;
+    core::TransportCatalogue database{};
+    core::TransportRouter router{database};
+    graphics::MapRenderer renderer{};
+    core::RequestHandler req_handler{out_str_stream, database, renderer,
+                                     router};
+    json::JsonReader json_reader{database, req_handler};
+    json_reader.ProcessInput(doc_map, input_info::OutputFormat::None);
+
+    serialization::Serializer serializer{};
+    database.ExportDataBase(serializer);
+    renderer.ExportRenderSettings(serializer);
+    router.ExportState(serializer);
+    std::ofstream out(file, std::ios::binary);
+    serializer.SerializeToFlatOstream(&out);
+  }
+
+  auto answer = [&doc_map](core::Snapshot &snapshot) {
+    std::ostringstream out_str_stream;
+    core::RequestHandler req_handler{out_str_stream, snapshot.database,
+                                     snapshot.renderer, snapshot.router};
+    json::JsonReader json_reader{snapshot.database, req_handler};
+    json_reader.ProcessInput(
+        json::Dict{{"stat_requests", doc_map.at("stat_requests")}});
+    CheckTotalTimes(out_str_stream.str());
+  };
+
+  core::SnapshotHolder snapshots;
+  BOOST_REQUIRE(!snapshots.Acquire());
+  snapshots.Load(file);
+  auto first = snapshots.Acquire();
+  BOOST_REQUIRE(first);
+
+  // reader keeps using its snapshot while the next one is loaded and
+  // published
+  BOOST_REQUIRE(snapshots.StartLoading(file));
+  while (snapshots.Acquire() == first) {
+    answer(*first);
+  }
+  answer(*snapshots.Acquire());
+  answer(*first);
+  first.reset();
+  snapshots.Wait();
+  BOOST_REQUIRE(!snapshots.IsLoading());
+  BOOST_REQUIRE(!snapshots.TakeLoadError());
+
+  // once published, next loading may start even if the caller still holds
+  // the snapshot that was replaced
+  auto held = snapshots.Acquire();
+  BOOST_REQUIRE(snapshots.StartLoading(file));
+  while (snapshots.IsLoading()) {
+    std::this_thread::yield();
+  }
+  BOOST_REQUIRE(snapshots.Acquire() != held);
+  BOOST_REQUIRE(snapshots.StartLoading(file));
+  snapshots.Wait();
+  answer(*held);
+  held.reset();
+  BOOST_REQUIRE(!snapshots.TakeLoadError());
+
+  // failed loading keeps current snapshot
+  auto current = snapshots.Acquire();
+  std::filesystem::remove(file);
+  BOOST_REQUIRE(snapshots.StartLoading(file));
+  snapshots.Wait();
+  BOOST_REQUIRE(snapshots.Acquire() == current);
+  BOOST_REQUIRE(snapshots.TakeLoadError());
+  BOOST_REQUIRE(!snapshots.TakeLoadError());
+  answer(*current);
+}
+
+BOOST_AUTO_TEST_CASE(catalogue_adjacency_test) {
+  core::TransportCatalogue database{};
+  database.AddStop({"C", {55.60, 37.20}});
+  database.AddStop({"A", {55.61, 37.20}});
+  database.AddStop({"B", {55.62, 37.20}});
+  database.AddStopLinks({"A", {{"B", 100}, {"C", 300}}});
+  database.AddStopLinks({"B", {{"C", 200}}});
+  // later link overrides earlier one
+  database.AddStopLinks({"A", {{"B", 150}}});
+  database.AddBus({"Z", {"A", "B", "C"}, false});
+  database.AddBus({"Y", {"C", "A", "C"}, true});
+
+  auto stop_info = database.GetStopInfo("C");
+  BOOST_REQUIRE(stop_info);
+  BOOST_REQUIRE(stop_info->linked_stops.empty());
+  // buses are ordered by name rather than by id
+  BOOST_REQUIRE_EQUAL(stop_info->linked_buses.size(), 2);
+  BOOST_REQUIRE_EQUAL(stop_info->linked_buses[0], 1);
+  BOOST_REQUIRE_EQUAL(stop_info->buses_json_line, R"(["Y","Z"])");
+
+  stop_info = database.GetStopInfo("A");
+  BOOST_REQUIRE_EQUAL(stop_info->linked_stops.size(), 2);
+  BOOST_REQUIRE_EQUAL(stop_info->linked_stops[0], 0);
+  BOOST_REQUIRE_EQUAL(stop_info->linked_distances[0], 300);
+  BOOST_REQUIRE_EQUAL(stop_info->linked_distances[1], 150);
+  BOOST_REQUIRE(!database.GetStopInfo("D"));
+
+  BOOST_REQUIRE_EQUAL(*database.GetStopsRealDist("A", "B"), 150);
+  // distance of reverse direction is used if there is no direct one
+  BOOST_REQUIRE_EQUAL(*database.GetStopsRealDist("C", "B"), 200);
+  BOOST_REQUIRE_EQUAL(database.GetBusInfo("Z")->real_length,
+                      2 * (150 + 200));
+  BOOST_REQUIRE_EQUAL(database.GetBusInfo("Z")->unique_stops.size(), 3);
+  BOOST_REQUIRE_EQUAL(database.GetBusInfo("Y")->unique_stops.size(), 2);
+
+  // rows are rebuilt once something is added
+  database.AddStop({"D", {55.63, 37.20}});
+  database.AddStopLinks({"D", {{"C", 50}}});
+  database.AddBus({"X", {"D", "C"}, false});
+  BOOST_REQUIRE_EQUAL(database.GetStopInfo("C")->buses_json_line,
+                      R"(["X","Y","Z"])");
+  BOOST_REQUIRE_EQUAL(database.GetStopInfo("D")->linked_buses.size(), 1);
+  BOOST_REQUIRE_EQUAL(database.GetStopInfo("A")->linked_distances[1], 150);
+}
+
+BOOST_AUTO_TEST_CASE(precomputed_answers_test) {
+  const json::Document doc = LoadTimeTestInput();
+  const auto &doc_map = doc.GetRoot().AsMap();
+  const json::Dict stat_requests{
+      {"stat_requests", doc_map.at("stat_requests")}};
+  std::ostringstream out_str_stream;
+  core::TransportCatalogue database{};
+  core::TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+  core::RequestHandler req_handler{out_str_stream, database, renderer, router};
+  json::JsonReader json_reader{database, req_handler};
+  json_reader.ProcessInput(doc_map, input_info::OutputFormat::None);
+
+  auto answer = [&](input_info::OutputFormat format) {
+    out_str_stream.str({});
+    json_reader.ProcessInput(stat_requests, format);
+    return out_str_stream.str();
+  };
+  const std::string pretty = answer(input_info::OutputFormat::Json);
+  const std::string single_line = answer(input_info::OutputFormat::JsonLine);
+
+  BOOST_REQUIRE(!database.GetPrecomputedAnswers());
+  database.SetPrecomputedAnswers(req_handler.PrecomputeAnswers());
+  BOOST_REQUIRE(database.GetPrecomputedAnswers());
+  BOOST_REQUIRE_EQUAL(answer(input_info::OutputFormat::Json), pretty);
+  BOOST_REQUIRE_EQUAL(answer(input_info::OutputFormat::JsonLine),
+                      single_line);
+
+  // answers are stored with database
+  serialization::Serializer serializer{};
+  database.ExportDataBase(serializer);
+  std::stringstream base;
+  serializer.SerializeToOstream(&base);
+  serialization::TrCatalogue sr_catalogue;
+  BOOST_REQUIRE(sr_catalogue.ParseFromIstream(&base));
+  core::TransportCatalogue imported{};
+  imported.ImportDataBase(sr_catalogue);
+  BOOST_REQUIRE(imported.GetPrecomputedAnswers());
+  BOOST_REQUIRE_EQUAL(imported.GetPrecomputedAnswers()->text,
+                      database.GetPrecomputedAnswers()->text);
+
+  // answers of other contents are rejected, and dropped by insertion
+  BOOST_REQUIRE_THROW(imported.SetPrecomputedAnswers({}),
+                      std::invalid_argument);
+  imported.AddStop({"Extra stop", {55.60, 37.20}});
+  BOOST_REQUIRE(!imported.GetPrecomputedAnswers());
+}
@@ -0,0 +1,563 @@
+/*!
+ * \file contraction_hierarchy.h
+ * \brief Contraction hierarchies preprocessing and bidirectional query
+ */
+
+#pragma once
+
+#include "graph.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+/*!
+ * \brief Router based on <a
+ * href="https://en.wikipedia.org/wiki/Contraction_hierarchies">contraction
+ * hierarchies</a>
+ *
+ * Vertices are contracted one by one (least important first), each
+ * contraction inserts shortcut edges which preserve shortest paths between
+ * remaining vertices. Queries then only follow edges leading to more important
+ * vertices from both ends, which visits a tiny part of the graph.
+ *
+ * Edges are addressed by "extended" ids: ids below graph edge count belong to
+ * the original graph, the rest refer to shortcuts (shortcut index + graph edge
+ * count). Shortcuts are expanded back into original edges when building route.
+ */
+template <typename Weight> class ContractionHierarchy {
+private:
+  using Graph = CsrGraph<Weight>;
+
+public:
+  using RouteInfo = graph::RouteInfo<Weight>;
+
+  //! Edge replacing path of two (extended) edges: first, then second
+  struct Shortcut {
+    VertexId from;
+    VertexId to;
+    Weight weight;
+    EdgeId first;
+    EdgeId second;
+  };
+
+  //! Runs preprocessing (vertices contraction) over the given graph
+  explicit ContractionHierarchy(const Graph &graph);
+
+  //! Restores previously computed hierarchy, no contraction is performed
+  ContractionHierarchy(const Graph &graph, std::vector<size_t> &&ranks,
+                       std::vector<Shortcut> &&shortcuts);
+
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+  //! Contraction order: vertex with rank 0 was contracted first
+  const std::vector<size_t> &GetRanks() const { return ranks_; }
+  const std::vector<Shortcut> &GetShortcuts() const { return shortcuts_; }
+
+private:
+  //! Adjacency entry: neighbour vertex, edge weight and extended edge id
+  struct Arc {
+    VertexId vertex;
+    Weight weight;
+    EdgeId id;
+  };
+
+  //! Graph being contracted, arcs of contracted vertices are removed
+  struct Overlay {
+    std::vector<std::vector<Arc>> out;
+    std::vector<std::vector<Arc>> in;
+    std::vector<bool> contracted;
+    std::vector<size_t> contracted_neighbours;
+  };
+
+  //! Reusable buffers of local searches looking for paths avoiding a vertex
+  struct WitnessSearch {
+    std::vector<std::optional<Weight>> dist;
+    std::vector<VertexId> touched;
+    std::vector<bool> is_target;
+  };
+
+  //! Single direction of the bidirectional query
+  struct SearchSpace {
+    std::vector<std::optional<Weight>> dist;
+    std::vector<EdgeId> prev_edge;
+    std::vector<VertexId> touched;
+
+    void Reset(size_t vertex_count);
+  };
+
+  using QueueItem = std::pair<Weight, VertexId>;
+  using MinQueue = std::priority_queue<QueueItem, std::vector<QueueItem>,
+                                       std::greater<QueueItem>>;
+
+  static constexpr Weight ZERO_WEIGHT{};
+  //! Witness searches give up after settling this many vertices (which only
+  //! results in extra shortcuts, never in wrong answers)
+  static constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+
+  const Graph &graph_;
+  std::vector<size_t> ranks_;
+  std::vector<Shortcut> shortcuts_;
+
+  //! Edges leading to higher ranked vertices, grouped by their source
+  std::vector<size_t> up_offsets_;
+  std::vector<Arc> up_arcs_;
+  //! Edges coming from higher ranked vertices, grouped by their target
+  std::vector<size_t> down_offsets_;
+  std::vector<Arc> down_arcs_;
+
+  void Contract();
+
+  Overlay BuildOverlay() const;
+
+  //! Shortcuts which must be inserted if vertex is contracted right now
+  std::vector<Shortcut> FindShortcuts(const Overlay &overlay,
+                                      WitnessSearch &search,
+                                      VertexId vertex) const;
+
+  //! Edge difference heuristic, vertices with lower values go first
+  static int ComputePriority(const Overlay &overlay, VertexId vertex,
+                             size_t shortcuts_count);
+
+  void ContractVertex(Overlay &overlay, VertexId vertex,
+                      std::vector<Shortcut> &&required);
+
+  //! Local Dijkstra search from source, which never enters avoided vertex.
+  //! Stops once all vertices marked as targets are settled
+  void RunWitnessSearch(const Overlay &overlay, WitnessSearch &search,
+                        VertexId source, VertexId avoid, Weight max_weight,
+                        size_t targets_count) const;
+
+  static void InsertArc(std::vector<Arc> &arcs, Arc arc);
+
+  //! Only the lightest of parallel edges may be a part of shortest path
+  static void KeepLightestArcs(std::vector<Arc> &arcs);
+
+  void BuildSearchGraphs();
+
+  VertexId GetEdgeFrom(EdgeId id) const;
+  VertexId GetEdgeTo(EdgeId id) const;
+
+  //! Expands extended edge into original graph edges (in travel order)
+  void UnpackEdge(EdgeId id, std::vector<EdgeId> &edges) const;
+};
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(const Graph &graph)
+    : graph_(graph) {
+  for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+    if (graph.GetEdgeWeight(edge_id) < ZERO_WEIGHT) {
+      throw std::domain_error("Edges' weights should be non-negative");
+    }
+  }
+  Contract();
+  BuildSearchGraphs();
+}
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(
+    const Graph &graph, std::vector<size_t> &&ranks,
+    std::vector<Shortcut> &&shortcuts)
+    : graph_(graph), ranks_(std::move(ranks)),
+      shortcuts_(std::move(shortcuts)) {
+  if (ranks_.size() != graph.GetVertexCount()) {
+    throw std::invalid_argument("Ranks do not match graph vertices");
+  }
+  // shortcut may only consist of graph edges and earlier shortcuts, so that
+  // its expansion ends
+  for (size_t i = 0; i < shortcuts_.size(); ++i) {
+    const Shortcut &shortcut = shortcuts_[i];
+    const size_t known_edges = graph.GetEdgeCount() + i;
+    if (shortcut.from >= graph.GetVertexCount() ||
+        shortcut.to >= graph.GetVertexCount() ||
+        shortcut.first >= known_edges || shortcut.second >= known_edges) {
+      throw std::invalid_argument("Shortcut refers to unknown edge or vertex");
+    }
+  }
+  BuildSearchGraphs();
+}
+
+template <typename Weight>
+typename ContractionHierarchy<Weight>::Overlay
+ContractionHierarchy<Weight>::BuildOverlay() const {
+  const size_t vertex_count = graph_.GetVertexCount();
+  Overlay overlay{std::vector<std::vector<Arc>>(vertex_count),
+                  std::vector<std::vector<Arc>>(vertex_count),
+                  std::vector<bool>(vertex_count, false),
+                  std::vector<size_t>(vertex_count, 0)};
+  for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+    const VertexId from = graph_.GetEdgeSource(edge_id);
+    const VertexId to = graph_.GetEdgeTarget(edge_id);
+    const Weight weight = graph_.GetEdgeWeight(edge_id);
+    if (from != to) {
+      overlay.out[from].push_back({to, weight, edge_id});
+      overlay.in[to].push_back({from, weight, edge_id});
+    }
+  }
+  for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+    KeepLightestArcs(overlay.out[vertex]);
+    KeepLightestArcs(overlay.in[vertex]);
+  }
+  return overlay;
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::KeepLightestArcs(std::vector<Arc> &arcs) {
+  std::sort(arcs.begin(), arcs.end(), [](const Arc &lhs, const Arc &rhs) {
+    return std::tie(lhs.vertex, lhs.weight, lhs.id) <
+           std::tie(rhs.vertex, rhs.weight, rhs.id);
+  });
+  arcs.erase(std::unique(arcs.begin(), arcs.end(),
+                         [](const Arc &lhs, const Arc &rhs) {
+                           return lhs.vertex == rhs.vertex;
+                         }),
+             arcs.end());
+}
+
+template <typename Weight> void ContractionHierarchy<Weight>::Contract() {
+  const size_t vertex_count = graph_.GetVertexCount();
+  Overlay overlay = BuildOverlay();
+  WitnessSearch search{std::vector<std::optional<Weight>>(vertex_count),
+                       {},
+                       std::vector<bool>(vertex_count, false)};
+
+  using PriorityItem = std::pair<int, VertexId>;
+  std::priority_queue<PriorityItem, std::vector<PriorityItem>,
+                      std::greater<PriorityItem>>
+      queue;
+  for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+    const size_t shortcuts = FindShortcuts(overlay, search, vertex).size();
+    queue.emplace(ComputePriority(overlay, vertex, shortcuts), vertex);
+  }
+
+  ranks_.assign(vertex_count, 0);
+  size_t next_rank{0};
+  while (!queue.empty()) {
+    const VertexId vertex = queue.top().second;
+    queue.pop();
+    // lazy update: priority could have grown since it was pushed
+    auto required = FindShortcuts(overlay, search, vertex);
+    const int priority = ComputePriority(overlay, vertex, required.size());
+    if (!queue.empty() && priority > queue.top().first) {
+      queue.emplace(priority, vertex);
+      continue;
+    }
+    ContractVertex(overlay, vertex, std::move(required));
+    ranks_[vertex] = next_rank++;
+  }
+}
+
+template <typename Weight>
+int ContractionHierarchy<Weight>::ComputePriority(const Overlay &overlay,
+                                                  VertexId vertex,
+                                                  size_t shortcuts_count) {
+  const auto removed = static_cast<int>(overlay.in[vertex].size() +
+                                        overlay.out[vertex].size());
+  return static_cast<int>(shortcuts_count) - removed +
+         static_cast<int>(overlay.contracted_neighbours[vertex]);
+}
+
+template <typename Weight>
+std::vector<typename ContractionHierarchy<Weight>::Shortcut>
+ContractionHierarchy<Weight>::FindShortcuts(const Overlay &overlay,
+                                            WitnessSearch &search,
+                                            VertexId vertex) const {
+  const auto &in_arcs = overlay.in[vertex];
+  const auto &out_arcs = overlay.out[vertex];
+  std::vector<Shortcut> required;
+
+  Weight max_out{ZERO_WEIGHT};
+  for (const Arc &out_arc : out_arcs) {
+    max_out = std::max(max_out, out_arc.weight);
+    search.is_target[out_arc.vertex] = true;
+  }
+  for (const Arc &in_arc : in_arcs) {
+    RunWitnessSearch(overlay, search, in_arc.vertex, vertex,
+                     in_arc.weight + max_out, out_arcs.size());
+    for (const Arc &out_arc : out_arcs) {
+      if (out_arc.vertex == in_arc.vertex) {
+        continue;
+      }
+      const Weight through = in_arc.weight + out_arc.weight;
+      const auto &witness = search.dist[out_arc.vertex];
+      if (!witness || through < *witness) {
+        required.push_back(
+            {in_arc.vertex, out_arc.vertex, through, in_arc.id, out_arc.id});
+      }
+    }
+  }
+  for (const Arc &out_arc : out_arcs) {
+    search.is_target[out_arc.vertex] = false;
+  }
+  return required;
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::ContractVertex(
+    Overlay &overlay, VertexId vertex, std::vector<Shortcut> &&required) {
+  for (Shortcut &shortcut : required) {
+    const EdgeId id = graph_.GetEdgeCount() + shortcuts_.size();
+    InsertArc(overlay.out[shortcut.from], {shortcut.to, shortcut.weight, id});
+    InsertArc(overlay.in[shortcut.to], {shortcut.from, shortcut.weight, id});
+    shortcuts_.push_back(shortcut);
+  }
+
+  // detach vertex, its remaining arcs lead to higher ranked vertices only
+  overlay.contracted[vertex] = true;
+  auto detach = [vertex](std::vector<Arc> &arcs) {
+    arcs.erase(std::remove_if(arcs.begin(), arcs.end(),
+                              [vertex](const Arc &arc) {
+                                return arc.vertex == vertex;
+                              }),
+               arcs.end());
+  };
+  for (const Arc &in_arc : overlay.in[vertex]) {
+    detach(overlay.out[in_arc.vertex]);
+    ++overlay.contracted_neighbours[in_arc.vertex];
+  }
+  for (const Arc &out_arc : overlay.out[vertex]) {
+    detach(overlay.in[out_arc.vertex]);
+    ++overlay.contracted_neighbours[out_arc.vertex];
+  }
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::RunWitnessSearch(
+    const Overlay &overlay, WitnessSearch &search, VertexId source,
+    VertexId avoid, Weight max_weight, size_t targets_count) const {
+  for (VertexId vertex : search.touched) {
+    search.dist[vertex].reset();
+  }
+  search.touched.clear();
+
+  MinQueue queue;
+  search.dist[source] = ZERO_WEIGHT;
+  search.touched.push_back(source);
+  queue.emplace(ZERO_WEIGHT, source);
+  size_t settled{0}, settled_targets{0};
+  while (!queue.empty() && settled < WITNESS_SETTLE_LIMIT &&
+         settled_targets < targets_count) {
+    const auto [weight, vertex] = queue.top();
+    queue.pop();
+    if (weight > *search.dist[vertex]) {
+      continue;
+    }
+    if (weight > max_weight) {
+      break;
+    }
+    ++settled;
+    if (search.is_target[vertex]) {
+      ++settled_targets;
+    }
+    for (const Arc &arc : overlay.out[vertex]) {
+      if (arc.vertex == avoid || overlay.contracted[arc.vertex]) {
+        continue;
+      }
+      const Weight candidate = weight + arc.weight;
+      auto &dist = search.dist[arc.vertex];
+      if (!dist) {
+        search.touched.push_back(arc.vertex);
+      }
+      if (!dist || candidate < *dist) {
+        dist = candidate;
+        queue.emplace(candidate, arc.vertex);
+      }
+    }
+  }
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::InsertArc(std::vector<Arc> &arcs, Arc arc) {
+  auto it = std::find_if(arcs.begin(), arcs.end(), [&arc](const Arc &other) {
+    return other.vertex == arc.vertex;
+  });
+  if (it == arcs.end()) {
+    arcs.push_back(arc);
+  } else if (arc.weight < it->weight) {
+    *it = arc;
+  }
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::BuildSearchGraphs() {
+  const size_t vertex_count = graph_.GetVertexCount();
+  std::vector<std::vector<Arc>> up(vertex_count), down(vertex_count);
+  auto add = [this, &up, &down](VertexId from, VertexId to, Weight weight,
+                                EdgeId id) {
+    if (from == to) {
+      return;
+    }
+    if (ranks_[from] < ranks_[to]) {
+      up[from].push_back({to, weight, id});
+    } else {
+      down[to].push_back({from, weight, id});
+    }
+  };
+  for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+    add(graph_.GetEdgeSource(edge_id), graph_.GetEdgeTarget(edge_id),
+        graph_.GetEdgeWeight(edge_id), edge_id);
+  }
+  for (size_t i = 0; i < shortcuts_.size(); ++i) {
+    const auto &shortcut = shortcuts_[i];
+    add(shortcut.from, shortcut.to, shortcut.weight,
+        graph_.GetEdgeCount() + i);
+  }
+
+  auto flatten = [vertex_count](std::vector<std::vector<Arc>> &lists,
+                                std::vector<size_t> &offsets,
+                                std::vector<Arc> &arcs) {
+    offsets.assign(vertex_count + 1, 0);
+    arcs.clear();
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      KeepLightestArcs(lists[vertex]);
+      offsets[vertex] = arcs.size();
+      arcs.insert(arcs.end(), lists[vertex].begin(), lists[vertex].end());
+    }
+    offsets[vertex_count] = arcs.size();
+  };
+  flatten(up, up_offsets_, up_arcs_);
+  flatten(down, down_offsets_, down_arcs_);
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::SearchSpace::Reset(size_t vertex_count) {
+  if (dist.size() != vertex_count) {
+    dist.assign(vertex_count, std::nullopt);
+    prev_edge.assign(vertex_count, 0);
+    touched.clear();
+    return;
+  }
+  for (VertexId vertex : touched) {
+    dist[vertex].reset();
+  }
+  touched.clear();
+}
+
+template <typename Weight>
+std::optional<typename ContractionHierarchy<Weight>::RouteInfo>
+ContractionHierarchy<Weight>::BuildRoute(VertexId from, VertexId to) const {
+  const size_t vertex_count = graph_.GetVertexCount();
+  if (from >= vertex_count || to >= vertex_count) {
+    throw std::out_of_range("Vertex id is out of range");
+  }
+
+  // search spaces are small, so buffers are reused instead of reallocated;
+  // thread_local keeps concurrent queries independent
+  static thread_local SearchSpace forward, backward;
+  forward.Reset(vertex_count);
+  backward.Reset(vertex_count);
+
+  MinQueue forward_queue, backward_queue;
+  forward.dist[from] = ZERO_WEIGHT;
+  forward.touched.push_back(from);
+  forward_queue.emplace(ZERO_WEIGHT, from);
+  backward.dist[to] = ZERO_WEIGHT;
+  backward.touched.push_back(to);
+  backward_queue.emplace(ZERO_WEIGHT, to);
+
+  std::optional<Weight> best;
+  VertexId meeting{from};
+  bool forward_turn{true};
+
+  auto step = [this, &best, &meeting](MinQueue &queue, SearchSpace &space,
+                                      const SearchSpace &other,
+                                      const std::vector<size_t> &offsets,
+                                      const std::vector<Arc> &arcs) {
+    const auto [weight, vertex] = queue.top();
+    queue.pop();
+    if (weight > *space.dist[vertex]) {
+      return;
+    }
+    if (best && !(weight < *best)) {
+      queue = MinQueue{};
+      return;
+    }
+    if (other.dist[vertex] && (!best || weight + *other.dist[vertex] < *best)) {
+      best = weight + *other.dist[vertex];
+      meeting = vertex;
+    }
+    for (size_t i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+      const Arc &arc = arcs[i];
+      const Weight candidate = weight + arc.weight;
+      auto &dist = space.dist[arc.vertex];
+      if (!dist) {
+        space.touched.push_back(arc.vertex);
+      }
+      if (!dist || candidate < *dist) {
+        dist = candidate;
+        space.prev_edge[arc.vertex] = arc.id;
+        queue.emplace(candidate, arc.vertex);
+      }
+    }
+  };
+
+  while (!forward_queue.empty() || !backward_queue.empty()) {
+    if (backward_queue.empty() || (forward_turn && !forward_queue.empty())) {
+      step(forward_queue, forward, backward, up_offsets_, up_arcs_);
+    } else {
+      step(backward_queue, backward, forward, down_offsets_, down_arcs_);
+    }
+    forward_turn = !forward_turn;
+  }
+
+  if (!best) {
+    return std::nullopt;
+  }
+
+  std::vector<EdgeId> path;
+  for (VertexId vertex = meeting; vertex != from;
+       vertex = GetEdgeFrom(forward.prev_edge[vertex])) {
+    path.push_back(forward.prev_edge[vertex]);
+  }
+  std::reverse(path.begin(), path.end());
+  for (VertexId vertex = meeting; vertex != to;
+       vertex = GetEdgeTo(backward.prev_edge[vertex])) {
+    path.push_back(backward.prev_edge[vertex]);
+  }
+
+  std::vector<EdgeId> edges;
+  for (EdgeId id : path) {
+    UnpackEdge(id, edges);
+  }
+  return RouteInfo{*best, std::move(edges)};
+}
+
+template <typename Weight>
+VertexId ContractionHierarchy<Weight>::GetEdgeFrom(EdgeId id) const {
+  return id < graph_.GetEdgeCount()
+             ? graph_.GetEdgeSource(id)
+             : shortcuts_[id - graph_.GetEdgeCount()].from;
+}
+
+template <typename Weight>
+VertexId ContractionHierarchy<Weight>::GetEdgeTo(EdgeId id) const {
+  return id < graph_.GetEdgeCount()
+             ? graph_.GetEdgeTarget(id)
+             : shortcuts_[id - graph_.GetEdgeCount()].to;
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::UnpackEdge(
+    EdgeId id, std::vector<EdgeId> &edges) const {
+  std::vector<EdgeId> stack{id};
+  while (!stack.empty()) {
+    const EdgeId curr = stack.back();
+    stack.pop_back();
+    if (curr < graph_.GetEdgeCount()) {
+      edges.push_back(curr);
+    } else {
+      const auto &shortcut = shortcuts_[curr - graph_.GetEdgeCount()];
+      stack.push_back(shortcut.second);
+      stack.push_back(shortcut.first);
+    }
+  }
+}
+
+} // namespace graph
@@ -0,0 +1,165 @@
+/*!
+ * \file dijkstra_router.h
+ * \brief On-demand (per query) Dijkstra's algorithm router
+ */
+
+#pragma once
+
+#include "graph.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+/*!
+ * Answers every BuildRoute() call with a separate single-pair Dijkstra search
+ * over binary heap. Nothing is precomputed, so memory usage is proportional to
+ * graph size and construction is instant, but each query explores (part of)
+ * the graph.
+ */
+template <typename Weight> class DijkstraRouter {
+private:
+  using Graph = CsrGraph<Weight>;
+
+public:
+  using RouteInfo = graph::RouteInfo<Weight>;
+
+  //! Start or finish of multi-terminal route: vertex and extra weight of
+  //! getting to it (or leaving from it)
+  using Terminal = std::pair<VertexId, Weight>;
+
+  struct MultiRouteInfo {
+    //! Its weight includes extra weights of both terminals
+    RouteInfo route;
+    VertexId source;
+    VertexId target;
+  };
+
+  explicit DijkstraRouter(const Graph &graph);
+
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+  /*!
+   * Finds the lightest route from any of sources to any of targets by single
+   * search, which starts from all sources at once and stops as soon as no
+   * unexplored vertex can improve the best route found
+   */
+  std::optional<MultiRouteInfo>
+  BuildRoute(const std::vector<Terminal> &sources,
+             const std::vector<Terminal> &targets) const;
+
+private:
+  static constexpr Weight ZERO_WEIGHT{};
+  const Graph &graph_;
+
+  //! Heap element: tentative distance and vertex it belongs to
+  using QueueItem = std::pair<Weight, VertexId>;
+  using MinQueue = std::priority_queue<QueueItem, std::vector<QueueItem>,
+                                       std::greater<QueueItem>>;
+};
+
+template <typename Weight>
+DijkstraRouter<Weight>::DijkstraRouter(const Graph &graph) : graph_(graph) {
+  for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+    if (graph.GetEdgeWeight(edge_id) < ZERO_WEIGHT) {
+      throw std::domain_error("Edges' weights should be non-negative");
+    }
+  }
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo>
+DijkstraRouter<Weight>::BuildRoute(VertexId from, VertexId to) const {
+  auto result = BuildRoute({{from, ZERO_WEIGHT}}, {{to, ZERO_WEIGHT}});
+  if (!result) {
+    return std::nullopt;
+  }
+  return std::move(result->route);
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::MultiRouteInfo>
+DijkstraRouter<Weight>::BuildRoute(const std::vector<Terminal> &sources,
+                                   const std::vector<Terminal> &targets) const {
+  const size_t vertex_count = graph_.GetVertexCount();
+  // Scratch buffers are local, so concurrent queries do not interfere
+  std::vector<std::optional<Weight>> dist(vertex_count);
+  std::vector<std::optional<Weight>> target_weight(vertex_count);
+  std::vector<std::optional<EdgeId>> prev_edge(vertex_count);
+  std::vector<bool> settled(vertex_count, false);
+  MinQueue queue;
+
+  for (const auto &[vertex, weight] : targets) {
+    if (vertex >= vertex_count) {
+      throw std::out_of_range("Vertex id is out of range");
+    }
+    if (!target_weight[vertex] || weight < *target_weight[vertex]) {
+      target_weight[vertex] = weight;
+    }
+  }
+  for (const auto &[vertex, weight] : sources) {
+    if (vertex >= vertex_count) {
+      throw std::out_of_range("Vertex id is out of range");
+    }
+    if (!dist[vertex] || weight < *dist[vertex]) {
+      dist[vertex] = weight;
+      queue.emplace(weight, vertex);
+    }
+  }
+
+  std::optional<Weight> best;
+  VertexId best_target{};
+  uint64_t relaxations = 0;
+  while (!queue.empty()) {
+    const auto [weight, vertex] = queue.top();
+    queue.pop();
+    if (settled[vertex]) {
+      continue;
+    }
+    // extra weights are non-negative, so remaining vertices can't do better
+    if (best && !(weight < *best)) {
+      break;
+    }
+    settled[vertex] = true;
+    if (target_weight[vertex] &&
+        (!best || weight + *target_weight[vertex] < *best)) {
+      best = weight + *target_weight[vertex];
+      best_target = vertex;
+    }
+    for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+      const VertexId target = graph_.GetEdgeTarget(edge_id);
+      const Weight candidate = weight + graph_.GetEdgeWeight(edge_id);
+      if (!dist[target] || candidate < *dist[target]) {
+        dist[target] = candidate;
+        prev_edge[target] = edge_id;
+        queue.emplace(candidate, target);
+        ++relaxations;
+      }
+    }
+  }
+  profile::Count("dijkstra_relaxations", relaxations);
+
+  if (!best) {
+    return std::nullopt;
+  }
+  std::vector<EdgeId> edges;
+  VertexId source = best_target;
+  for (std::optional<EdgeId> edge_id = prev_edge[best_target]; edge_id;
+       edge_id = prev_edge[source]) {
+    edges.push_back(*edge_id);
+    source = graph_.GetEdgeSource(*edge_id);
+  }
+  std::reverse(edges.begin(), edges.end());
+
+  return MultiRouteInfo{RouteInfo{*best, std::move(edges)}, source,
+                        best_target};
+}
+
+} // namespace graph
@@ -1,5 +1,7 @@
 #include "domain.h"
 
+#include <utility>
+
 const geo::Coordinates &data::StopCoordsIterator::operator*() const {
   return (*wrapped_)->pos;
 }
@@ -64,6 +66,18 @@ data::RouteAnswer::Bus &data::RouteAnswer::Bus::SetTime(double number) {
   time = number;
   return *this;
 }
+data::RouteAnswer::Walk &data::RouteAnswer::Walk::SetFrom(const Stop *ptr) {
+  from = ptr;
+  return *this;
+}
+data::RouteAnswer::Walk &data::RouteAnswer::Walk::SetTo(const Stop *ptr) {
+  to = ptr;
+  return *this;
+}
+data::RouteAnswer::Walk &data::RouteAnswer::Walk::SetTime(double number) {
+  time = number;
+  return *this;
+}
 data::BusStats &data::BusStats::SetBus(Bus *ptr) {
   bus_ptr = ptr;
   return *this;
@@ -73,7 +87,7 @@ data::BusStats &data::BusStats::SetTotalStops(size_t number) {
   return *this;
 }
 data::BusStats &
-data::BusStats::SetUniqueStops(std::unordered_set<data::Stop *> &&stops) {
+data::BusStats::SetUniqueStops(std::vector<data::StopId> &&stops) {
   unique_stops = std::move(stops);
   return *this;
 }
@@ -85,23 +99,14 @@ data::BusStats &data::BusStats::SetRealLength(double val) {
   real_length = val;
   return *this;
 }
-data::StopStats &data::StopStats::SetStop(Stop *ptr) {
-  stop_ptr = ptr;
-  return *this;
-}
-data::StopStats &data::StopStats::AddLinkedBus(Bus *ptr) {
-  linked_buses.insert(ptr);
-  return *this;
-}
-data::StopStats &data::StopStats::SetLinkedStopDistance(Stop *ptr,
-                                                        double distance) {
-  linked_stops[ptr] = distance;
-  return *this;
-}
 data::Bus &data::Bus::SetBusName(std::string_view str) {
   name = str;
   return *this;
 }
+data::Bus &data::Bus::SetId(BusId value) {
+  id = value;
+  return *this;
+}
 data::Bus &data::Bus::SetCircular(bool value) {
   is_circular = value;
   return *this;
@@ -110,6 +115,12 @@ data::Bus &data::Bus::AddStop(Stop *ptr) {
   stops.emplace_back(ptr);
   return *this;
 }
+data::Bus &data::Bus::SetDistances(std::vector<double> &&forward,
+                                   std::vector<double> &&backward) {
+  forward_distances = std::move(forward);
+  backward_distances = std::move(backward);
+  return *this;
+}
 data::Stop &data::Stop::SetStopName(std::string_view str) {
   name = str;
   return *this;
@@ -118,3 +129,7 @@ data::Stop &data::Stop::SetCoordinates(geo::Coordinates value) {
   pos = value;
   return *this;
 }
+data::Stop &data::Stop::SetId(StopId value) {
+  id = value;
+  return *this;
+}
@@ -7,6 +7,8 @@
  */
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -91,58 +93,133 @@ struct RenderSettings {
 //! Dummy type used to specify program output format
 enum class OutputFormat {
   Json,
+  //! Json written on a single line (newline-delimited JSON)
+  JsonLine,
   None,
 };
+
+//! Engine used by core::TransportRouter to answer fastest path requests
+enum class RoutingAlgorithm {
+  //! All-pairs table computed once (graph::Router), O(V^2) memory
+  AllPairs,
+  //! Separate search per request (graph::DijkstraRouter), O(E) memory
+  Dijkstra,
+  //! Preprocessed shortcuts and bidirectional search
+  //! (graph::ContractionHierarchy), O(E) memory
+  ContractionHierarchies,
+  //! All-pairs table rows computed on first use and kept in LRU cache
+  //! (graph::LazyRouter), O(E + rows limit * V) memory
+  LazyAllPairs,
+};
 } // namespace input_info
 
 //! Information for internal usage in different program parts, mostly derived
 //! from input_info after processing
 namespace data {
 
+//! Dense index of stop in core::TransportCatalogue (order of addition)
+using StopId = uint32_t;
+//! Dense index of bus in core::TransportCatalogue (order of addition)
+using BusId = uint32_t;
+
+//! Read-only view over contiguous array of T
+template <typename T> class ArrayView {
+public:
+  ArrayView() = default;
+  ArrayView(const T *data, size_t size) : data_(data), size_(size) {}
+
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+  const T *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T &operator[](size_t index) const { return data_[index]; }
+
+private:
+  const T *data_{nullptr};
+  size_t size_{0};
+};
+
 //! %Stop name and position (meant for storage)
 struct Stop {
   Stop &SetStopName(std::string_view str);
   Stop &SetCoordinates(geo::Coordinates value);
+  Stop &SetId(StopId value);
   std::string name{};
   geo::Coordinates pos{};
+  StopId id{};
 };
 
 //! Route name and stops (meant for storage)
 struct Bus {
   Bus &SetBusName(std::string_view str);
+  Bus &SetId(BusId value);
   Bus &SetCircular(bool value);
   Bus &AddStop(Stop *ptr);
+  Bus &SetDistances(std::vector<double> &&forward,
+                    std::vector<double> &&backward);
   std::string name{};
+  BusId id{};
   std::vector<Stop *> stops{};
   bool is_circular{};
+  //! Prefix sums of road distances: from stops.front() to stops[i]
+  std::vector<double> forward_distances{};
+  //! Suffix sums of road distances in reverse direction: from stops.back()
+  //! to stops[i] (empty for circular routes)
+  std::vector<double> backward_distances{};
 };
 
-//! Wrapper for Stop, used to painlessly add extra information about stop
+/*!
+ * \brief %Stop with buses passing it and road distances to neighbours
+ *
+ * Views point into core::TransportCatalogue storage and stay valid until
+ * anything is added to the catalogue.
+ */
 struct StopStats {
-  StopStats &SetStop(Stop *ptr);
-  StopStats &AddLinkedBus(Bus *ptr);
-  StopStats &SetLinkedStopDistance(Stop *ptr, double distance);
-  Stop *stop_ptr{nullptr};
-  std::unordered_set<Bus *> linked_buses{};
-  std::unordered_map<Stop *, double> linked_stops{};
+  const Stop *stop_ptr{nullptr};
+  //! Buses passing the stop, ordered by name
+  ArrayView<BusId> linked_buses{};
+  //! Stops with known road distance from this stop, ordered by id
+  ArrayView<StopId> linked_stops{};
+  //! Road distances to linked_stops (in meters)
+  ArrayView<double> linked_distances{};
+  //! Names of linked_buses as JSON array, indented for the level Stop answer
+  //! puts it at (dictionary in array of answers)
+  std::string_view buses_json{};
+  //! Same array written on a single line
+  std::string_view buses_json_line{};
 };
 
 //! Wrapper for Bus, used to painlessly add extra information about route
 struct BusStats {
   BusStats &SetBus(Bus *ptr);
   BusStats &SetTotalStops(size_t number);
-  BusStats &SetUniqueStops(std::unordered_set<Stop *> &&stops);
+  BusStats &SetUniqueStops(std::vector<StopId> &&stops);
   BusStats &SetDirectLength(double val);
   BusStats &SetRealLength(double val);
   Bus *bus_ptr{nullptr};
   size_t total_stops{};
-  std::unordered_set<Stop *> unique_stops{};
+  //! Stops of the route without repeats, ordered by id
+  std::vector<StopId> unique_stops{};
   double direct_lenght{};
   double real_length{};
 };
 
-using BusStorage = std::unordered_map<std::string_view, BusStats>;
-using StopStorage = std::unordered_map<std::string_view, StopStats>;
+/*!
+ * \brief Bus and Stop answers formatted ahead of time, with request_id left
+ * out
+ *
+ * Every answer is written twice: indented for the level of answers array and
+ * on a single line. Answers of buses come first, then answers of stops (both
+ * in order of ids), so answer of bus i is entry 2i in the first layout and
+ * 2i + 1 in the second one, stops follow 2 * bus count entries.
+ */
+struct PrecomputedAnswers {
+  //! Entry i is text[offsets[2i], offsets[2i + 1]), request_id value and
+  //! text[offsets[2i + 1], offsets[2i + 2])
+  std::string text;
+  std::vector<uint32_t> offsets;
+};
 
 //! Iterator over geo::Coordinates extracted from DataStorage::Stop pointers
 //! container
@@ -185,7 +262,16 @@ struct RouteAnswer {
     size_t span_count;
     double time;
   };
-  using Item = std::variant<Wait, Bus>;
+  //! Walk between route end point and stop, the point is nullptr
+  struct Walk {
+    Walk &SetFrom(const data::Stop *ptr);
+    Walk &SetTo(const data::Stop *ptr);
+    Walk &SetTime(double number);
+    const data::Stop *from;
+    const data::Stop *to;
+    double time;
+  };
+  using Item = std::variant<Wait, Bus, Walk>;
   double total_time;
   std::vector<Item> items;
 };
@@ -0,0 +1,342 @@
+#include "flat_base.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace serialization {
+
+namespace {
+
+constexpr size_t SECTION_ALIGNMENT = 8;
+
+//! Collects sections contents before they are written to stream
+class SectionsBuilder {
+public:
+  template <typename T>
+  void Set(flat::Section section, const std::vector<T> &items) {
+    auto &bytes = sections_[static_cast<size_t>(section)];
+    bytes.resize(items.size() * sizeof(T));
+    if (!items.empty()) {
+      std::memcpy(bytes.data(), items.data(), bytes.size());
+    }
+  }
+
+  //! Section of a single struct
+  template <typename T> void Set(flat::Section section, const T &item) {
+    auto &bytes = sections_[static_cast<size_t>(section)];
+    bytes.resize(sizeof(T));
+    std::memcpy(bytes.data(), &item, sizeof(T));
+  }
+
+  void Set(flat::Section section, const std::string &bytes) {
+    sections_[static_cast<size_t>(section)].assign(bytes.begin(), bytes.end());
+  }
+
+  void Write(const Router &sr_router, std::ostream &out) const {
+    flat::Header header{};
+    std::memcpy(header.magic, flat::MAGIC, sizeof(header.magic));
+    header.version = flat::VERSION;
+    header.algorithm = static_cast<uint32_t>(sr_router.algorithm());
+    header.lazy_cache_rows = sr_router.lazy_cache_rows();
+    header.bus_wait_time = sr_router.bus_wait_time();
+    header.bus_velocity = sr_router.bus_velocity();
+
+    uint64_t offset = AlignUp(sizeof(flat::Header));
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      header.sections[i] = {offset, sections_[i].size()};
+      offset = AlignUp(offset + sections_[i].size());
+    }
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      WritePadding(header.sections[i].offset - written, out);
+      out.write(sections_[i].data(),
+                static_cast<std::streamsize>(sections_[i].size()));
+      written = header.sections[i].offset + sections_[i].size();
+    }
+    WritePadding(AlignUp(written) - written, out);
+  }
+
+private:
+  std::vector<std::vector<char>> sections_ =
+      std::vector<std::vector<char>>(static_cast<size_t>(flat::Section::Count));
+
+  static uint64_t AlignUp(uint64_t value) {
+    return (value + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT *
+           SECTION_ALIGNMENT;
+  }
+
+  static void WritePadding(uint64_t size, std::ostream &out) {
+    static const char zeros[SECTION_ALIGNMENT]{};
+    out.write(zeros, static_cast<std::streamsize>(size));
+  }
+};
+
+//! Appends string to the pool and returns its offset
+uint32_t AddString(std::string &pool, const std::string &str) {
+  const auto offset = static_cast<uint32_t>(pool.size());
+  pool += str;
+  return offset;
+}
+
+void WriteCatalogue(const TrCatalogue &sr_catalogue, std::string &pool,
+                    SectionsBuilder &sections) {
+  const auto stop_count = static_cast<size_t>(sr_catalogue.stops_size());
+  const auto bus_count = static_cast<size_t>(sr_catalogue.buses_size());
+
+  std::vector<flat::Stop> stops(stop_count, flat::Stop{});
+  for (size_t i = 0; i < stop_count; ++i) {
+    const auto &sr_stop = sr_catalogue.stops(static_cast<int>(i));
+    stops[i].lat = sr_stop.coordinates().lat();
+    stops[i].lng = sr_stop.coordinates().lng();
+    stops[i].name_offset = AddString(pool, sr_stop.name());
+    stops[i].name_size = static_cast<uint32_t>(sr_stop.name().size());
+  }
+
+  // stop stats may come in any order, ranges are laid out by stop index
+  std::vector<const StopStats *> stop_stats(stop_count, nullptr);
+  for (const auto &sr_stop_stats : sr_catalogue.stopname_to_stop_stats()) {
+    stop_stats.at(sr_stop_stats.stop_index()) = &sr_stop_stats;
+  }
+  std::vector<uint32_t> linked_buses;
+  std::vector<flat::Link> linked_stops;
+  for (size_t i = 0; i < stop_count; ++i) {
+    stops[i].buses_begin = static_cast<uint32_t>(linked_buses.size());
+    stops[i].links_begin = static_cast<uint32_t>(linked_stops.size());
+    if (stop_stats[i]) {
+      const auto &sr_stop_stats = *stop_stats[i];
+      linked_buses.insert(linked_buses.end(),
+                          sr_stop_stats.linked_buses_indexes().begin(),
+                          sr_stop_stats.linked_buses_indexes().end());
+      for (int k = 0; k < sr_stop_stats.linked_stops_indexes_size(); ++k) {
+        linked_stops.push_back({sr_stop_stats.linked_stops_distances(k),
+                                sr_stop_stats.linked_stops_indexes(k), 0});
+      }
+    }
+    stops[i].buses_end = static_cast<uint32_t>(linked_buses.size());
+    stops[i].links_end = static_cast<uint32_t>(linked_stops.size());
+  }
+
+  std::vector<flat::Bus> buses(bus_count, flat::Bus{});
+  std::vector<uint32_t> bus_stops;
+  for (size_t i = 0; i < bus_count; ++i) {
+    const auto &sr_bus = sr_catalogue.buses(static_cast<int>(i));
+    buses[i].name_offset = AddString(pool, sr_bus.name());
+    buses[i].name_size = static_cast<uint32_t>(sr_bus.name().size());
+    buses[i].is_circular = sr_bus.is_circular();
+    buses[i].stops_begin = static_cast<uint32_t>(bus_stops.size());
+    bus_stops.insert(bus_stops.end(), sr_bus.stop_indexes().begin(),
+                     sr_bus.stop_indexes().end());
+    buses[i].stops_end = static_cast<uint32_t>(bus_stops.size());
+  }
+
+  std::vector<const BusStats *> bus_stats(bus_count, nullptr);
+  for (const auto &sr_bus_stats : sr_catalogue.busname_to_bus_stats()) {
+    bus_stats.at(sr_bus_stats.bus_index()) = &sr_bus_stats;
+  }
+  std::vector<uint32_t> unique_stops;
+  for (size_t i = 0; i < bus_count; ++i) {
+    buses[i].unique_begin = static_cast<uint32_t>(unique_stops.size());
+    if (bus_stats[i]) {
+      buses[i].direct_length = bus_stats[i]->direct_length();
+      buses[i].real_length = bus_stats[i]->real_length();
+      buses[i].total_stops = bus_stats[i]->total_stops();
+      unique_stops.insert(unique_stops.end(),
+                          bus_stats[i]->uniq_stops_indexes().begin(),
+                          bus_stats[i]->uniq_stops_indexes().end());
+    }
+    buses[i].unique_end = static_cast<uint32_t>(unique_stops.size());
+  }
+
+  sections.Set(flat::Section::Stops, stops);
+  sections.Set(flat::Section::Buses, buses);
+  sections.Set(flat::Section::BusStops, bus_stops);
+  sections.Set(flat::Section::UniqueStops, unique_stops);
+  sections.Set(flat::Section::LinkedBuses, linked_buses);
+  sections.Set(flat::Section::LinkedStops, linked_stops);
+  sections.Set(flat::Section::RenderSettings,
+               sr_catalogue.render_settings().SerializeAsString());
+  sections.Set(flat::Section::RenderedMap, sr_catalogue.rendered_map());
+  sections.Set(flat::Section::AnswerText, sr_catalogue.answers().text());
+  sections.Set(flat::Section::AnswerOffsets,
+               std::vector<uint32_t>(sr_catalogue.answers().offsets().begin(),
+                                     sr_catalogue.answers().offsets().end()));
+
+  const auto &sr_index = sr_catalogue.stop_index();
+  sections.Set(flat::Section::StopGrid,
+               flat::Grid{sr_index.min_lat(), sr_index.min_lng(),
+                          sr_index.lat_step(), sr_index.lng_step(),
+                          sr_index.rows(), sr_index.cols()});
+  sections.Set(flat::Section::StopCells,
+               std::vector<uint32_t>(sr_index.cell_offsets().begin(),
+                                     sr_index.cell_offsets().end()));
+  sections.Set(flat::Section::CellStops,
+               std::vector<uint32_t>(sr_index.stop_indexes().begin(),
+                                     sr_index.stop_indexes().end()));
+}
+
+void WriteRouter(const TrCatalogue &sr_catalogue, SectionsBuilder &sections) {
+  std::unordered_map<std::string_view, uint32_t> stop_to_index, bus_to_index;
+  for (int i = 0; i < sr_catalogue.stops_size(); ++i) {
+    stop_to_index[sr_catalogue.stops(i).name()] = static_cast<uint32_t>(i);
+  }
+  for (int i = 0; i < sr_catalogue.buses_size(); ++i) {
+    bus_to_index[sr_catalogue.buses(i).name()] = static_cast<uint32_t>(i);
+  }
+
+  std::vector<flat::Vertex> vertices;
+  for (const auto &sr_vertex : sr_catalogue.id_to_vertex()) {
+    vertices.push_back(
+        {stop_to_index.at(sr_vertex.stop_name()), sr_vertex.must_wait()});
+  }
+  sections.Set(flat::Section::Vertices, vertices);
+
+  // edges are already stored in CSR order
+  const auto &sr_router = sr_catalogue.router();
+  const auto &sr_graph = sr_router.graph();
+  const size_t vertex_count = sr_graph.vertex_count();
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  std::vector<uint32_t> targets, sources, edge_buses, stop_counts;
+  std::vector<double> weights;
+  for (const auto &sr_edge : sr_graph.edge()) {
+    ++offsets.at(sr_edge.from() + 1);
+    targets.push_back(sr_edge.to());
+    weights.push_back(sr_edge.weight());
+    sources.push_back(sr_edge.from());
+    edge_buses.push_back(bus_to_index.at(sr_edge.bus_name()));
+    stop_counts.push_back(sr_edge.stop_count());
+  }
+  for (size_t vertex = 0; vertex < vertex_count; ++vertex) {
+    offsets[vertex + 1] += offsets[vertex];
+  }
+  sections.Set(flat::Section::EdgeOffsets, offsets);
+  sections.Set(flat::Section::EdgeTargets, targets);
+  sections.Set(flat::Section::EdgeWeights, weights);
+  sections.Set(flat::Section::EdgeSources, sources);
+  sections.Set(flat::Section::EdgeBuses, edge_buses);
+  sections.Set(flat::Section::EdgeStopCounts, stop_counts);
+
+  const std::vector<double> route_weights(sr_router.route_weight().begin(),
+                                          sr_router.route_weight().end());
+  const std::vector<uint32_t> route_prev_edges(
+      sr_router.route_prev_edge().begin(), sr_router.route_prev_edge().end());
+  sections.Set(flat::Section::RouteWeights, route_weights);
+  sections.Set(flat::Section::RoutePrevEdges, route_prev_edges);
+
+  const auto &sr_hierarchy = sr_router.hierarchy();
+  sections.Set(flat::Section::Ranks,
+               std::vector<uint32_t>(sr_hierarchy.rank().begin(),
+                                     sr_hierarchy.rank().end()));
+  std::vector<flat::Shortcut> shortcuts;
+  for (const auto &sr_shortcut : sr_hierarchy.shortcut()) {
+    shortcuts.push_back({sr_shortcut.weight(), sr_shortcut.from(),
+                         sr_shortcut.to(), sr_shortcut.first(),
+                         sr_shortcut.second()});
+  }
+  sections.Set(flat::Section::Shortcuts, shortcuts);
+}
+
+} // namespace
+
+bool FlatBase::IsFlatFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(flat::MAGIC)]{};
+  in.read(magic, sizeof(magic));
+  return in && std::equal(std::begin(magic), std::end(magic),
+                          std::begin(flat::MAGIC));
+}
+
+#ifdef _WIN32
+
+FlatBase::FlatBase(const std::string &path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    throw std::runtime_error("Can't open flat base " + path);
+  }
+  size_ = static_cast<size_t>(in.tellg());
+  buffer_.resize((size_ + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  in.seekg(0);
+  in.read(reinterpret_cast<char *>(buffer_.data()),
+          static_cast<std::streamsize>(size_));
+  data_ = reinterpret_cast<const char *>(buffer_.data());
+  Validate();
+}
+
+FlatBase::~FlatBase() = default;
+
+#else
+
+FlatBase::FlatBase(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Can't open flat base " + path);
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("Can't read flat base " + path);
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("Can't map flat base " + path);
+  }
+  data_ = static_cast<const char *>(mapping);
+  try {
+    Validate();
+  } catch (...) {
+    munmap(mapping, size_);
+    throw;
+  }
+}
+
+FlatBase::~FlatBase() { munmap(const_cast<char *>(data_), size_); }
+
+#endif
+
+std::string_view FlatBase::GetString(uint32_t offset, uint32_t size) const {
+  const auto pool = GetSection<char>(flat::Section::Strings);
+  if (static_cast<size_t>(offset) + size > pool.size()) {
+    throw std::out_of_range("Flat base string is out of pool");
+  }
+  return {pool.data() + offset, size};
+}
+
+void FlatBase::Validate() const {
+  if (size_ < sizeof(flat::Header) ||
+      !std::equal(std::begin(flat::MAGIC), std::end(flat::MAGIC),
+                  GetHeader().magic)) {
+    throw std::runtime_error("Not a flat base file");
+  }
+  if (GetHeader().version != flat::VERSION) {
+    throw std::runtime_error("Unsupported flat base version");
+  }
+  for (const auto &entry : GetHeader().sections) {
+    if (entry.offset % SECTION_ALIGNMENT != 0 || entry.offset > size_ ||
+        entry.size > size_ - entry.offset) {
+      throw std::runtime_error("Flat base section is out of file");
+    }
+  }
+}
+
+void WriteFlatBase(const TrCatalogue &sr_catalogue, std::ostream &out) {
+  SectionsBuilder sections;
+  std::string pool;
+  WriteCatalogue(sr_catalogue, pool, sections);
+  WriteRouter(sr_catalogue, sections);
+  sections.Set(flat::Section::Strings, pool);
+  sections.Write(sr_catalogue.router(), out);
+}
+
+} // namespace serialization
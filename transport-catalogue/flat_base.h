@@ -0,0 +1,195 @@
+/*!
+ * \file flat_base.h
+ * \brief Flat (offset based) database file which is memory-mapped on load
+ *
+ * The file is a fixed header followed by 8-byte aligned sections of plain
+ * structs and scalar arrays. Sections refer to each other by indexes, strings
+ * are stored once in a shared pool. Nothing is parsed on load: the file is
+ * mapped into memory and sections are read in place. Layout uses native byte
+ * order, so the file is only portable between machines of same endianness.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <transport_catalogue.pb.h>
+
+#include "domain.h"
+
+namespace serialization {
+
+//! On-disk structures of the flat database file
+namespace flat {
+
+inline constexpr char MAGIC[8] = {'T', 'C', 'F', 'L', 'A', 'T', '\0', '\0'};
+inline constexpr uint32_t VERSION = 7;
+//! Sentinel of missing index (e.g. route without previous edge)
+inline constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+enum class Section : uint32_t {
+  Strings,        //!< char pool referenced by name offsets
+  Stops,          //!< flat::Stop per stop
+  Buses,          //!< flat::Bus per bus
+  BusStops,       //!< uint32_t stop indexes of all buses
+  UniqueStops,    //!< uint32_t stop indexes of all buses (no repeats)
+  LinkedBuses,    //!< uint32_t bus indexes of all stops, ordered by name
+  LinkedStops,    //!< flat::Link of all stops
+  RenderSettings, //!< serialization::RenderSettings protobuf message
+  Vertices,       //!< flat::Vertex per graph vertex
+  EdgeOffsets,    //!< uint32_t CSR offsets, vertex count + 1 items
+  EdgeTargets,    //!< uint32_t per edge
+  EdgeWeights,    //!< double per edge
+  EdgeSources,    //!< uint32_t per edge
+  EdgeBuses,      //!< uint32_t bus index per edge
+  EdgeStopCounts, //!< uint32_t per edge
+  RouteWeights,   //!< double per vertex pair, infinity if unreachable
+  RoutePrevEdges, //!< uint32_t per vertex pair, NO_INDEX if absent
+  Ranks,          //!< uint32_t contraction rank per vertex
+  Shortcuts,      //!< flat::Shortcut per contraction hierarchy shortcut
+  RenderedMap,    //!< char SVG map image, empty if not prerendered
+  StopGrid,       //!< single flat::Grid of stops spatial index
+  StopCells,      //!< uint32_t offsets of grid cells, cell count + 1 items
+  CellStops,      //!< uint32_t stop indexes grouped by grid cells
+  AnswerText,     //!< char pieces of precomputed answers
+  AnswerOffsets,  //!< uint32_t, empty if answers were not precomputed
+  Count,
+};
+
+struct SectionEntry {
+  uint64_t offset;
+  uint64_t size; //!< in bytes
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t algorithm; //!< serialization::RoutingAlgorithm value
+  uint32_t lazy_cache_rows; //!< rows limit of graph::LazyRouter cache
+  uint32_t reserved;
+  //! Routing settings edge weights were computed with (velocity is in meters
+  //! per minute)
+  double bus_wait_time;
+  double bus_velocity;
+  SectionEntry sections[static_cast<size_t>(Section::Count)];
+};
+
+struct Stop {
+  double lat;
+  double lng;
+  uint32_t name_offset;
+  uint32_t name_size;
+  //! Range of Section::LinkedBuses
+  uint32_t buses_begin;
+  uint32_t buses_end;
+  //! Range of Section::LinkedStops
+  uint32_t links_begin;
+  uint32_t links_end;
+};
+
+struct Bus {
+  double direct_length;
+  double real_length;
+  uint64_t total_stops;
+  uint32_t name_offset;
+  uint32_t name_size;
+  //! Range of Section::BusStops
+  uint32_t stops_begin;
+  uint32_t stops_end;
+  //! Range of Section::UniqueStops
+  uint32_t unique_begin;
+  uint32_t unique_end;
+  uint32_t is_circular;
+  uint32_t reserved;
+};
+
+struct Link {
+  double distance;
+  uint32_t stop;
+  uint32_t reserved;
+};
+
+struct Vertex {
+  uint32_t stop;
+  uint32_t must_wait;
+};
+
+//! Geometry of geo::GridIndex
+struct Grid {
+  double min_lat;
+  double min_lng;
+  double lat_step;
+  double lng_step;
+  uint32_t rows;
+  uint32_t cols;
+};
+
+struct Shortcut {
+  double weight;
+  uint32_t from;
+  uint32_t to;
+  uint32_t first;
+  uint32_t second;
+};
+
+} // namespace flat
+
+using data::ArrayView;
+
+/*!
+ * Memory-mapped flat database file. Views returned by the object point into
+ * the mapping, so it must outlive everything imported from it.
+ */
+class FlatBase {
+public:
+  //! Checks file signature without mapping the file
+  static bool IsFlatFile(const std::string &path);
+
+  explicit FlatBase(const std::string &path);
+  FlatBase(const FlatBase &) = delete;
+  FlatBase &operator=(const FlatBase &) = delete;
+  ~FlatBase();
+
+  const flat::Header &GetHeader() const {
+    return *reinterpret_cast<const flat::Header *>(data_);
+  }
+
+  template <typename T> ArrayView<T> GetSection(flat::Section section) const;
+
+  std::string_view GetString(uint32_t offset, uint32_t size) const;
+
+private:
+  const char *data_{nullptr};
+  size_t size_{0};
+#ifdef _WIN32
+  // no mmap, the file is read into 8-byte aligned buffer instead
+  std::vector<uint64_t> buffer_;
+#endif
+
+  void Validate() const;
+};
+
+/*!
+ * Writes database accumulated by Serializer in flat format
+ * \param[in] sr_catalogue complete database message
+ * \param[out] out binary stream
+ */
+void WriteFlatBase(const TrCatalogue &sr_catalogue, std::ostream &out);
+
+template <typename T>
+ArrayView<T> FlatBase::GetSection(flat::Section section) const {
+  const auto &entry = GetHeader().sections[static_cast<size_t>(section)];
+  if (entry.size % sizeof(T) != 0) {
+    throw std::runtime_error("Flat base section has unexpected size");
+  }
+  return {reinterpret_cast<const T *>(data_ + entry.offset),
+          entry.size / sizeof(T)};
+}
+
+} // namespace serialization
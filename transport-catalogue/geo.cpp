@@ -1,5 +1,16 @@
 #include "geo.h"
 
+#include <algorithm>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#define GEO_USE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) ||                                 \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GEO_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 bool geo::Coordinates::operator!=(const Coordinates &other) const {
   return !(*this == other);
 }
@@ -7,3 +18,191 @@ bool geo::Coordinates::operator!=(const Coordinates &other) const {
 bool geo::Coordinates::operator==(const Coordinates &other) const {
   return lat == other.lat && lng == other.lng;
 }
+
+namespace geo {
+
+namespace {
+
+struct UnitVector {
+  double x, y, z;
+};
+
+UnitVector ToUnitVector(Coordinates pos) {
+  const double lat = pos.lat * DEG_TO_RAD;
+  const double lng = pos.lng * DEG_TO_RAD;
+  return {std::cos(lat) * std::cos(lng), std::cos(lat) * std::sin(lng),
+          std::sin(lat)};
+}
+
+//! Dot product or squared chord of a single pair, see ComputeTerms()
+double ComputeTerm(double x1, double y1, double z1, double x2, double y2,
+                   double z2, bool dot) {
+  if (!dot) {
+    x1 = x2 = x1 - x2;
+    y1 = y2 = y1 - y2;
+    z1 = z2 = z1 - z2;
+  }
+#if defined(GEO_USE_AVX2)
+  return std::fma(x1, x2, std::fma(y1, y2, z1 * z2));
+#else
+  return x1 * x2 + (y1 * y2 + z1 * z2);
+#endif
+}
+
+//! Turns result of ComputeTerm() into distance (in meters)
+double TermToDistance(DistanceFormula formula, double value) {
+  if (formula == DistanceFormula::Cosines) {
+    return std::acos(std::clamp(value, -1.0, 1.0)) * EARTH_RADIUS;
+  }
+  // chord c of unit sphere spans angle 2 * asin(c / 2), which is haversine
+  // formula written for vectors
+  return 2 * std::asin(std::min(std::sqrt(value) / 2, 1.0)) * EARTH_RADIUS;
+}
+
+//! Unit vectors of pairs: first of pair is either a single vector (\p Single)
+//! or a vector per pair
+template <bool Single> struct VectorPairs {
+  const double *x1, *y1, *z1;
+  const double *x2, *y2, *z2;
+};
+
+/*!
+ * Computes dot products (DistanceFormula::Cosines) or squared chords
+ * (DistanceFormula::Haversine) of unit vector pairs. Every lane computes
+ * exactly the same operations as the scalar tail, so result doesn't depend on
+ * position of a pair in batch
+ */
+template <bool Single>
+void ComputeTerms(const VectorPairs<Single> &pairs, size_t count,
+                  DistanceFormula formula, double *result) {
+  const bool dot = formula == DistanceFormula::Cosines;
+  size_t i = 0;
+#if defined(GEO_USE_AVX2)
+  auto load_first = [](const double *values, size_t index) {
+    return Single ? _mm256_broadcast_sd(values)
+                  : _mm256_loadu_pd(values + index);
+  };
+  for (; i + 4 <= count; i += 4) {
+    __m256d x1 = load_first(pairs.x1, i);
+    __m256d y1 = load_first(pairs.y1, i);
+    __m256d z1 = load_first(pairs.z1, i);
+    const __m256d x2 = _mm256_loadu_pd(pairs.x2 + i);
+    const __m256d y2 = _mm256_loadu_pd(pairs.y2 + i);
+    const __m256d z2 = _mm256_loadu_pd(pairs.z2 + i);
+    if (dot) {
+      _mm256_storeu_pd(
+          result + i,
+          _mm256_fmadd_pd(x1, x2,
+                          _mm256_fmadd_pd(y1, y2, _mm256_mul_pd(z1, z2))));
+    } else {
+      x1 = _mm256_sub_pd(x1, x2);
+      y1 = _mm256_sub_pd(y1, y2);
+      z1 = _mm256_sub_pd(z1, z2);
+      _mm256_storeu_pd(
+          result + i,
+          _mm256_fmadd_pd(x1, x1,
+                          _mm256_fmadd_pd(y1, y1, _mm256_mul_pd(z1, z1))));
+    }
+  }
+#elif defined(GEO_USE_SSE2)
+  auto load_first = [](const double *values, size_t index) {
+    return Single ? _mm_set1_pd(*values) : _mm_loadu_pd(values + index);
+  };
+  for (; i + 2 <= count; i += 2) {
+    __m128d x1 = load_first(pairs.x1, i);
+    __m128d y1 = load_first(pairs.y1, i);
+    __m128d z1 = load_first(pairs.z1, i);
+    const __m128d x2 = _mm_loadu_pd(pairs.x2 + i);
+    const __m128d y2 = _mm_loadu_pd(pairs.y2 + i);
+    const __m128d z2 = _mm_loadu_pd(pairs.z2 + i);
+    if (!dot) {
+      x1 = _mm_sub_pd(x1, x2);
+      y1 = _mm_sub_pd(y1, y2);
+      z1 = _mm_sub_pd(z1, z2);
+    }
+    const __m128d &x = dot ? x2 : x1;
+    const __m128d &y = dot ? y2 : y1;
+    const __m128d &z = dot ? z2 : z1;
+    _mm_storeu_pd(result + i,
+                  _mm_add_pd(_mm_mul_pd(x1, x),
+                             _mm_add_pd(_mm_mul_pd(y1, y), _mm_mul_pd(z1, z))));
+  }
+#endif
+  for (; i < count; ++i) {
+    const size_t first = Single ? 0 : i;
+    result[i] = ComputeTerm(pairs.x1[first], pairs.y1[first], pairs.z1[first],
+                            pairs.x2[i], pairs.y2[i], pairs.z2[i], dot);
+  }
+}
+
+//! Turns results of ComputeTerms() into distances (in meters)
+void TermsToDistances(DistanceFormula formula, std::vector<double> &result) {
+  for (double &value : result) {
+    value = TermToDistance(formula, value);
+  }
+}
+
+} // namespace
+
+void PointSet::Add(Coordinates pos) {
+  const UnitVector vector = ToUnitVector(pos);
+  x_.push_back(vector.x);
+  y_.push_back(vector.y);
+  z_.push_back(vector.z);
+}
+
+void PointSet::AddFrom(const PointSet &other, size_t index) {
+  x_.push_back(other.x_[index]);
+  y_.push_back(other.y_[index]);
+  z_.push_back(other.z_[index]);
+}
+
+void PointSet::Reserve(size_t count) {
+  x_.reserve(count);
+  y_.reserve(count);
+  z_.reserve(count);
+}
+
+void PointSet::Clear() {
+  x_.clear();
+  y_.clear();
+  z_.clear();
+}
+
+double ComputeDistance(Coordinates from, Coordinates to,
+                       DistanceFormula formula) {
+  // same operations as for a pair of batch, but nothing is allocated
+  const UnitVector first = ToUnitVector(from);
+  const UnitVector second = ToUnitVector(to);
+  return TermToDistance(formula,
+                        ComputeTerm(first.x, first.y, first.z, second.x,
+                                    second.y, second.z,
+                                    formula == DistanceFormula::Cosines));
+}
+
+void ComputeDistances(Coordinates from, const PointSet &points,
+                      std::vector<double> &result, DistanceFormula formula) {
+  const UnitVector origin = ToUnitVector(from);
+  result.resize(points.Size());
+  ComputeTerms(VectorPairs<true>{&origin.x, &origin.y, &origin.z,
+                                 points.x_.data(), points.y_.data(),
+                                 points.z_.data()},
+               points.Size(), formula, result.data());
+  TermsToDistances(formula, result);
+}
+
+void ComputePathDistances(const PointSet &path, std::vector<double> &result,
+                          DistanceFormula formula) {
+  if (path.Size() < 2) {
+    result.clear();
+    return;
+  }
+  result.resize(path.Size() - 1);
+  ComputeTerms(VectorPairs<false>{path.x_.data(), path.y_.data(),
+                                  path.z_.data(), path.x_.data() + 1,
+                                  path.y_.data() + 1, path.z_.data() + 1},
+               result.size(), formula, result.data());
+  TermsToDistances(formula, result);
+}
+
+} // namespace geo
@@ -5,6 +5,8 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
+#include <vector>
 
 //! Geographic coordinates related elements
 namespace geo {
@@ -17,17 +19,83 @@ struct Coordinates {
   bool operator!=(const Coordinates &other) const;
 };
 
+//! Degrees to radians ratio used by distance computations
+inline constexpr double DEG_TO_RAD = 3.1415926535 / 180.;
+//! Radius of ideal sphere Earth is assumed to be (in meters)
+inline constexpr double EARTH_RADIUS = 6371000;
+
 //! Assuming Earth is ideal sphere, computes great-circle distance
 inline double ComputeDistance(Coordinates from, Coordinates to) {
   if (from == to) {
     return 0;
   }
-  static const double dr = 3.1415926535 / 180.;
-  static const double earth_radius = 6371000;
+  static const double dr = DEG_TO_RAD;
+  static const double earth_radius = EARTH_RADIUS;
   return acos(sin(from.lat * dr) * sin(to.lat * dr) +
               cos(from.lat * dr) * cos(to.lat * dr) *
                   cos(std::abs(from.lng - to.lng) * dr)) *
          earth_radius;
 }
 
+//! Formula of great-circle distance used by batch computations
+enum class DistanceFormula {
+  //! Spherical law of cosines, same as ComputeDistance(); loses precision for
+  //! points closer than a few meters (acos near 1)
+  Cosines,
+  //! Haversine, numerically stable at any distance
+  Haversine,
+};
+
+//! Computes great-circle distance (in meters) between two points with given
+//! formula, consistently with batch computations
+double ComputeDistance(Coordinates from, Coordinates to,
+                       DistanceFormula formula);
+
+/*!
+ * \brief Points stored as unit vectors in structure of arrays layout
+ *
+ * Sines and cosines of coordinates are computed once per point, so batch
+ * distance computations only take products (vectorized with SSE2 or AVX2,
+ * if the build enables them) and a single inverse trigonometric function per
+ * distance.
+ */
+class PointSet {
+public:
+  void Add(Coordinates pos);
+  //! Appends copy of point of \p other set, no trigonometry involved
+  void AddFrom(const PointSet &other, size_t index);
+  void Reserve(size_t count);
+  void Clear();
+  size_t Size() const { return x_.size(); }
+
+private:
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> z_;
+
+  friend void ComputeDistances(Coordinates from, const PointSet &points,
+                               std::vector<double> &result,
+                               DistanceFormula formula);
+  friend void ComputePathDistances(const PointSet &path,
+                                   std::vector<double> &result,
+                                   DistanceFormula formula);
+};
+
+/*!
+ * Computes great-circle distances (in meters) from \p from to every point
+ * \param[out] result resized to points.Size(), result[i] is distance to
+ * points[i]
+ */
+void ComputeDistances(Coordinates from, const PointSet &points,
+                      std::vector<double> &result,
+                      DistanceFormula formula = DistanceFormula::Cosines);
+
+/*!
+ * Computes great-circle distances (in meters) between consecutive points
+ * \param[out] result resized to path.Size() - 1 (empty for less than two
+ * points), result[i] is distance between path[i] and path[i + 1]
+ */
+void ComputePathDistances(const PointSet &path, std::vector<double> &result,
+                          DistanceFormula formula = DistanceFormula::Cosines);
+
 } // namespace geo
@@ -6,11 +6,16 @@
 #pragma once
 
 #include "domain.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <iterator>
+#include <stdexcept>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace graph {
@@ -35,6 +40,43 @@ template <typename C> auto AsRange(const C &container) {
 using VertexId = size_t;
 using EdgeId = size_t;
 
+//! Iterates over consecutive edge ids, e.g. edges of a single CSR row
+class EdgeIdIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = EdgeId;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const EdgeId *;
+  using reference = EdgeId;
+
+  explicit EdgeIdIterator(EdgeId id) : id_(id) {}
+  EdgeId operator*() const { return id_; }
+  EdgeIdIterator &operator++() {
+    ++id_;
+    return *this;
+  }
+  EdgeIdIterator operator++(int) {
+    EdgeIdIterator prev = *this;
+    ++id_;
+    return prev;
+  }
+  bool operator==(const EdgeIdIterator &other) const {
+    return id_ == other.id_;
+  }
+  bool operator!=(const EdgeIdIterator &other) const {
+    return id_ != other.id_;
+  }
+
+private:
+  EdgeId id_;
+};
+
+//! Path found by any of the routers: total weight and edges in travel order
+template <typename Weight> struct RouteInfo {
+  Weight weight;
+  std::vector<EdgeId> edges;
+};
+
 //! Model of a road between two stops within the same route (bus)
 template <typename Weight> struct Edge {
   Edge &SetFromVertex(VertexId vert) {
@@ -65,7 +107,11 @@ template <typename Weight> struct Edge {
   size_t stop_count;
 };
 
-//! Can be treated as map containing multiple buses (roads) and their stops
+/*!
+ * Can be treated as map containing multiple buses (roads) and their stops.
+ * Serves as a builder: edges are appended one by one and then the graph is
+ * frozen into CsrGraph, which is what routers operate on.
+ */
 template <typename Weight> class DirectedWeightedGraph {
 public:
   using IncidenceList = std::vector<EdgeId>;
@@ -80,20 +126,62 @@ public:
   const Edge<Weight> &GetEdge(EdgeId edge_id) const;
   IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
-  DirectedWeightedGraph &SetEdges(std::vector<Edge<Weight>> &&edges) {
-    edges_ = std::move(edges);
-    return *this;
-  }
-  DirectedWeightedGraph &SetIncidenceLists(std::vector<IncidenceList> &&lists) {
-    incidence_lists_ = std::move(lists);
-    return *this;
-  }
-
 private:
   std::vector<Edge<Weight>> edges_;
   std::vector<IncidenceList> incidence_lists_;
 };
 
+/*!
+ * \brief Frozen (immutable) graph in compressed sparse row layout
+ *
+ * Edges are renumbered so that outgoing edges of every vertex occupy a
+ * contiguous id range [offsets[v], offsets[v + 1]). Targets and weights, which
+ * are read on every relaxation, live in their own packed arrays; source, bus
+ * and span count are kept in parallel "cold" arrays and are only touched when
+ * building the answer.
+ */
+template <typename Weight> class CsrGraph {
+public:
+  using IncidentEdgesRange = Range<EdgeIdIterator>;
+
+  CsrGraph() = default;
+
+  /*!
+   * Freezes builder graph. Edges are stably sorted by source vertex, so a
+   * builder whose edges are already grouped by source keeps its edge ids
+   */
+  explicit CsrGraph(const DirectedWeightedGraph<Weight> &graph);
+
+  //! Adopts arrays which are already laid out in CSR order
+  CsrGraph(std::vector<uint32_t> &&offsets, std::vector<uint32_t> &&targets,
+           std::vector<Weight> &&weights, std::vector<uint32_t> &&sources,
+           std::vector<const data::Bus *> &&buses,
+           std::vector<uint32_t> &&stop_counts);
+
+  size_t GetVertexCount() const { return offsets_.size() - 1; }
+  size_t GetEdgeCount() const { return targets_.size(); }
+
+  //! Assembles edge from all arrays, prefer field accessors in hot loops
+  Edge<Weight> GetEdge(EdgeId edge_id) const;
+  IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+
+  VertexId GetEdgeSource(EdgeId edge_id) const { return sources_[edge_id]; }
+  VertexId GetEdgeTarget(EdgeId edge_id) const { return targets_[edge_id]; }
+  Weight GetEdgeWeight(EdgeId edge_id) const { return weights_[edge_id]; }
+
+private:
+  std::vector<uint32_t> offsets_{0};
+
+  // hot arrays
+  std::vector<uint32_t> targets_;
+  std::vector<Weight> weights_;
+
+  // cold arrays
+  std::vector<uint32_t> sources_;
+  std::vector<const data::Bus *> buses_;
+  std::vector<uint32_t> stop_counts_;
+};
+
 template <typename Weight>
 DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
     : incidence_lists_(vertex_count) {}
@@ -127,4 +215,83 @@ typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
   return AsRange(incidence_lists_.at(vertex));
 }
-} // namespace graph
\ No newline at end of file
+
+template <typename Weight>
+CsrGraph<Weight>::CsrGraph(const DirectedWeightedGraph<Weight> &graph) {
+  const size_t vertex_count = graph.GetVertexCount();
+  const size_t edge_count = graph.GetEdgeCount();
+  if (vertex_count > UINT32_MAX || edge_count > UINT32_MAX) {
+    throw std::length_error("Graph is too large for CSR layout");
+  }
+
+  offsets_.assign(vertex_count + 1, 0);
+  for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+    ++offsets_[graph.GetEdge(edge_id).from + 1];
+  }
+  for (size_t vertex = 0; vertex < vertex_count; ++vertex) {
+    offsets_[vertex + 1] += offsets_[vertex];
+  }
+
+  targets_.resize(edge_count);
+  weights_.resize(edge_count);
+  sources_.resize(edge_count);
+  buses_.resize(edge_count);
+  stop_counts_.resize(edge_count);
+  std::vector<uint32_t> next(offsets_.begin(), offsets_.end() - 1);
+  for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+    const auto &edge = graph.GetEdge(edge_id);
+    const uint32_t pos = next[edge.from]++;
+    targets_[pos] = static_cast<uint32_t>(edge.to);
+    weights_[pos] = edge.weight;
+    sources_[pos] = static_cast<uint32_t>(edge.from);
+    buses_[pos] = edge.bus;
+    stop_counts_[pos] = static_cast<uint32_t>(edge.stop_count);
+  }
+}
+
+template <typename Weight>
+CsrGraph<Weight>::CsrGraph(std::vector<uint32_t> &&offsets,
+                           std::vector<uint32_t> &&targets,
+                           std::vector<Weight> &&weights,
+                           std::vector<uint32_t> &&sources,
+                           std::vector<const data::Bus *> &&buses,
+                           std::vector<uint32_t> &&stop_counts)
+    : offsets_(std::move(offsets)), targets_(std::move(targets)),
+      weights_(std::move(weights)), sources_(std::move(sources)),
+      buses_(std::move(buses)), stop_counts_(std::move(stop_counts)) {
+  const size_t edge_count = targets_.size();
+  if (offsets_.empty() || offsets_.front() != 0 ||
+      offsets_.back() != edge_count || weights_.size() != edge_count ||
+      sources_.size() != edge_count || buses_.size() != edge_count ||
+      stop_counts_.size() != edge_count ||
+      !std::is_sorted(offsets_.begin(), offsets_.end())) {
+    throw std::invalid_argument("Inconsistent CSR graph arrays");
+  }
+  // arrays may come from a file, so every vertex is checked
+  const size_t vertex_count = offsets_.size() - 1;
+  for (size_t edge_id = 0; edge_id < edge_count; ++edge_id) {
+    if (targets_[edge_id] >= vertex_count ||
+        sources_[edge_id] >= vertex_count) {
+      throw std::invalid_argument("CSR graph edge refers to unknown vertex");
+    }
+  }
+}
+
+template <typename Weight>
+Edge<Weight> CsrGraph<Weight>::GetEdge(EdgeId edge_id) const {
+  return Edge<Weight>{}
+      .SetFromVertex(sources_.at(edge_id))
+      .SetToVertex(targets_.at(edge_id))
+      .SetWeight(weights_.at(edge_id))
+      .SetBus(buses_.at(edge_id))
+      .SetStopCount(stop_counts_.at(edge_id));
+}
+
+template <typename Weight>
+typename CsrGraph<Weight>::IncidentEdgesRange
+CsrGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+  return {EdgeIdIterator(offsets_.at(vertex)),
+          EdgeIdIterator(offsets_.at(vertex + 1))};
+}
+
+} // namespace graph
@@ -0,0 +1,198 @@
+#include "grid_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace geo {
+
+namespace {
+//! Smallest grid extent (in degrees), used when all points are aligned
+constexpr double MIN_SPAN = 1e-5;
+//! Margin for rounding errors of computed distances (in meters)
+constexpr double DISTANCE_ERROR = 1.0;
+} // namespace
+
+void GridIndex::Add(Coordinates pos) {
+  positions_.push_back(pos);
+  points_.Add(pos);
+  if (!Covers(pos) ||
+      positions_.size() > cells_.size() * MAX_POINTS_PER_CELL) {
+    Rebuild();
+    return;
+  }
+  const auto [row, col] = GetCellOf(pos);
+  cells_[static_cast<size_t>(row) * grid_.cols + col].push_back(
+      static_cast<uint32_t>(positions_.size() - 1));
+}
+
+void GridIndex::Clear() {
+  grid_ = {};
+  positions_.clear();
+  points_.Clear();
+  cells_.clear();
+}
+
+std::vector<std::pair<size_t, double>>
+GridIndex::FindNearest(Coordinates pos, size_t count) const {
+  if (count == 0 || positions_.empty()) {
+    return {};
+  }
+  // max-heap of (distance, index), the worst of best candidates on top
+  std::vector<std::pair<double, size_t>> best;
+  // points of a cell are gathered to compute their distances at once
+  PointSet cell_points;
+  std::vector<double> distances;
+  auto visit_cell = [&](int64_t row, int64_t col) {
+    if (row < 0 || col < 0 || row >= grid_.rows || col >= grid_.cols) {
+      return;
+    }
+    const auto &cell = cells_[static_cast<size_t>(row) * grid_.cols + col];
+    cell_points.Clear();
+    for (const uint32_t index : cell) {
+      cell_points.AddFrom(points_, index);
+    }
+    ComputeDistances(pos, cell_points, distances, DistanceFormula::Haversine);
+    for (size_t i = 0; i < cell.size(); ++i) {
+      const std::pair candidate{distances[i], static_cast<size_t>(cell[i])};
+      if (best.size() < count) {
+        best.push_back(candidate);
+        std::push_heap(best.begin(), best.end());
+      } else if (candidate < best.front()) {
+        std::pop_heap(best.begin(), best.end());
+        best.back() = candidate;
+        std::push_heap(best.begin(), best.end());
+      }
+    }
+  };
+
+  const auto [center_row, center_col] = GetCellOf(pos);
+  const uint32_t last_ring =
+      std::max({center_row, grid_.rows - 1 - center_row, center_col,
+                grid_.cols - 1 - center_col});
+  // cells are visited in rings (squares) around the cell of position, until
+  // rings are too far to contain anything closer than found candidates
+  for (uint32_t ring = 0; ring <= last_ring; ++ring) {
+    if (best.size() == count &&
+        GetRingDistance(pos, ring) > best.front().first) {
+      break;
+    }
+    const int64_t first_row = int64_t{center_row} - ring;
+    const int64_t last_row = int64_t{center_row} + ring;
+    for (int64_t row = first_row; row <= last_row; ++row) {
+      if (ring == 0 || row == first_row || row == last_row) {
+        for (int64_t col = int64_t{center_col} - ring;
+             col <= int64_t{center_col} + ring; ++col) {
+          visit_cell(row, col);
+        }
+      } else {
+        visit_cell(row, int64_t{center_col} - ring);
+        visit_cell(row, int64_t{center_col} + ring);
+      }
+    }
+  }
+
+  std::sort_heap(best.begin(), best.end());
+  std::vector<std::pair<size_t, double>> result;
+  result.reserve(best.size());
+  for (const auto &[distance, index] : best) {
+    result.emplace_back(index, distance);
+  }
+  return result;
+}
+
+std::vector<size_t> GridIndex::FindInBox(Coordinates min,
+                                         Coordinates max) const {
+  std::vector<size_t> result;
+  if (positions_.empty() || min.lat > max.lat || min.lng > max.lng) {
+    return result;
+  }
+  const auto [first_row, first_col] = GetCellOf(min);
+  const auto [last_row, last_col] = GetCellOf(max);
+  for (uint32_t row = first_row; row <= last_row; ++row) {
+    for (uint32_t col = first_col; col <= last_col; ++col) {
+      for (const uint32_t index :
+           cells_[static_cast<size_t>(row) * grid_.cols + col]) {
+        const Coordinates &point = positions_[index];
+        if (point.lat >= min.lat && point.lat <= max.lat &&
+            point.lng >= min.lng && point.lng <= max.lng) {
+          result.push_back(index);
+        }
+      }
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+bool GridIndex::Covers(Coordinates pos) const {
+  return !cells_.empty() && pos.lat >= grid_.min.lat &&
+         pos.lat <= grid_.min.lat + grid_.rows * grid_.lat_step &&
+         pos.lng >= grid_.min.lng &&
+         pos.lng <= grid_.min.lng + grid_.cols * grid_.lng_step;
+}
+
+std::pair<uint32_t, uint32_t> GridIndex::GetCellOf(Coordinates pos) const {
+  auto clamp_index = [](double value, uint32_t size) {
+    if (!(value > 0)) {
+      return uint32_t{0};
+    }
+    return static_cast<uint32_t>(std::min(value, double(size - 1)));
+  };
+  return {clamp_index((pos.lat - grid_.min.lat) / grid_.lat_step, grid_.rows),
+          clamp_index((pos.lng - grid_.min.lng) / grid_.lng_step, grid_.cols)};
+}
+
+void GridIndex::Rebuild() {
+  Coordinates low = positions_.front(), high = low;
+  for (const auto &pos : positions_) {
+    low = {std::min(low.lat, pos.lat), std::min(low.lng, pos.lng)};
+    high = {std::max(high.lat, pos.lat), std::max(high.lng, pos.lng)};
+  }
+  // margin of a quarter of extent on each side lets further points in, so
+  // rebuilds caused by growing extent happen geometrically rarer
+  const double lat_span = std::max(high.lat - low.lat, MIN_SPAN) * 1.5;
+  const double lng_span = std::max(high.lng - low.lng, MIN_SPAN) * 1.5;
+  low = {(low.lat + high.lat - lat_span) / 2,
+         (low.lng + high.lng - lng_span) / 2};
+
+  // cells are kept roughly square in meters
+  const size_t target_cells =
+      std::max<size_t>(1, positions_.size() / POINTS_PER_CELL);
+  const double aspect =
+      lng_span * std::cos((low.lat + lat_span / 2) * DEG_TO_RAD) / lat_span;
+  const size_t cols = std::clamp<size_t>(
+      static_cast<size_t>(std::lround(std::sqrt(target_cells * aspect))), 1,
+      target_cells);
+  const size_t rows = (target_cells + cols - 1) / cols;
+
+  grid_ = {low, lat_span / rows, lng_span / cols, static_cast<uint32_t>(rows),
+           static_cast<uint32_t>(cols)};
+  cells_.assign(rows * cols, {});
+  for (size_t index = 0; index < positions_.size(); ++index) {
+    const auto [row, col] = GetCellOf(positions_[index]);
+    cells_[static_cast<size_t>(row) * grid_.cols + col].push_back(
+        static_cast<uint32_t>(index));
+  }
+}
+
+double GridIndex::GetRingDistance(Coordinates pos, uint32_t ring) const {
+  if (ring <= 1) {
+    return 0;
+  }
+  // whole cells between position and ring, along latitude or longitude
+  const double gap = ring - 1;
+  const double max_lat = std::min(
+      90.0, std::max({std::abs(pos.lat), std::abs(grid_.min.lat),
+                      std::abs(grid_.min.lat + grid_.rows * grid_.lat_step)}));
+  // meridian arc is the shortest path between latitudes; between longitudes
+  // path is not shorter than chord of the narrowest parallel
+  const double lat_distance = gap * grid_.lat_step * DEG_TO_RAD * EARTH_RADIUS;
+  const double lng_angle =
+      std::min(gap * grid_.lng_step * DEG_TO_RAD, 3.1415926535);
+  const double lng_distance = 2 * EARTH_RADIUS *
+                              std::cos(max_lat * DEG_TO_RAD) *
+                              std::sin(lng_angle / 2);
+  return std::min(lat_distance, lng_distance) - DISTANCE_ERROR;
+}
+
+} // namespace geo
@@ -0,0 +1,141 @@
+/*!
+ * \file grid_index.h
+ * \brief Spatial index that answers nearest points and bounding box queries
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "geo.h"
+
+namespace geo {
+
+/*!
+ * \brief Uniform grid over geographic points, each cell lists points inside
+ * of it
+ *
+ * Points are identified by dense indexes in order of addition. Grid is
+ * rebuilt whenever a point falls outside of it or cells get too crowded; its
+ * bounds grow with a margin, so adding N points takes amortized O(N). Grid is
+ * assumed to cross neither poles nor the antimeridian.
+ */
+class GridIndex {
+public:
+  //! Grid geometry: cell (row, col) starts at min + (row * lat_step,
+  //! col * lng_step)
+  struct Grid {
+    Coordinates min{};
+    double lat_step{};
+    double lng_step{};
+    uint32_t rows{};
+    uint32_t cols{};
+  };
+
+  //! Adds point, its index is the amount of previously added points
+  void Add(Coordinates pos);
+
+  //! Removes all points
+  void Clear();
+
+  /*!
+   * \return up to \p count points closest to \p pos as pairs of index and
+   * great-circle distance (in meters, haversine formula), sorted by distance
+   * (then by index)
+   */
+  std::vector<std::pair<size_t, double>> FindNearest(Coordinates pos,
+                                                     size_t count) const;
+
+  /*!
+   * \return indexes of points inside of box (borders included), in ascending
+   * order
+   */
+  std::vector<size_t> FindInBox(Coordinates min, Coordinates max) const;
+
+  size_t GetPointsCount() const { return positions_.size(); }
+  //! Unit vectors of points in order of indexes, for batch distances
+  const PointSet &GetPoints() const { return points_; }
+  const Grid &GetGrid() const { return grid_; }
+  //! Cells are numbered row by row
+  const std::vector<uint32_t> &GetCell(size_t cell) const {
+    return cells_.at(cell);
+  }
+
+  /*!
+   * Restores previously saved index without computing cells of points. Empty
+   * grid (e.g. missing in older files) makes index rebuild itself instead
+   * \param[in] positions points in order of indexes
+   * \param[in] offsets cells of the grid row by row, cell i consists of
+   * points[offsets[i]] .. points[offsets[i + 1] - 1]
+   * \param[in] points indexes of points grouped by cells
+   */
+  template <typename Offsets, typename Points>
+  void Restore(const Grid &grid, std::vector<Coordinates> positions,
+               const Offsets &offsets, const Points &points);
+
+private:
+  Grid grid_{};
+  std::vector<Coordinates> positions_;
+  PointSet points_;
+  std::vector<std::vector<uint32_t>> cells_;
+
+  //! Average amount of points per cell right after rebuild
+  static constexpr size_t POINTS_PER_CELL = 2;
+  //! Grid is rebuilt once average amount of points per cell exceeds it
+  static constexpr size_t MAX_POINTS_PER_CELL = 8;
+
+  bool Covers(Coordinates pos) const;
+  //! Row and column of cell nearest to position (position may be outside)
+  std::pair<uint32_t, uint32_t> GetCellOf(Coordinates pos) const;
+  //! Chooses new grid that covers all points with margin and fills cells
+  void Rebuild();
+  //! Lower bound of distance (in meters) between \p pos and points of cells
+  //! that are \p ring cells away from cell of \p pos
+  double GetRingDistance(Coordinates pos, uint32_t ring) const;
+};
+
+template <typename Offsets, typename Points>
+void GridIndex::Restore(const Grid &grid, std::vector<Coordinates> positions,
+                        const Offsets &offsets, const Points &points) {
+  positions_ = std::move(positions);
+  points_.Clear();
+  points_.Reserve(positions_.size());
+  for (const Coordinates &pos : positions_) {
+    points_.Add(pos);
+  }
+  cells_.clear();
+  grid_ = grid;
+  if (grid_.rows == 0 || grid_.cols == 0) {
+    grid_ = {};
+    if (!positions_.empty()) {
+      Rebuild();
+    }
+    return;
+  }
+  const size_t cell_count = static_cast<size_t>(grid_.rows) * grid_.cols;
+  if (static_cast<size_t>(offsets.size()) != cell_count + 1 ||
+      static_cast<size_t>(points.size()) != positions_.size()) {
+    throw std::runtime_error("Saved grid index does not match stops");
+  }
+  cells_.resize(cell_count);
+  for (size_t cell = 0; cell < cell_count; ++cell) {
+    const size_t begin = offsets[static_cast<int>(cell)];
+    const size_t end = offsets[static_cast<int>(cell + 1)];
+    if (begin > end || end > positions_.size()) {
+      throw std::runtime_error("Saved grid index is corrupted");
+    }
+    for (size_t i = begin; i < end; ++i) {
+      const uint32_t point = points[static_cast<int>(i)];
+      if (point >= positions_.size()) {
+        throw std::runtime_error("Saved grid index is corrupted");
+      }
+      cells_[cell].push_back(point);
+    }
+  }
+}
+
+} // namespace geo
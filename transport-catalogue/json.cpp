@@ -1,10 +1,17 @@
+#include <algorithm>
+#include <charconv>
 #include <cmath>
+#include <cstdint>
+#include <iterator>
 #include <limits>
 
 #include "json.h"
+#include "profiler.h"
 
 namespace json {
 
+using namespace std::literals;
+
 bool operator==(const Node &lhs, const Node &rhs) {
   if (lhs.IsNull() && rhs.IsNull()) {
     return true;
@@ -39,183 +46,405 @@ bool operator!=(const Node &lhs, const Node &rhs) { return !(lhs == rhs); }
 
 namespace {
 
-bool SequenceCheck(std::istream &input, const std::string &str) {
-  return std::equal(str.begin(), str.end(),
-                    std::istreambuf_iterator<char>(input));
-}
-
-Node LoadNode(std::istream &input);
-
-Node LoadNumber(std::istream &input) {
-  using namespace std::literals;
-
-  std::string parsed_num;
-
-  auto read_char = [&parsed_num, &input] {
-    parsed_num += static_cast<char>(input.get());
-    if (!input) {
-      throw ParsingError("Failed to read number from stream"s);
+//! Recursive descent parser over contiguous buffer, reports to Handler
+class Parser {
+public:
+  /*!
+   * \param[in] input text to parse
+   * \param[in] writable same buffer as input if escape sequences should be
+   * decoded in place, nullptr otherwise
+   * \param[in] handler receiver of parsing events
+   */
+  Parser(std::string_view input, char *writable, Handler &handler)
+      : begin_(input.data()), pos_(input.data()),
+        end_(input.data() + input.size()), writable_(writable),
+        handler_(handler) {}
+
+  void ParseDocument() {
+    SkipWhitespace();
+    if (pos_ == end_) {
+      throw ParsingError("Stream end reached - no data found");
     }
-  };
-
-  auto read_digits = [&input, read_char] {
-    if (!std::isdigit(input.peek())) {
-      throw ParsingError("A digit is expected"s);
-    }
-    while (std::isdigit(input.peek())) {
-      read_char();
+    ParseValue();
+    SkipWhitespace();
+    if (pos_ != end_) {
+      throw ParsingError("Unexpected data after JSON value");
     }
-  };
+  }
 
-  if (input.peek() == '-') {
-    read_char();
+private:
+  const char *const begin_;
+  const char *pos_;
+  const char *const end_;
+  char *const writable_;
+  Handler &handler_;
+  //! Decoded strings with escape sequences when parsing not in place
+  std::string scratch_;
+
+  static bool IsDigit(char ch) { return ch >= '0' && ch <= '9'; }
+
+  bool Consume(char ch) {
+    if (pos_ != end_ && *pos_ == ch) {
+      ++pos_;
+      return true;
+    }
+    return false;
   }
 
-  if (input.peek() == '0') {
-    read_char();
-  } else {
-    read_digits();
+  void SkipWhitespace() {
+    while (pos_ != end_ &&
+           (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\t' || *pos_ == '\r')) {
+      ++pos_;
+    }
   }
 
-  bool is_int = true;
-  if (input.peek() == '.') {
-    read_char();
-    read_digits();
-    is_int = false;
+  void ExpectLiteral(std::string_view literal) {
+    if (static_cast<size_t>(end_ - pos_) < literal.size() ||
+        std::string_view(pos_, literal.size()) != literal) {
+      throw ParsingError("Unexpected token, "s + std::string(literal) +
+                         " is expected"s);
+    }
+    pos_ += literal.size();
   }
 
-  if (int ch = input.peek(); ch == 'e' || ch == 'E') {
-    read_char();
-    if (ch = input.peek(); ch == '+' || ch == '-') {
-      read_char();
+  void ParseValue() {
+    if (pos_ == end_) {
+      throw ParsingError("Unexpected end of input");
+    }
+    switch (*pos_) {
+    case '{':
+      ParseDict();
+      break;
+    case '[':
+      ParseArray();
+      break;
+    case '"':
+      handler_.OnString(ParseString());
+      break;
+    case 'n':
+      ExpectLiteral("null");
+      handler_.OnNull();
+      break;
+    case 't':
+      ExpectLiteral("true");
+      handler_.OnBool(true);
+      break;
+    case 'f':
+      ExpectLiteral("false");
+      handler_.OnBool(false);
+      break;
+    default:
+      ParseNumber();
     }
-    read_digits();
-    is_int = false;
   }
 
-  try {
-    if (is_int) {
-      try {
-        int result = std::stoi(parsed_num);
-        return Node{result};
-      } catch (...) {
+  void ParseArray() {
+    ++pos_;
+    handler_.OnStartArray();
+    SkipWhitespace();
+    if (!Consume(']')) {
+      while (true) {
+        ParseValue();
+        SkipWhitespace();
+        if (Consume(']')) {
+          break;
+        }
+        if (!Consume(',')) {
+          throw ParsingError("Missing ]");
+        }
+        SkipWhitespace();
       }
     }
-    double result = std::stod(parsed_num);
-    return Node{result};
-  } catch (...) {
-    throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
+    handler_.OnEndArray();
   }
-}
 
-Node LoadString(std::istream &input) {
-  using namespace std::literals;
+  void ParseDict() {
+    ++pos_;
+    handler_.OnStartDict();
+    SkipWhitespace();
+    if (!Consume('}')) {
+      while (true) {
+        if (pos_ == end_ || *pos_ != '"') {
+          throw ParsingError("Dictionary key is expected");
+        }
+        handler_.OnKey(ParseString());
+        SkipWhitespace();
+        if (!Consume(':')) {
+          throw ParsingError("Missing : after dictionary key");
+        }
+        SkipWhitespace();
+        ParseValue();
+        SkipWhitespace();
+        if (Consume('}')) {
+          break;
+        }
+        if (!Consume(',')) {
+          throw ParsingError("Missing }");
+        }
+        SkipWhitespace();
+      }
+    }
+    handler_.OnEndDict();
+  }
 
-  auto it = std::istreambuf_iterator<char>(input);
-  auto end = std::istreambuf_iterator<char>();
-  std::string s;
-  while (true) {
-    if (it == end) {
+  //! Expects opening quote at current position
+  std::string_view ParseString() {
+    const char *start = ++pos_;
+    while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\' && *pos_ != '\n' &&
+           *pos_ != '\r') {
+      ++pos_;
+    }
+    if (pos_ == end_) {
       throw ParsingError("String parsing error");
     }
-    const char ch = *it;
-    if (ch == '"') {
-      ++it;
-      break;
-    } else if (ch == '\\') {
-      ++it;
-      if (it == end) {
+    if (*pos_ == '"') {
+      ++pos_;
+      return {start, static_cast<size_t>(pos_ - start - 1)};
+    }
+    if (*pos_ != '\\') {
+      throw ParsingError("Unexpected end of line");
+    }
+    return ParseEscapedString(start);
+  }
+
+  //! Continues ParseString() from the first escape sequence
+  std::string_view ParseEscapedString(const char *start) {
+    // decoded text is never longer than its source, so writing in place
+    // does not overtake reading
+    char *const out_begin =
+        writable_ ? writable_ + (start - begin_) : nullptr;
+    char *out = writable_ ? writable_ + (pos_ - begin_) : nullptr;
+    if (!writable_) {
+      scratch_.assign(start, pos_);
+    }
+    auto put = [this, &out](char ch) {
+      if (out) {
+        *out++ = ch;
+      } else {
+        scratch_.push_back(ch);
+      }
+    };
+
+    while (true) {
+      if (pos_ == end_) {
         throw ParsingError("String parsing error");
       }
-      const char escaped_char = *(it);
+      const char ch = *pos_++;
+      if (ch == '"') {
+        break;
+      } else if (ch == '\n' || ch == '\r') {
+        throw ParsingError("Unexpected end of line"s);
+      } else if (ch != '\\') {
+        put(ch);
+        continue;
+      }
+      if (pos_ == end_) {
+        throw ParsingError("String parsing error");
+      }
+      const char escaped_char = *pos_++;
       switch (escaped_char) {
       case 'n':
-        s.push_back('\n');
+        put('\n');
         break;
       case 't':
-        s.push_back('\t');
+        put('\t');
         break;
       case 'r':
-        s.push_back('\r');
+        put('\r');
         break;
-      case '"':
-        s.push_back('"');
+      case 'b':
+        put('\b');
+        break;
+      case 'f':
+        put('\f');
         break;
+      case '"':
       case '\\':
-        s.push_back('\\');
+      case '/':
+        put(escaped_char);
+        break;
+      case 'u':
+        PutCodePoint(ParseCodePoint(), put);
         break;
       default:
         throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
       }
-    } else if (ch == '\n' || ch == '\r') {
-      throw ParsingError("Unexpected end of line"s);
-    } else {
-      s.push_back(ch);
     }
-    ++it;
+
+    if (out) {
+      return {out_begin, static_cast<size_t>(out - out_begin)};
+    }
+    return scratch_;
   }
 
-  return Node{s};
-}
+  uint32_t ParseHex4() {
+    if (end_ - pos_ < 4) {
+      throw ParsingError("Incomplete \\u escape sequence");
+    }
+    uint32_t value = 0;
+    const auto [ptr, ec] = std::from_chars(pos_, pos_ + 4, value, 16);
+    if (ec != std::errc{} || ptr != pos_ + 4) {
+      throw ParsingError("Invalid \\u escape sequence");
+    }
+    pos_ += 4;
+    return value;
+  }
 
-Node LoadArray(std::istream &input) {
-  Array result;
-  char c;
-  for (; input >> c && c != ']';) {
-    if (c != ',') {
-      input.putback(c);
+  //! Reads the rest of \u escape sequence (and its low surrogate pair)
+  uint32_t ParseCodePoint() {
+    uint32_t code = ParseHex4();
+    if (code >= 0xD800 && code <= 0xDBFF) {
+      if (end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u') {
+        throw ParsingError("Unpaired surrogate in \\u escape sequence");
+      }
+      pos_ += 2;
+      const uint32_t low = ParseHex4();
+      if (low < 0xDC00 || low > 0xDFFF) {
+        throw ParsingError("Unpaired surrogate in \\u escape sequence");
+      }
+      code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
     }
-    result.push_back(LoadNode(input));
+    return code;
   }
-  if (!input && c != ']')
-    throw ParsingError("Missing ]");
 
-  return Node(std::move(result));
-}
+  //! Writes code point as UTF-8
+  template <typename Put> static void PutCodePoint(uint32_t code, Put &put) {
+    if (code < 0x80) {
+      put(static_cast<char>(code));
+    } else if (code < 0x800) {
+      put(static_cast<char>(0xC0 | (code >> 6)));
+      put(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+      put(static_cast<char>(0xE0 | (code >> 12)));
+      put(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      put(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+      put(static_cast<char>(0xF0 | (code >> 18)));
+      put(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+      put(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      put(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+  }
 
-Node LoadDict(std::istream &input) {
-  Dict result;
-  char c;
+  void ParseNumber() {
+    const char *start = pos_;
+    auto read_digits = [this] {
+      if (pos_ == end_ || !IsDigit(*pos_)) {
+        throw ParsingError("A digit is expected"s);
+      }
+      while (pos_ != end_ && IsDigit(*pos_)) {
+        ++pos_;
+      }
+    };
 
-  for (; input >> c && c != '}';) {
-    if (c == ',') {
-      input >> c;
+    Consume('-');
+    if (!Consume('0')) {
+      read_digits();
     }
 
-    std::string key = LoadString(input).AsString();
-    input >> c;
-    result.insert({std::move(key), LoadNode(input)});
+    bool is_int = true;
+    if (Consume('.')) {
+      read_digits();
+      is_int = false;
+    }
+
+    if (Consume('e') || Consume('E')) {
+      if (!Consume('+')) {
+        Consume('-');
+      }
+      read_digits();
+      is_int = false;
+    }
+
+    if (is_int) {
+      int result{};
+      if (const auto [ptr, ec] = std::from_chars(start, pos_, result);
+          ec == std::errc{}) {
+        handler_.OnInt(result);
+        return;
+      }
+    }
+    double result{};
+    if (const auto [ptr, ec] = std::from_chars(start, pos_, result);
+        ec != std::errc{}) {
+      throw ParsingError("Failed to convert "s + std::string(start, pos_) +
+                         " to number"s);
+    }
+    handler_.OnDouble(result);
   }
-  if (!input && c != '}')
-    throw ParsingError("Missing }");
+};
+
+/*!
+ * Arena for tree of document parsed from input of given size: its first
+ * block roughly fits containers of a typical document, further blocks grow
+ * geometrically
+ */
+std::shared_ptr<std::pmr::monotonic_buffer_resource>
+MakeArena(size_t input_size) {
+  return std::make_shared<std::pmr::monotonic_buffer_resource>(
+      std::max<size_t>(input_size, 1024));
+}
+
+} // namespace
 
-  return Node(std::move(result));
+void NodeHandler::OnNull() { AddValue(Node{nullptr}); }
+
+void NodeHandler::OnBool(bool value) { AddValue(Node{value}); }
+
+void NodeHandler::OnInt(int value) { AddValue(Node{value}); }
+
+void NodeHandler::OnDouble(double value) { AddValue(Node{value}); }
+
+void NodeHandler::OnString(std::string_view value) {
+  AddValue(Node{std::string(value)});
+}
+
+void NodeHandler::OnStartArray() { stack_.emplace_back(Array{resource_}); }
+
+void NodeHandler::OnEndArray() {
+  Node node = std::move(stack_.back());
+  stack_.pop_back();
+  AddValue(std::move(node));
+}
+
+void NodeHandler::OnStartDict() { stack_.emplace_back(Dict{resource_}); }
+
+void NodeHandler::OnKey(std::string_view key) { keys_.emplace_back(key); }
+
+void NodeHandler::OnEndDict() { OnEndArray(); }
+
+Node NodeHandler::Extract() {
+  if (!root_ || !stack_.empty()) {
+    throw ParsingError("JSON value is incomplete");
+  }
+  Node result = std::move(*root_);
+  root_.reset();
+  return result;
 }
 
-Node LoadNode(std::istream &input) {
-  char c{};
-  for (; input >> c && Delimiters.count(c);)
-    ;
-  if (!input)
-    throw ParsingError("Stream end reached - no data found");
-  if (c == '[') {
-    return LoadArray(input);
-  } else if (c == '{') {
-    return LoadDict(input);
-  } else if (c == '"') {
-    return LoadString(input);
-  } else if (c == 'n' && SequenceCheck(input, "ull")) {
-    return Node{};
-  } else if ((c == 't' && SequenceCheck(input, "rue")) ||
-             (c == 'f' && SequenceCheck(input, "alse"))) {
-    return Node{c == 't'};
+void NodeHandler::AddValue(Node &&node) {
+  if (stack_.empty()) {
+    root_ = std::move(node);
+    return;
+  }
+  auto &container = stack_.back().GetValue();
+  if (auto *arr = std::get_if<Array>(&container)) {
+    arr->push_back(std::move(node));
   } else {
-    input.putback(c);
-    return LoadNumber(input);
+    // first occurrence wins for duplicate keys
+    std::get<Dict>(container).emplace(std::move(keys_.back()),
+                                      std::move(node));
+    keys_.pop_back();
   }
 }
 
-} // namespace
+void Parse(std::string_view input, Handler &handler) {
+  Parser(input, nullptr, handler).ParseDocument();
+}
+
+void ParseInPlace(std::string &buffer, Handler &handler) {
+  Parser(buffer, buffer.data(), handler).ParseDocument();
+}
 
 bool Node::IsInt() const { return std::holds_alternative<int>(*this); }
 bool Node::IsDouble() const {
@@ -284,9 +513,28 @@ Node::Value &Node::GetValue() { return dynamic_cast<Value &>(*this); }
 
 Document::Document(Node root) : root_(std::move(root)) {}
 
+Document::Document(Node root, std::shared_ptr<std::pmr::memory_resource> arena)
+    : arena_(std::move(arena)), root_(std::move(root)) {}
+
 const Node &Document::GetRoot() const { return root_; }
 
-Document Load(std::istream &input) { return Document{LoadNode(input)}; }
+Document Load(std::istream &input) {
+  profile::ScopedTimer timer{"json_load"};
+  std::string buffer{std::istreambuf_iterator<char>(input),
+                     std::istreambuf_iterator<char>()};
+  auto arena = MakeArena(buffer.size());
+  NodeHandler handler{arena.get()};
+  ParseInPlace(buffer, handler);
+  return Document{handler.Extract(), std::move(arena)};
+}
+
+Document Load(std::string_view input) {
+  profile::ScopedTimer timer{"json_load"};
+  auto arena = MakeArena(input.size());
+  NodeHandler handler{arena.get()};
+  Parse(input, handler);
+  return Document{handler.Extract(), std::move(arena)};
+}
 
 void Print(const Document &doc, std::ostream &output) {
   PrintNode(doc.GetRoot(), {output});
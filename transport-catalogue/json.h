@@ -7,9 +7,12 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -41,11 +44,8 @@ bool operator!=(const Node &lhs, const Node &rhs);
  * \details Type that is widely used to define various settings,
  * with option names (strings) stored as dictionary keys
  */
-using Dict = std::map<std::string, Node>;
-using Array = std::vector<Node>;
-
-//! Characters treated as delimiters when reading from input stream
-const std::unordered_set<char> Delimiters = {' ', '\n', '\t', '\r'};
+using Dict = std::pmr::map<std::string, Node>;
+using Array = std::pmr::vector<Node>;
 
 //! Characters replaced by PrintValue(const std::string &str, const PrintContext
 //! &ctx) during printing
@@ -56,8 +56,52 @@ const std::unordered_map<char, std::string> CharsToReplace = {
     {'\\', R"(\\)"},
 };
 
+/*!
+ * \brief Receives events of Parse() (SAX-style parsing)
+ *
+ * Events follow document order. Views passed to OnString() and OnKey() are
+ * only guaranteed to be valid during the call (see ParseInPlace() for longer
+ * living ones)
+ */
+class Handler {
+public:
+  virtual ~Handler() = default;
+
+  virtual void OnNull() = 0;
+  virtual void OnBool(bool value) = 0;
+  //! Integers that do not fit into int are reported by OnDouble()
+  virtual void OnInt(int value) = 0;
+  virtual void OnDouble(double value) = 0;
+  virtual void OnString(std::string_view value) = 0;
+  virtual void OnStartArray() = 0;
+  virtual void OnEndArray() = 0;
+  virtual void OnStartDict() = 0;
+  virtual void OnKey(std::string_view key) = 0;
+  virtual void OnEndDict() = 0;
+};
+
+/*!
+ * Parses single JSON value from contiguous buffer and reports it to handler.
+ * Only whitespace may follow the value
+ * \throw ParsingError on malformed input
+ */
+void Parse(std::string_view input, Handler &handler);
+
+/*!
+ * Same as Parse(), but escape sequences are decoded right inside buffer, so
+ * every string passed to handler is a view into buffer, valid while buffer
+ * is alive and not modified
+ */
+void ParseInPlace(std::string &buffer, Handler &handler);
+
+/*!
+ * Reads the rest of input stream and parses it. Arrays and dictionaries of
+ * the document are allocated from its own arena, see Document
+ */
 Document Load(std::istream &input);
 
+Document Load(std::string_view input);
+
 /**
     \fn PrintValue(const Value &value, const PrintContext &ctx)
     \details Prints whatever type with defined operator<<(std::basic_ostream) to
@@ -139,15 +183,60 @@ public:
   Value &GetValue();
 };
 
-//! Wrapper for Node, which stores Node containing entire input data
+/*!
+ * \brief Wrapper for Node, which stores Node containing entire input data
+ *
+ * Arrays and dictionaries of a loaded document live in monotonic arena
+ * owned by the document, so loading doesn't allocate every node separately
+ * and destruction releases them all at once. Values copied out of the
+ * document (Array and Dict copies) use default memory resource, so they may
+ * outlive it; short strings are kept inside of nodes, longer ones use heap.
+ */
 class Document {
 public:
   explicit Document(Node root);
+  //! \param[in] arena memory resource used by containers of root
+  Document(Node root, std::shared_ptr<std::pmr::memory_resource> arena);
 
   const Node &GetRoot() const;
 
 private:
+  //! Declared before root_, so it is released after the tree
+  std::shared_ptr<std::pmr::memory_resource> arena_;
   Node root_;
 };
 
+//! Handler which assembles events into regular Node tree
+class NodeHandler final : public Handler {
+public:
+  //! \param[in] resource memory resource of created arrays and dictionaries
+  explicit NodeHandler(std::pmr::memory_resource *resource =
+                           std::pmr::get_default_resource())
+      : resource_{resource} {}
+
+  void OnNull() override;
+  void OnBool(bool value) override;
+  void OnInt(int value) override;
+  void OnDouble(double value) override;
+  void OnString(std::string_view value) override;
+  void OnStartArray() override;
+  void OnEndArray() override;
+  void OnStartDict() override;
+  void OnKey(std::string_view key) override;
+  void OnEndDict() override;
+
+  //! Returns complete value and makes handler ready for the next one
+  Node Extract();
+
+private:
+  //! Unfinished arrays and dictionaries
+  std::vector<Node> stack_;
+  //! Keys of values pending insertion into dictionaries of stack_
+  std::vector<std::string> keys_;
+  std::optional<Node> root_;
+  std::pmr::memory_resource *resource_;
+
+  void AddValue(Node &&node);
+};
+
 } // namespace json
\ No newline at end of file
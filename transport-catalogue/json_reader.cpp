@@ -1,10 +1,24 @@
 #include "json_reader.h"
 #include "domain.h"
+#include "profiler.h"
+
+#include <stdexcept>
 namespace json {
+json::Document JsonReader::ReadInput(std::string &input) {
+  profile::ScopedTimer timer{"read_input"};
+  auto arena = std::make_shared<std::pmr::monotonic_buffer_resource>();
+  InputHandler handler{*this, arena.get()};
+  json::ParseInPlace(input, handler);
+  return json::Document{handler.ExtractSections(), std::move(arena)};
+}
+
 void JsonReader::ProcessInput(const json::Dict &doc_map,
                               input_info::OutputFormat format) {
   if (doc_map.count("base_requests")) {
     ProcessBaseReqs(doc_map);
+  } else if (!input_queue_.empty()) {
+    // base requests were enqueued by ReadInput()
+    InsertAllIntoCatalogue();
   }
   if (doc_map.count("render_settings")) {
     EnqueueRenderSettingsUpdate(doc_map);
@@ -15,6 +29,9 @@ void JsonReader::ProcessInput(const json::Dict &doc_map,
   if (doc_map.count("stat_requests")) {
     EnqueueStatReqs(doc_map);
   }
+  if (doc_map.count("execution_settings")) {
+    ApplyExecutionSettings(doc_map);
+  }
   req_handler_.ProcessAllRequests(format);
 }
 
@@ -43,6 +60,17 @@ void JsonReader::EnqueueStatReqs(const json::Dict &doc_map) {
   }
 }
 
+void JsonReader::ApplyExecutionSettings(const json::Dict &doc_map) {
+  const auto &settings = doc_map.at("execution_settings").AsMap();
+  if (settings.count("threads")) {
+    const int threads = settings.at("threads").AsInt();
+    if (threads < 0) {
+      throw std::invalid_argument("Amount of threads must be non-negative");
+    }
+    req_handler_.SetThreadCount(static_cast<size_t>(threads));
+  }
+}
+
 void JsonReader::ParseSingleCommand(const json::Node &node) {
   json_input_parser_(node.AsMap().at("type").AsString(), node);
 }
@@ -60,8 +88,7 @@ void JsonReader::JsonInputParse::EnqueueBus(const json::Node &node) {
   for (const auto &name : bus_map.at("stops").AsArray()) {
     new_bus.stops.emplace_back(name.AsString());
   }
-  auto bus_ptr = &parent_.buses_input_queue_.emplace_back(std::move(new_bus));
-  parent_.input_queue_.emplace_back(RequestTypes::BusInsert{bus_ptr});
+  parent_.EnqueueBus(std::move(new_bus));
 }
 
 void JsonReader::JsonInputParse::EnqueueStop(const json::Node &node) {
@@ -74,17 +101,23 @@ void JsonReader::JsonInputParse::EnqueueStop(const json::Node &node) {
   for (const auto &[name, dist] : stop_map.at("road_distances").AsMap()) {
     new_stoplink.neighbours.emplace_back(name, dist.AsDouble());
   }
-  auto stop_ptr = &parent_.stops_input_queue_.emplace_back(new_stop);
-  parent_.input_queue_.emplace_back(RequestTypes::StopInsert{stop_ptr});
-  auto stoplink_ptr =
-      &parent_.stoplinks_input_queue_.emplace_back(new_stoplink);
-  parent_.input_queue_.emplace_back(RequestTypes::StopLinkInsert{stoplink_ptr});
+  parent_.EnqueueStop(new_stop, std::move(new_stoplink));
+}
+
+void JsonReader::JsonInputParse::EnqueueStopRemoval(const json::Node &node) {
+  parent_.EnqueueStopRemoval(node.AsMap().at("name").AsString());
+}
+
+void JsonReader::JsonInputParse::EnqueueBusRemoval(const json::Node &node) {
+  parent_.EnqueueBusRemoval(node.AsMap().at("name").AsString());
 }
 
 std::unordered_map<std::string_view, JsonReader::JsonInputParse::FunctionPtr>
     JsonReader::JsonInputParse::handlers_ = {
         {"Bus", &JsonReader::JsonInputParse::EnqueueBus},
         {"Stop", &JsonReader::JsonInputParse::EnqueueStop},
+        {"RemoveStop", &JsonReader::JsonInputParse::EnqueueStopRemoval},
+        {"RemoveBus", &JsonReader::JsonInputParse::EnqueueBusRemoval},
 };
 
 void JsonReader::JsonPrintParse::operator()(std::string_view type,
@@ -112,9 +145,55 @@ void JsonReader::JsonPrintParse::EnqueueMapDraw(const json::Node &node) {
 
 void JsonReader::JsonPrintParse::EnqueueRoute(const json::Node &node) {
   const auto &route_map = node.AsMap();
-  parent_.InsertIntoQueue(RequestTypes::Route{route_map.at("id").AsInt(),
-                                              route_map.at("from").AsString(),
-                                              route_map.at("to").AsString()});
+  RequestTypes::Route route{route_map.at("id").AsInt(),
+                            ParsePlace(route_map.at("from")),
+                            ParsePlace(route_map.at("to"))};
+  if (route_map.count("walking_velocity")) {
+    route.walking.velocity = route_map.at("walking_velocity").AsDouble();
+    if (!(route.walking.velocity > 0)) {
+      throw std::invalid_argument("Walking velocity must be positive");
+    }
+  }
+  if (route_map.count("walking_stops")) {
+    const int stops_count = route_map.at("walking_stops").AsInt();
+    if (stops_count < 1) {
+      throw std::invalid_argument("Amount of walking stops must be positive");
+    }
+    route.walking.stops_count = static_cast<size_t>(stops_count);
+  }
+  parent_.InsertIntoQueue(std::move(route));
+}
+
+core::TransportRouter::Place
+JsonReader::JsonPrintParse::ParsePlace(const json::Node &node) {
+  if (node.IsString()) {
+    return std::string_view{node.AsString()};
+  }
+  const auto &point = node.AsMap();
+  return geo::Coordinates{point.at("latitude").AsDouble(),
+                          point.at("longitude").AsDouble()};
+}
+
+void JsonReader::JsonPrintParse::EnqueueNearestStops(const json::Node &node) {
+  const auto &req_map = node.AsMap();
+  const int count = req_map.at("count").AsInt();
+  if (count < 0) {
+    throw std::invalid_argument("Amount of nearest stops must be non-negative");
+  }
+  parent_.InsertIntoQueue(RequestTypes::NearestStops{
+      req_map.at("id").AsInt(),
+      {req_map.at("latitude").AsDouble(), req_map.at("longitude").AsDouble()},
+      static_cast<size_t>(count)});
+}
+
+void JsonReader::JsonPrintParse::EnqueueStopsInBox(const json::Node &node) {
+  const auto &req_map = node.AsMap();
+  parent_.InsertIntoQueue(RequestTypes::StopsInBox{
+      req_map.at("id").AsInt(),
+      {req_map.at("min_latitude").AsDouble(),
+       req_map.at("min_longitude").AsDouble()},
+      {req_map.at("max_latitude").AsDouble(),
+       req_map.at("max_longitude").AsDouble()}});
 }
 
 std::unordered_map<std::string_view, JsonReader::JsonPrintParse::FunctionPtr>
@@ -123,8 +202,194 @@ std::unordered_map<std::string_view, JsonReader::JsonPrintParse::FunctionPtr>
         {"Stop", &JsonReader::JsonPrintParse::EnqueueStop},
         {"Map", &JsonReader::JsonPrintParse::EnqueueMapDraw},
         {"Route", &JsonReader::JsonPrintParse::EnqueueRoute},
+        {"NearestStops", &JsonReader::JsonPrintParse::EnqueueNearestStops},
+        {"StopsInBox", &JsonReader::JsonPrintParse::EnqueueStopsInBox},
 };
 
+void JsonReader::EnqueueStop(input_info::Stop stop,
+                             input_info::StopLink stoplink) {
+  auto stop_ptr = &stops_input_queue_.emplace_back(stop);
+  input_queue_.emplace_back(RequestTypes::StopInsert{stop_ptr});
+  auto stoplink_ptr = &stoplinks_input_queue_.emplace_back(std::move(stoplink));
+  input_queue_.emplace_back(RequestTypes::StopLinkInsert{stoplink_ptr});
+}
+
+void JsonReader::EnqueueBus(input_info::Bus bus) {
+  auto bus_ptr = &buses_input_queue_.emplace_back(std::move(bus));
+  input_queue_.emplace_back(RequestTypes::BusInsert{bus_ptr});
+}
+
+void JsonReader::EnqueueStopRemoval(std::string_view name) {
+  removed_stops_.push_back(name);
+}
+
+void JsonReader::EnqueueBusRemoval(std::string_view name) {
+  removed_buses_.push_back(name);
+}
+
+void JsonReader::InputHandler::OnNull() {
+  if (section_) {
+    tree_.OnNull();
+    FinishTreeValue();
+  } else {
+    CheckBaseScalar();
+  }
+}
+
+void JsonReader::InputHandler::OnBool(bool value) {
+  if (section_) {
+    tree_.OnBool(value);
+    FinishTreeValue();
+  } else {
+    CheckBaseScalar();
+    if (depth_ == 3 && field_ == "is_roundtrip") {
+      request_.is_roundtrip = value;
+    }
+  }
+}
+
+void JsonReader::InputHandler::OnInt(int value) {
+  if (section_) {
+    tree_.OnInt(value);
+    FinishTreeValue();
+  } else {
+    OnBaseNumber(value);
+  }
+}
+
+void JsonReader::InputHandler::OnDouble(double value) {
+  if (section_) {
+    tree_.OnDouble(value);
+    FinishTreeValue();
+  } else {
+    OnBaseNumber(value);
+  }
+}
+
+void JsonReader::InputHandler::OnString(std::string_view value) {
+  if (section_) {
+    tree_.OnString(value);
+    FinishTreeValue();
+    return;
+  }
+  CheckBaseScalar();
+  if (depth_ == 3 && field_ == "type") {
+    request_.type = value;
+  } else if (depth_ == 3 && field_ == "name") {
+    request_.name = value;
+  } else if (depth_ == 4 && field_ == "stops") {
+    request_.stops.push_back(value);
+  }
+}
+
+void JsonReader::InputHandler::OnStartArray() {
+  if (section_) {
+    tree_.OnStartArray();
+  } else if (depth_ == 0) {
+    throw json::ParsingError("Input document must be a dictionary");
+  } else if (depth_ == 2) {
+    throw json::ParsingError("base_requests items must be dictionaries");
+  }
+  ++depth_;
+}
+
+void JsonReader::InputHandler::OnEndArray() {
+  --depth_;
+  if (section_) {
+    tree_.OnEndArray();
+    FinishTreeValue();
+  } else if (depth_ == 1) {
+    in_base_requests_ = false;
+  }
+}
+
+void JsonReader::InputHandler::OnStartDict() {
+  if (section_) {
+    tree_.OnStartDict();
+  } else if (depth_ == 1) {
+    throw json::ParsingError("base_requests must be an array");
+  } else if (depth_ == 2) {
+    request_ = BaseRequest{};
+  }
+  ++depth_;
+}
+
+void JsonReader::InputHandler::OnKey(std::string_view key) {
+  if (section_) {
+    tree_.OnKey(key);
+  } else if (depth_ == 1) {
+    if (key == "base_requests") {
+      in_base_requests_ = true;
+    } else {
+      section_ = std::string(key);
+    }
+  } else if (depth_ == 3) {
+    field_ = key;
+  } else if (depth_ == 4) {
+    neighbour_ = key;
+  }
+}
+
+void JsonReader::InputHandler::OnEndDict() {
+  --depth_;
+  if (section_) {
+    tree_.OnEndDict();
+    FinishTreeValue();
+  } else if (in_base_requests_ && depth_ == 2) {
+    EnqueueRequest();
+  }
+}
+
+json::Dict JsonReader::InputHandler::ExtractSections() {
+  return std::move(sections_);
+}
+
+void JsonReader::InputHandler::FinishTreeValue() {
+  if (depth_ == 1) {
+    sections_.emplace(std::move(*section_), tree_.Extract());
+    section_.reset();
+  }
+}
+
+void JsonReader::InputHandler::CheckBaseScalar() const {
+  if (depth_ == 0) {
+    throw json::ParsingError("Input document must be a dictionary");
+  } else if (depth_ == 1) {
+    throw json::ParsingError("base_requests must be an array");
+  } else if (depth_ == 2) {
+    throw json::ParsingError("base_requests items must be dictionaries");
+  }
+}
+
+void JsonReader::InputHandler::OnBaseNumber(double value) {
+  CheckBaseScalar();
+  if (depth_ == 3 && field_ == "latitude") {
+    request_.pos.lat = value;
+  } else if (depth_ == 3 && field_ == "longitude") {
+    request_.pos.lng = value;
+  } else if (depth_ == 4 && field_ == "road_distances") {
+    request_.road_distances.emplace_back(neighbour_, value);
+  }
+}
+
+void JsonReader::InputHandler::EnqueueRequest() {
+  using namespace std::literals;
+  if (request_.type == "Stop") {
+    parent_.EnqueueStop({request_.name, request_.pos},
+                        {request_.name, std::move(request_.road_distances)});
+  } else if (request_.type == "Bus") {
+    parent_.EnqueueBus(
+        {request_.name, std::move(request_.stops), request_.is_roundtrip});
+  } else if (request_.type == "RemoveStop") {
+    parent_.EnqueueStopRemoval(request_.name);
+  } else if (request_.type == "RemoveBus") {
+    parent_.EnqueueBusRemoval(request_.name);
+  } else {
+    throw json::ParsingError("Unknown base request type "s +
+                             std::string(request_.type));
+  }
+}
+
 void JsonReader::CatalogueInserter::operator()(
     const JsonReader::RequestTypes::StopInsert &req) {
   parent_.catalogue_.AddStop(*req.stop_ptr);
@@ -141,6 +406,20 @@ void JsonReader::CatalogueInserter::operator()(
 }
 
 void JsonReader::InsertAllIntoCatalogue() {
+  profile::ScopedTimer timer{"insert_into_catalogue"};
+  if (!removed_stops_.empty() || !removed_buses_.empty()) {
+    throw std::invalid_argument(
+        "RemoveStop and RemoveBus requests only apply to existing database");
+  }
+  if (profile::IsEnabled()) {
+    for (const auto &elem : input_queue_) {
+      if (std::holds_alternative<RequestTypes::StopInsert>(elem)) {
+        profile::Count("stops_inserted", 1);
+      } else if (std::holds_alternative<RequestTypes::BusInsert>(elem)) {
+        profile::Count("buses_inserted", 1);
+      }
+    }
+  }
   std::sort(input_queue_.begin(), input_queue_.end(),
             [](InputQueue &lhs, InputQueue &rhs) {
               return lhs.index() < rhs.index();
@@ -151,10 +430,115 @@ void JsonReader::InsertAllIntoCatalogue() {
   Clear();
 }
 
+void JsonReader::InsertUpdateIntoCatalogue(
+    const core::TransportCatalogue &previous) {
+  using namespace std::literals;
+  profile::ScopedTimer timer{"insert_into_catalogue"};
+  const std::unordered_set<std::string_view> removed_stops(
+      removed_stops_.begin(), removed_stops_.end());
+  const std::unordered_set<std::string_view> removed_buses(
+      removed_buses_.begin(), removed_buses_.end());
+  for (const std::string_view name : removed_stops) {
+    if (!previous.GetStopInfo(name)) {
+      throw std::invalid_argument("Unknown stop is removed: "s +
+                                  std::string(name));
+    }
+  }
+  for (const std::string_view name : removed_buses) {
+    if (!previous.GetBusInfo(name)) {
+      throw std::invalid_argument("Unknown bus is removed: "s +
+                                  std::string(name));
+    }
+  }
+  // stop described several times takes the latest description
+  std::unordered_map<std::string_view, const input_info::Stop *>
+      updated_stops;
+  for (const auto &stop : stops_input_queue_) {
+    updated_stops[stop.name] = &stop;
+  }
+  std::unordered_set<std::string_view> updated_buses;
+  for (const auto &bus : buses_input_queue_) {
+    updated_buses.insert(bus.name);
+  }
+  // removed stops which are not added back
+  std::unordered_set<std::string_view> gone_stops;
+  for (const std::string_view name : removed_stops) {
+    if (!updated_stops.count(name)) {
+      gone_stops.insert(name);
+    }
+  }
+
+  // previous stops go first, so their ids (and routing graph vertices) shift
+  // only if some of them are removed
+  const auto previous_stops = previous.GetAllStops();
+  for (const data::Stop *stop : previous_stops) {
+    if (removed_stops.count(stop->name)) {
+      continue;
+    }
+    const auto it = updated_stops.find(stop->name);
+    catalogue_.AddStop(it != updated_stops.end()
+                           ? *it->second
+                           : input_info::Stop{stop->name, stop->pos});
+  }
+  for (const auto &stop : stops_input_queue_) {
+    if (updated_stops.at(stop.name) == &stop &&
+        (!previous.GetStopInfo(stop.name) || removed_stops.count(stop.name))) {
+      catalogue_.AddStop(stop);
+    }
+  }
+
+  for (const data::Stop *stop : previous_stops) {
+    if (removed_stops.count(stop->name)) {
+      continue;
+    }
+    input_info::StopLink links{stop->name, {}};
+    const auto stop_info = previous.GetStopInfo(stop->name);
+    for (size_t i = 0; i < stop_info->linked_stops.size(); ++i) {
+      const std::string_view neighbour =
+          previous_stops[stop_info->linked_stops[i]]->name;
+      if (!removed_stops.count(neighbour)) {
+        links.neighbours.emplace_back(neighbour,
+                                      stop_info->linked_distances[i]);
+      }
+    }
+    catalogue_.AddStopLinks(links);
+  }
+  for (const auto &links : stoplinks_input_queue_) {
+    catalogue_.AddStopLinks(links);
+  }
+
+  for (const data::Bus *bus : previous.GetAllBuses()) {
+    if (removed_buses.count(bus->name) || updated_buses.count(bus->name)) {
+      continue;
+    }
+    input_info::Bus kept{bus->name, {}, bus->is_circular};
+    for (const data::Stop *stop : bus->stops) {
+      if (gone_stops.count(stop->name)) {
+        throw std::invalid_argument("Removed stop "s + stop->name +
+                                    " is used by bus " + bus->name);
+      }
+      kept.stops.push_back(stop->name);
+    }
+    catalogue_.AddBus(kept);
+  }
+  for (const auto &bus : buses_input_queue_) {
+    for (const std::string_view stop : bus.stops) {
+      if (gone_stops.count(stop)) {
+        throw std::invalid_argument("Removed stop "s + std::string(stop) +
+                                    " is used by bus " + std::string(bus.name));
+      }
+    }
+    catalogue_.AddBus(bus);
+  }
+  Clear();
+}
+
 void JsonReader::Clear() {
   input_queue_.clear();
   stops_input_queue_.clear();
   stoplinks_input_queue_.clear();
   buses_input_queue_.clear();
+  removed_stops_.clear();
+  removed_buses_.clear();
 }
 } // namespace json
\ No newline at end of file
@@ -8,9 +8,11 @@
 
 #include <algorithm>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "domain.h"
@@ -44,6 +46,17 @@ public:
                       core::RequestHandler &req_handler)
       : catalogue_{catalogue}, req_handler_{req_handler} {};
 
+  /*!
+   * Parses JSON document without building tree for "base_requests": their
+   * elements are read straight from parser events into input queues, which
+   * are inserted into catalogue by the following ProcessInput() call
+   * \param[in,out] input document text, escape sequences are decoded in
+   * place; must stay alive and unmodified until ProcessInput() returns
+   * \return document with all top-level sections except "base_requests",
+   * allocated from its own arena like json::Load() result
+   */
+  json::Document ReadInput(std::string &input);
+
   void ProcessInput(
       const json::Dict &doc_map,
       input_info::OutputFormat format = input_info::OutputFormat::Json);
@@ -51,6 +64,7 @@ public:
   void EnqueueRenderSettingsUpdate(const json::Dict &doc_map);
   void EnqueueRoutingSettingsUpdate(const json::Dict &doc_map);
   void EnqueueStatReqs(const json::Dict &doc_map);
+  void ApplyExecutionSettings(const json::Dict &doc_map);
 
   //! Handles node that represents single known action defined in RequestTypes
   void ParseSingleCommand(const json::Node &node);
@@ -58,9 +72,22 @@ public:
   /*!
    * Inserts all of new routes and stops parsed so far into
    * JsonReader::catalogue_
+   * \throw std::invalid_argument if removal requests were parsed
    */
   void InsertAllIntoCatalogue();
 
+  /*!
+   * Fills empty JsonReader::catalogue_ with contents of \p previous changed
+   * by requests parsed so far: "Stop" and "Bus" add new or replace existing
+   * stops and routes (listed road distances override previous ones),
+   * "RemoveStop" and "RemoveBus" remove them. Remaining stops keep their
+   * order, new ones follow
+   * \param[in] previous must outlive JsonReader::catalogue_ filling
+   * \throw std::invalid_argument if unknown stop or bus is removed, or
+   * removed stop is still used by some route
+   */
+  void InsertUpdateIntoCatalogue(const core::TransportCatalogue &previous);
+
 private:
   //! Database to be modified in place with insertion of new stops and routes
   core::TransportCatalogue &catalogue_;
@@ -86,6 +113,11 @@ private:
     };
   };
 
+  void EnqueueStop(input_info::Stop stop, input_info::StopLink stoplink);
+  void EnqueueBus(input_info::Bus bus);
+  void EnqueueStopRemoval(std::string_view name);
+  void EnqueueBusRemoval(std::string_view name);
+
   //! Runtime polymorphic type capable of storing all kinds of RequestTypes
   using InputQueue =
       std::variant<RequestTypes::StopInsert, RequestTypes::StopLinkInsert,
@@ -108,6 +140,8 @@ private:
     JsonReader &parent_;
     void EnqueueBus(const json::Node &node);
     void EnqueueStop(const json::Node &node);
+    void EnqueueStopRemoval(const json::Node &node);
+    void EnqueueBusRemoval(const json::Node &node);
   } json_input_parser_{*this};
 
   /*!
@@ -128,8 +162,70 @@ private:
     void EnqueueStop(const json::Node &node);
     void EnqueueMapDraw(const json::Node &node);
     void EnqueueRoute(const json::Node &node);
+    void EnqueueNearestStops(const json::Node &node);
+    void EnqueueStopsInBox(const json::Node &node);
+    //! Route end is either stop name or dictionary with point coordinates
+    static core::TransportRouter::Place ParsePlace(const json::Node &node);
   } json_print_parser_{req_handler_};
 
+  /*!
+   * Parsing events receiver used by ReadInput(). Stops and routes of
+   * "base_requests" are collected from events and enqueued one by one, other
+   * sections are assembled into regular JSON tree
+   */
+  class InputHandler final : public json::Handler {
+  public:
+    //! \param[in] resource memory resource of assembled sections
+    InputHandler(JsonReader &parent, std::pmr::memory_resource *resource)
+        : parent_{parent}, tree_{resource}, sections_{resource} {};
+
+    void OnNull() override;
+    void OnBool(bool value) override;
+    void OnInt(int value) override;
+    void OnDouble(double value) override;
+    void OnString(std::string_view value) override;
+    void OnStartArray() override;
+    void OnEndArray() override;
+    void OnStartDict() override;
+    void OnKey(std::string_view key) override;
+    void OnEndDict() override;
+
+    json::Dict ExtractSections();
+
+  private:
+    //! Fields of single "base_requests" element
+    struct BaseRequest {
+      std::string_view type{};
+      std::string_view name{};
+      geo::Coordinates pos{};
+      bool is_roundtrip{};
+      std::vector<std::pair<std::string_view, double>> road_distances{};
+      std::vector<std::string_view> stops{};
+    };
+
+    JsonReader &parent_;
+    //! Amount of currently open arrays and dictionaries
+    size_t depth_{0};
+    //! Whether "base_requests" array is being read
+    bool in_base_requests_{false};
+    //! Name of top-level section being assembled by tree_
+    std::optional<std::string> section_;
+    json::NodeHandler tree_;
+    json::Dict sections_;
+    BaseRequest request_;
+    //! Key of request_ field being read
+    std::string_view field_;
+    //! Stop name of road_distances item being read
+    std::string_view neighbour_;
+
+    //! Stores section assembled by tree_ once it is complete
+    void FinishTreeValue();
+    //! Throws unless scalar is inside of "base_requests" element
+    void CheckBaseScalar() const;
+    void OnBaseNumber(double value);
+    void EnqueueRequest();
+  };
+
   //! Functor used to process elements of JsonReader::input_queue_
   struct CatalogueInserter {
   public:
@@ -162,6 +258,10 @@ private:
   //! Temporary storage of buses related information
   std::deque<input_info::Bus> buses_input_queue_;
 
+  //! Names of stops and buses to be removed by InsertUpdateIntoCatalogue()
+  std::vector<std::string_view> removed_stops_;
+  std::vector<std::string_view> removed_buses_;
+
   /*!
    * Clears all temporary JSON data, making JsonReader ready to accept new
    * document
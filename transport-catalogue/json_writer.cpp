@@ -0,0 +1,181 @@
+#include "json_writer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace json {
+
+Writer &Writer::StartArray() {
+  BeforeValue(true);
+  out_.put('[');
+  LineBreak();
+  stack_.push_back({false, true});
+  return *this;
+}
+
+Writer &Writer::EndArray() {
+  EndContainer(false, ']');
+  return *this;
+}
+
+Writer &Writer::StartDict() {
+  BeforeValue(true);
+  out_.put('{');
+  LineBreak();
+  stack_.push_back({true, true});
+  return *this;
+}
+
+Writer &Writer::EndDict() {
+  EndContainer(true, '}');
+  return *this;
+}
+
+Writer &Writer::Key(std::string_view key) {
+  if (stack_.empty() || !stack_.back().is_dict) {
+    throw std::logic_error("Key(...) is only allowed inside of dictionary");
+  }
+  if (key_pending_) {
+    throw std::logic_error("Previously written Key(...) must get value "
+                           "before writing Key(...) again");
+  }
+  if (!stack_.back().is_empty) {
+    out_.put(',');
+    LineBreak();
+  }
+  stack_.back().is_empty = false;
+  PrintIndent(stack_.size());
+  PrintString(key);
+  out_ << (single_line_ ? ":" : ": ");
+  key_pending_ = true;
+  return *this;
+}
+
+Writer &Writer::Value(std::nullptr_t) {
+  BeforeValue(false);
+  out_ << "null";
+  return *this;
+}
+
+Writer &Writer::Value(bool value) {
+  BeforeValue(false);
+  out_ << (value ? "true" : "false");
+  return *this;
+}
+
+Writer &Writer::Value(int value) {
+  BeforeValue(false);
+  out_ << value;
+  return *this;
+}
+
+Writer &Writer::Value(double value) {
+  BeforeValue(false);
+  out_ << value;
+  return *this;
+}
+
+Writer &Writer::Value(std::string_view value) {
+  BeforeValue(false);
+  PrintString(value);
+  return *this;
+}
+
+Writer &Writer::RawValue(std::string_view json) {
+  BeforeValue(!json.empty() && (json.front() == '[' || json.front() == '{'));
+  out_ << json;
+  return *this;
+}
+
+Writer &Writer::RawValue(std::string_view head, int value,
+                         std::string_view tail) {
+  BeforeValue(!head.empty() && (head.front() == '[' || head.front() == '{'));
+  out_ << head << value << tail;
+  return *this;
+}
+
+void Writer::BeforeValue(bool is_container) {
+  if (stack_.empty()) {
+    return;
+  }
+  Frame &frame = stack_.back();
+  if (frame.is_dict) {
+    if (!key_pending_) {
+      throw std::logic_error(
+          "Dictionary key must be written before corresponding value");
+    }
+    key_pending_ = false;
+    if (is_container) {
+      LineBreak();
+      PrintIndent(stack_.size());
+    }
+    return;
+  }
+  if (!frame.is_empty) {
+    out_.put(',');
+    LineBreak();
+  }
+  frame.is_empty = false;
+  PrintIndent(stack_.size());
+}
+
+void Writer::EndContainer(bool is_dict, char bracket) {
+  if (stack_.empty() || stack_.back().is_dict != is_dict || key_pending_) {
+    throw std::logic_error("Incorrect order of container start/end calls");
+  }
+  stack_.pop_back();
+  LineBreak();
+  PrintIndent(stack_.size());
+  out_ << bracket;
+}
+
+void Writer::LineBreak() {
+  if (!single_line_) {
+    out_.put('\n');
+  }
+}
+
+void Writer::PrintIndent(size_t level) {
+  if (single_line_) {
+    return;
+  }
+  static constexpr std::string_view SPACES{"                                "};
+  // indentation is written by chunks rather than by single characters
+  for (size_t left = (base_level_ + level) * INDENT_STEP; left > 0;) {
+    const size_t chunk = std::min(left, SPACES.size());
+    out_.write(SPACES.data(), static_cast<std::streamsize>(chunk));
+    left -= chunk;
+  }
+}
+
+void Writer::PrintString(std::string_view str) {
+  out_.put('"');
+  // unescaped runs are written at once
+  size_t run_begin = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    const char *replacement = nullptr;
+    switch (str[i]) {
+    case '\n':
+      replacement = R"(\n)";
+      break;
+    case '\r':
+      replacement = R"(\r)";
+      break;
+    case '"':
+      replacement = R"(\")";
+      break;
+    case '\\':
+      replacement = R"(\\)";
+      break;
+    default:
+      continue;
+    }
+    out_.write(str.data() + run_begin, i - run_begin);
+    out_ << replacement;
+    run_begin = i + 1;
+  }
+  out_.write(str.data() + run_begin, str.size() - run_begin);
+  out_.put('"');
+}
+
+} // namespace json
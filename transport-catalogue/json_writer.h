@@ -0,0 +1,85 @@
+/*!
+ * \file json_writer.h
+ * \brief JSON generator which writes straight to output stream
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+/*!
+ * \brief Writes JSON to stream as soon as values are supplied, no Node tree
+ * is built
+ *
+ * Output is formatted exactly like json::Print() would format the same
+ * document, but dictionary keys are written in the order they are given (so
+ * to match json::Print() they should be sorted by caller). Alternatively the
+ * whole value may be written on a single line with no extra spaces.
+ */
+class Writer {
+public:
+  /*!
+   * \param[out] output stream to write to
+   * \param[in] base_level nesting level of the written value in a larger
+   * document, its lines are indented accordingly (see RawValue())
+   * \param[in] single_line whether line breaks and indentation are omitted
+   */
+  explicit Writer(std::ostream &output, size_t base_level = 0,
+                  bool single_line = false)
+      : out_{output}, base_level_{base_level}, single_line_{single_line} {};
+
+  bool IsSingleLine() const { return single_line_; }
+
+  Writer &StartArray();
+  Writer &EndArray();
+  Writer &StartDict();
+  Writer &EndDict();
+  Writer &Key(std::string_view key);
+
+  Writer &Value(std::nullptr_t);
+  Writer &Value(bool value);
+  Writer &Value(int value);
+  Writer &Value(double value);
+  Writer &Value(std::string_view value);
+  Writer &Value(const char *value) { return Value(std::string_view{value}); }
+
+  /*!
+   * Writes value that has already been formatted, e.g. by another Writer
+   * whose base level is the nesting level of this value
+   */
+  Writer &RawValue(std::string_view json);
+
+  //! Writes preformatted value with \p value inserted between \p head and
+  //! \p tail, e.g. answer whose request_id is only known now
+  Writer &RawValue(std::string_view head, int value, std::string_view tail);
+
+private:
+  //! Open array or dictionary
+  struct Frame {
+    bool is_dict;
+    bool is_empty;
+  };
+
+  std::ostream &out_;
+  size_t base_level_;
+  bool single_line_;
+  std::vector<Frame> stack_;
+  //! Whether Key() was written and is waiting for its value
+  bool key_pending_{false};
+  static constexpr int INDENT_STEP = 4;
+
+  //! Writes separator and indentation that precede value
+  void BeforeValue(bool is_container);
+  void EndContainer(bool is_dict, char bracket);
+  //! Both do nothing in single line mode
+  void LineBreak();
+  void PrintIndent(size_t level);
+  //! Writes quoted string with special characters escaped
+  void PrintString(std::string_view str);
+};
+
+} // namespace json
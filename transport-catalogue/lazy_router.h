@@ -0,0 +1,150 @@
+/*!
+ * \file lazy_router.h
+ * \brief All-pairs router whose table rows are computed on demand
+ */
+
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+/*!
+ * Answers routes from rows of all-pairs table (see Router::RoutesTable), but
+ * a row is only computed by single-source Dijkstra's search the first time a
+ * route from its vertex is requested. Computed rows are kept in a bounded LRU
+ * cache, so memory grows with the amount of distinct origins actually queried
+ * (up to the limit) instead of V². Safe to use from several threads.
+ */
+template <typename Weight> class LazyRouter {
+private:
+  using Graph = CsrGraph<Weight>;
+
+public:
+  using RouteInfo = graph::RouteInfo<Weight>;
+
+  //! Rows are computed by RouterView code, so the sentinel has to be shared
+  static constexpr uint32_t NO_EDGE = RouterView<Weight>::NO_EDGE;
+  static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+  /*!
+   * \param[in] graph finished graph, must outlive router
+   * \param[in] capacity maximum amount of cached rows (at least one)
+   */
+  explicit LazyRouter(const Graph &graph, size_t capacity = DEFAULT_CAPACITY);
+
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+  size_t GetCapacity() const { return capacity_; }
+
+private:
+  //! Routes from a single vertex, same sentinels as in Router::RoutesTable
+  struct Row {
+    std::vector<Weight> weights;
+    std::vector<uint32_t> prev_edges;
+  };
+  using RowPtr = std::shared_ptr<const Row>;
+
+  static constexpr Weight ZERO_WEIGHT{};
+  static constexpr Weight INFINITE_WEIGHT =
+      std::numeric_limits<Weight>::infinity();
+
+  const Graph &graph_;
+  size_t capacity_;
+
+  // most recently used rows are at the front
+  mutable std::mutex mutex_;
+  mutable std::list<std::pair<VertexId, RowPtr>> rows_;
+  mutable std::unordered_map<VertexId,
+                             typename std::list<std::pair<VertexId, RowPtr>>::
+                                 iterator>
+      row_positions_;
+
+  RowPtr GetRow(VertexId from) const;
+
+  Row ComputeRow(VertexId from) const;
+};
+
+template <typename Weight>
+LazyRouter<Weight>::LazyRouter(const Graph &graph, size_t capacity)
+    : graph_(graph), capacity_(std::max<size_t>(capacity, 1)) {
+  for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+    if (graph.GetEdgeWeight(edge_id) < ZERO_WEIGHT) {
+      throw std::domain_error("Edges' weights should be non-negative");
+    }
+  }
+}
+
+template <typename Weight>
+std::optional<typename LazyRouter<Weight>::RouteInfo>
+LazyRouter<Weight>::BuildRoute(VertexId from, VertexId to) const {
+  const size_t vertex_count = graph_.GetVertexCount();
+  if (from >= vertex_count || to >= vertex_count) {
+    throw std::out_of_range("Vertex id is out of range");
+  }
+  // row is shared, so it stays valid even if evicted meanwhile
+  const RowPtr row = GetRow(from);
+  if (row->weights[to] == INFINITE_WEIGHT) {
+    return std::nullopt;
+  }
+  std::vector<EdgeId> edges;
+  for (uint32_t edge_id = row->prev_edges[to]; edge_id != NO_EDGE;
+       edge_id = row->prev_edges[graph_.GetEdgeSource(edge_id)]) {
+    edges.push_back(edge_id);
+  }
+  std::reverse(edges.begin(), edges.end());
+
+  return RouteInfo{row->weights[to], std::move(edges)};
+}
+
+template <typename Weight>
+typename LazyRouter<Weight>::RowPtr
+LazyRouter<Weight>::GetRow(VertexId from) const {
+  {
+    std::lock_guard guard(mutex_);
+    if (auto it = row_positions_.find(from); it != row_positions_.end()) {
+      rows_.splice(rows_.begin(), rows_, it->second);
+      return it->second->second;
+    }
+  }
+
+  // search runs unlocked, two threads may compute the same row at worst
+  auto row = std::make_shared<const Row>(ComputeRow(from));
+
+  std::lock_guard guard(mutex_);
+  if (auto it = row_positions_.find(from); it != row_positions_.end()) {
+    rows_.splice(rows_.begin(), rows_, it->second);
+    return it->second->second;
+  }
+  rows_.emplace_front(from, row);
+  row_positions_[from] = rows_.begin();
+  if (rows_.size() > capacity_) {
+    row_positions_.erase(rows_.back().first);
+    rows_.pop_back();
+  }
+  return row;
+}
+
+template <typename Weight>
+typename LazyRouter<Weight>::Row
+LazyRouter<Weight>::ComputeRow(VertexId from) const {
+  const size_t vertex_count = graph_.GetVertexCount();
+  Row row{std::vector<Weight>(vertex_count),
+          std::vector<uint32_t>(vertex_count)};
+  ComputeRoutesFrom(graph_, from, row.weights.data(), row.prev_edges.data());
+  return row;
+}
+
+} // namespace graph
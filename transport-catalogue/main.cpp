@@ -1,22 +1,175 @@
 #include "domain.h"
-#include "json_builder.h"
 #include "json_reader.h"
+#include "json_writer.h"
+#include "profiler.h"
 #include "serialization.h"
+#include "snapshot.h"
 
+#include <algorithm>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 
 void PrintUsage(const std::string &filename, std::ostream &stream = std::cerr) {
-  stream << "Usage: " << filename << " [make_base|process_requests]\n";
+  stream << "Usage: " << filename
+         << " [make_base|update_base|process_requests|serve] "
+            "[--profile[=file]]\n";
+}
+
+/*!
+ * Writes instrumentation report collected during the run, if it was enabled
+ * \param[in] target file name, empty one means standard error stream
+ */
+void WriteProfile(const std::string &target) {
+  if (!profile::IsEnabled()) {
+    return;
+  }
+  if (target.empty()) {
+    profile::WriteReport(std::cerr);
+    return;
+  }
+  std::ofstream out(target);
+  profile::WriteReport(out);
+}
+
+/*!
+ * Writes database to the file given by serialization settings, in the format
+ * they choose. File is replaced at once, so it may be the one database was
+ * imported from
+ */
+void ExportBase(const json::Dict &sr_settings,
+                core::TransportCatalogue &database,
+                graphics::MapRenderer &renderer, core::TransportRouter &router,
+                core::RequestHandler &req_handler) {
+  serialization::Serializer serializer{};
+  if (sr_settings.count("precompute_answers") &&
+      sr_settings.at("precompute_answers").AsBool()) {
+    database.SetPrecomputedAnswers(req_handler.PrecomputeAnswers());
+  }
+  database.ExportDataBase(serializer);
+  renderer.ExportRenderSettings(serializer);
+  router.ExportState(serializer);
+  if (sr_settings.count("prerender_map") &&
+      sr_settings.at("prerender_map").AsBool()) {
+    renderer.ExportMap(serializer, database.GetVersion(), [&req_handler] {
+      return req_handler.GetCatalogueData();
+    });
+  }
+
+  const std::filesystem::path file{sr_settings.at("file").AsString()};
+  std::filesystem::path temporary{file};
+  temporary += ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary);
+    if (sr_settings.count("format") &&
+        sr_settings.at("format").AsString() == "flat") {
+      serializer.SerializeToFlatOstream(&out);
+    } else {
+      serializer.SerializeToOstream(&out);
+    }
+  }
+  std::filesystem::rename(temporary, file);
 }
 
 int main(int argc, char *argv[]) {
   std::filesystem::path fp{argv[0]};
-  if (argc != 2) {
+  if (argc != 2 && argc != 3) {
     PrintUsage(fp.filename().string());
     return 1;
   }
   const std::string_view mode(argv[1]);
+  if (mode != "make_base" && mode != "update_base" &&
+      mode != "process_requests" && mode != "serve") {
+    PrintUsage(fp.filename().string());
+    return 1;
+  }
+  // instrumentation report goes to standard error or to the given file
+  std::string profile_target;
+  if (argc == 3) {
+    const std::string_view option(argv[2]);
+    if (option != "--profile" && option.substr(0, 10) != "--profile=") {
+      PrintUsage(fp.filename().string());
+      return 1;
+    }
+    profile_target = option.substr(std::min<size_t>(option.size(), 10));
+    profile::SetEnabled(true);
+  }
+
+  if (mode == "serve") {
+    // every input line is a separate document answered by a single line,
+    // base is loaded by the first document and stays resident until a
+    // document with "reload_base" replaces it in background
+    core::SnapshotHolder snapshots;
+    // answers of a document are printed only once all of them succeeded
+    std::ostringstream batch_output;
+    size_t thread_count = 1;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
+      }
+      if (const auto error = snapshots.TakeLoadError()) {
+        std::cerr << "Database reload failed: " << *error << '\n';
+      }
+      try {
+        const json::Document doc = json::Load(line);
+        const auto &doc_map = doc.GetRoot().AsMap();
+        if (doc_map.count("base_requests")) {
+          throw std::invalid_argument(
+              "base_requests are not accepted in serve mode");
+        }
+        // snapshot stays alive until the document is answered, even if
+        // a reloaded one is published meanwhile
+        auto snapshot = snapshots.Acquire();
+        if (!snapshot) {
+          snapshots.Load(doc_map.at("serialization_settings")
+                             .AsMap()
+                             .at("file")
+                             .AsString());
+          snapshot = snapshots.Acquire();
+        } else if (doc_map.count("reload_base") &&
+                   doc_map.at("reload_base").AsBool()) {
+          const std::string file =
+              doc_map.count("serialization_settings")
+                  ? doc_map.at("serialization_settings")
+                        .AsMap()
+                        .at("file")
+                        .AsString()
+                  : snapshot->file;
+          if (!snapshots.StartLoading(file)) {
+            throw std::runtime_error("Database is already being reloaded");
+          }
+        }
+        core::RequestHandler req_handler{batch_output, snapshot->database,
+                                         snapshot->renderer, snapshot->router};
+        req_handler.SetThreadCount(thread_count);
+        json::JsonReader json_reader{snapshot->database, req_handler};
+        json_reader.ProcessInput(doc_map, input_info::OutputFormat::JsonLine);
+        thread_count = req_handler.GetThreadCount();
+        std::cout << batch_output.str();
+      } catch (const std::exception &e) {
+        json::Writer{std::cout, 0, true}
+            .StartDict()
+            .Key("error_message")
+            .Value(e.what())
+            .EndDict();
+      }
+      batch_output.str({});
+      std::cout << std::endl;
+    }
+    // reloading started by the last documents may fail after them
+    snapshots.Wait();
+    if (const auto error = snapshots.TakeLoadError()) {
+      std::cerr << "Database reload failed: " << *error << '\n';
+    }
+    WriteProfile(profile_target);
+    return 0;
+  }
 
   core::TransportCatalogue database{};
   core::TransportRouter router{database};
@@ -24,35 +177,39 @@ int main(int argc, char *argv[]) {
   core::RequestHandler req_handler{std::cout, database, renderer, router};
   json::JsonReader json_reader{database, req_handler};
 
-  const json::Document doc = json::Load(std::cin);
-  const auto &doc_map = doc.GetRoot().AsMap();
+  // stops and routes are read without building JSON tree, their names refer
+  // to input buffer
+  std::string input{std::istreambuf_iterator<char>(std::cin),
+                    std::istreambuf_iterator<char>()};
+  const json::Document doc = json_reader.ReadInput(input);
+  const json::Dict &doc_map = doc.GetRoot().AsMap();
 
   if (mode == "make_base") {
-    serialization::Serializer serializer{};
-
     json_reader.ProcessInput(doc_map, input_info::OutputFormat::None);
-    database.ExportDataBase(serializer);
-    renderer.ExportRenderSettings(serializer);
-    router.ExportState(serializer);
-
-    std::ofstream out(
-        doc_map.at("serialization_settings").AsMap().at("file").AsString());
-    serializer.SerializeToOstream(&out);
-
-  } else if (mode == "process_requests") {
-    std::ifstream in(
-        doc_map.at("serialization_settings").AsMap().at("file").AsString());
-
-    serialization::TrCatalogue sr_catalogue;
-    sr_catalogue.ParseFromIstream(&in);
-
-    database.ImportDataBase(sr_catalogue);
-    renderer.ImportRenderSettings(sr_catalogue);
-    router.ImportState(sr_catalogue);
-
-    json_reader.ProcessInput(doc_map);
+    ExportBase(doc_map.at("serialization_settings").AsMap(), database,
+               renderer, router, req_handler);
+  } else if (mode == "update_base") {
+    // base_requests describe changes of the stored database, which is
+    // imported aside and copied into the catalogue with changes applied
+    if (doc_map.count("routing_settings")) {
+      throw std::invalid_argument(
+          "Routing settings of existing database can't be changed");
+    }
+    const auto &sr_settings = doc_map.at("serialization_settings").AsMap();
+    core::TransportCatalogue previous_database{};
+    core::TransportRouter previous_router{previous_database};
+    const auto flat_base =
+        core::ImportBase(sr_settings.at("file").AsString(), previous_database,
+                         renderer, previous_router);
+    json_reader.InsertUpdateIntoCatalogue(previous_database);
+    json_reader.ProcessInput(doc_map, input_info::OutputFormat::None);
+    router.PrepareRouting(previous_router);
+    ExportBase(sr_settings, database, renderer, router, req_handler);
   } else {
-    PrintUsage(fp.filename().string());
-    return 1;
+    const auto flat_base = core::ImportBase(
+        doc_map.at("serialization_settings").AsMap().at("file").AsString(),
+        database, renderer, router);
+    json_reader.ProcessInput(doc_map);
   }
-}
\ No newline at end of file
+  WriteProfile(profile_target);
+}
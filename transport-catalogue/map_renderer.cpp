@@ -11,7 +11,23 @@ svg::Point SphereProjector::operator()(geo::Coordinates coords) const {
 
 void MapRenderer::ImportRenderSettings(
     const serialization::TrCatalogue &sr_catalogue) {
-  auto &settings = sr_catalogue.render_settings();
+  ImportRenderSettings(sr_catalogue.render_settings());
+}
+
+void MapRenderer::ImportRenderSettings(const serialization::FlatBase &base) {
+  // settings are tiny, so they are kept as protobuf message in flat base too
+  const auto blob =
+      base.GetSection<char>(serialization::flat::Section::RenderSettings);
+  serialization::RenderSettings settings;
+  if (!settings.ParseFromArray(blob.data(), static_cast<int>(blob.size()))) {
+    throw std::runtime_error("Corrupted render settings in flat base");
+  }
+  ImportRenderSettings(settings);
+}
+
+void MapRenderer::ImportRenderSettings(
+    const serialization::RenderSettings &settings) {
+  ResetMap();
   settings_.width = settings.width();
   settings_.height = settings.height();
   settings_.padding = settings.padding();
@@ -57,7 +73,6 @@ std::string MapRenderer::RenderMap(data::RoutesData data) {
       data::StopCoordsIterator(data.routes_stops.cbegin()),
       data::StopCoordsIterator(data.routes_stops.cend()), settings_.width,
       settings_.height, settings_.padding};
-  svg::Document doc;
   std::sort(data.bus_stats.begin(), data.bus_stats.end(),
             [](const auto *lhs, const auto *rhs) {
               return lhs->bus_ptr->name < rhs->bus_ptr->name;
@@ -65,17 +80,66 @@ std::string MapRenderer::RenderMap(data::RoutesData data) {
   std::sort(
       data.routes_stops.begin(), data.routes_stops.end(),
       [](const auto *lhs, const auto *rhs) { return lhs->name < rhs->name; });
+
+  // objects are written to the result right away, each Draw function reuses
+  // a few of them
+  std::string result;
+  svg::DocumentWriter doc{result};
   DrawRoutes(data, projector, doc);
   DrawRouteNames(data, projector, doc);
   DrawStopSymbols(data, projector, doc);
   DrawStopNames(data, projector, doc);
+  doc.Finish();
+  return result;
+}
+
+std::shared_ptr<const std::string>
+MapRenderer::GetMap(uint64_t catalogue_version,
+                    const std::function<data::RoutesData()> &get_data) {
+  // rendering happens under lock, concurrent requests wait for the same image
+  std::lock_guard guard(map_mutex_);
+  if (!map_ || map_version_ != catalogue_version) {
+    map_ = std::make_shared<const std::string>(RenderMap(get_data()));
+    map_version_ = catalogue_version;
+  }
+  return map_;
+}
+
+void MapRenderer::ExportMap(
+    serialization::Serializer &sr, uint64_t catalogue_version,
+    const std::function<data::RoutesData()> &get_data) {
+  sr.SerializeRenderedMap(*GetMap(catalogue_version, get_data));
+}
+
+void MapRenderer::ImportMap(const serialization::TrCatalogue &sr_catalogue,
+                            uint64_t catalogue_version) {
+  if (sr_catalogue.rendered_map().empty()) {
+    return;
+  }
+  std::lock_guard guard(map_mutex_);
+  map_ = std::make_shared<const std::string>(sr_catalogue.rendered_map());
+  map_version_ = catalogue_version;
+}
+
+void MapRenderer::ImportMap(const serialization::FlatBase &base,
+                            uint64_t catalogue_version) {
+  const auto svg =
+      base.GetSection<char>(serialization::flat::Section::RenderedMap);
+  if (svg.empty()) {
+    return;
+  }
+  std::lock_guard guard(map_mutex_);
+  map_ = std::make_shared<const std::string>(svg.begin(), svg.end());
+  map_version_ = catalogue_version;
+}
 
-  std::ostringstream tmp{};
-  doc.Render(tmp);
-  return tmp.str();
+void MapRenderer::ResetMap() {
+  std::lock_guard guard(map_mutex_);
+  map_.reset();
 }
 
 void MapRenderer::LoadSettings(const json::Node &node) {
+  ResetMap();
   const auto &render_map = node.AsMap();
   settings_.width = render_map.at("width").AsDouble();
   settings_.height = render_map.at("height").AsDouble();
@@ -115,18 +179,19 @@ svg::Color MapRenderer::ParseColor(const json::Node &node) {
 }
 
 void MapRenderer::DrawRoutes(data::RoutesData &data, SphereProjector &projector,
-                             svg::Document &doc) {
+                             svg::DocumentWriter &doc) {
   size_t counter{0}, palsize{settings_.color_palette.size()};
+  svg::Polyline route;
+  route.SetFillColor(svg::NoneColor)
+      .SetStrokeWidth(settings_.line_width)
+      .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+      .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
   for (const auto bus : data.bus_stats) {
     if (!bus->unique_stops.empty()) {
       bool is_roundtrip = bus->bus_ptr->is_circular;
 
-      svg::Polyline route;
-      route.SetStrokeColor(settings_.color_palette.at(counter % palsize))
-          .SetFillColor(svg::NoneColor)
-          .SetStrokeWidth(settings_.line_width)
-          .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-          .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+      route.ClearPoints().SetStrokeColor(
+          settings_.color_palette.at(counter % palsize));
       for (auto stop : bus->bus_ptr->stops) {
         route.AddPoint(projector(stop->pos));
       }
@@ -138,15 +203,14 @@ void MapRenderer::DrawRoutes(data::RoutesData &data, SphereProjector &projector,
         }
       }
       ++counter;
-      doc.Add(std::move(route));
-      ;
+      doc.Add(route);
     }
   }
 }
 
 void MapRenderer::DrawRouteNames(data::RoutesData &data,
                                  SphereProjector &projector,
-                                 svg::Document &doc) {
+                                 svg::DocumentWriter &doc) {
   svg::Text name, substrate;
   substrate.SetOffset(settings_.bus_label_offset)
       .SetFontSize(static_cast<uint32_t>(settings_.bus_label_font_size))
@@ -189,7 +253,7 @@ void MapRenderer::DrawRouteNames(data::RoutesData &data,
 
 void MapRenderer::DrawStopSymbols(data::RoutesData &data,
                                   SphereProjector &projector,
-                                  svg::Document &doc) {
+                                  svg::DocumentWriter &doc) {
   svg::Circle circ;
   circ.SetRadius(settings_.stop_radius).SetFillColor("white");
   for (const auto stop : data.routes_stops) {
@@ -199,7 +263,7 @@ void MapRenderer::DrawStopSymbols(data::RoutesData &data,
 
 void MapRenderer::DrawStopNames(data::RoutesData &data,
                                 SphereProjector &projector,
-                                svg::Document &doc) {
+                                svg::DocumentWriter &doc) {
   svg::Text name, substrate;
   substrate.SetOffset(settings_.stop_label_offset)
       .SetFontSize(static_cast<uint32_t>(settings_.stop_label_font_size))
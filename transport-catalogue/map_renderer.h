@@ -5,10 +5,15 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <string>
 #include <vector>
 
 #include "domain.h"
@@ -53,6 +58,7 @@ public:
   MapRenderer() = default;
 
   void ImportRenderSettings(const serialization::TrCatalogue &sr_catalogue);
+  void ImportRenderSettings(const serialization::FlatBase &base);
   void ExportRenderSettings(serialization::Serializer &sr);
   /*!
    * Constructs map image
@@ -60,29 +66,65 @@ public:
    * \return Actual SVG stored as string
    */
   std::string RenderMap(data::RoutesData data);
+  /*!
+   * Returns map image, which is only rendered again when settings or database
+   * contents have changed since the previous call. Safe to call concurrently
+   * \param[in] catalogue_version see core::TransportCatalogue::GetVersion()
+   * \param[in] get_data provides routes to be drawn and all their stops, only
+   * called if map has to be rendered
+   */
+  std::shared_ptr<const std::string>
+  GetMap(uint64_t catalogue_version,
+         const std::function<data::RoutesData()> &get_data);
+  //! Stores map image of current database, so it is not rendered after import
+  void ExportMap(serialization::Serializer &sr, uint64_t catalogue_version,
+                 const std::function<data::RoutesData()> &get_data);
+  /*!
+   * Adopts map image stored by ExportMap() (if any), must follow import of
+   * render settings
+   * \param[in] catalogue_version version of database imported from the same
+   * file
+   */
+  void ImportMap(const serialization::TrCatalogue &sr_catalogue,
+                 uint64_t catalogue_version);
+  void ImportMap(const serialization::FlatBase &base,
+                 uint64_t catalogue_version);
   /*!
    * Updates image generation settings
    * \param[in] node json::Dict that defines all fields of RenderSettings
    */
   void LoadSettings(const json::Node &node);
+  //! Whether routes can be drawn: settings define at least one route color
+  bool HasPalette() const { return !settings_.color_palette.empty(); }
 
 private:
   //! MapRenderer settings storage
   input_info::RenderSettings settings_;
 
+  //! Guards map_ and map_version_
+  std::mutex map_mutex_;
+  //! Map rendered with current settings, nullptr if settings have changed
+  std::shared_ptr<const std::string> map_;
+  //! Database version map_ was rendered for
+  uint64_t map_version_{};
+
+  void ResetMap();
+
   static svg::Color ParseColor(const json::Node &node);
 
+  void ImportRenderSettings(const serialization::RenderSettings &settings);
+
   void DrawRoutes(data::RoutesData &data, SphereProjector &projector,
-                  svg::Document &doc);
+                  svg::DocumentWriter &doc);
 
   void DrawRouteNames(data::RoutesData &data, SphereProjector &projector,
-                      svg::Document &doc);
+                      svg::DocumentWriter &doc);
 
   void DrawStopSymbols(data::RoutesData &data, SphereProjector &projector,
-                       svg::Document &doc);
+                       svg::DocumentWriter &doc);
 
   void DrawStopNames(data::RoutesData &data, SphereProjector &projector,
-                     svg::Document &doc);
+                     svg::DocumentWriter &doc);
 
   static svg::Color DeserializeColor(const serialization::Color &color);
 };
@@ -0,0 +1,72 @@
+/*!
+ * \file parallel.h
+ * \brief Helpers to spread independent pieces of work across threads
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+//! Resolves requested amount of threads, 0 means
+//! std::thread::hardware_concurrency()
+inline size_t GetThreadCount(size_t requested) {
+  if (requested == 0) {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+  return requested;
+}
+
+/*!
+ * Calls func(index) for every index < count using up to thread_count threads
+ * (calling thread included), returns once all calls are finished. Indexes are
+ * handed out one by one, so calls may differ in amount of work. If some call
+ * throws, remaining indexes are skipped and the first exception is rethrown.
+ */
+template <typename Func>
+void For(size_t count, size_t thread_count, Func func) {
+  thread_count = std::min(GetThreadCount(thread_count), count);
+  if (thread_count <= 1) {
+    for (size_t index = 0; index < count; ++index) {
+      func(index);
+    }
+    return;
+  }
+  std::atomic<size_t> next_index{0};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto worker = [&next_index, count, &func, &error_mutex, &error]() {
+    for (size_t index = next_index++; index < count; index = next_index++) {
+      try {
+        func(index);
+      } catch (...) {
+        std::lock_guard guard(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next_index = count;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count - 1);
+  for (size_t i = 1; i < thread_count; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace parallel
@@ -0,0 +1,125 @@
+#include "profiler.h"
+
+#include "json_writer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+
+namespace profile {
+
+namespace {
+
+struct Phase {
+  uint64_t calls{};
+  std::chrono::nanoseconds total{};
+  std::chrono::nanoseconds max{};
+  uint64_t allocations{};
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::map<std::string_view, Phase> phases;
+  std::map<std::string_view, uint64_t> counters;
+};
+
+Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+thread_local uint64_t thread_allocations = 0;
+std::atomic<uint64_t> total_allocations{0};
+
+double ToMilliseconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+namespace detail {
+
+void AddTime(std::string_view phase, std::chrono::nanoseconds duration,
+             uint64_t allocations) {
+  Registry &registry = GetRegistry();
+  std::lock_guard lock{registry.mutex};
+  Phase &stats = registry.phases[phase];
+  ++stats.calls;
+  stats.total += duration;
+  stats.max = std::max(stats.max, duration);
+  stats.allocations += allocations;
+}
+
+void AddCount(std::string_view counter, uint64_t value) {
+  Registry &registry = GetRegistry();
+  std::lock_guard lock{registry.mutex};
+  registry.counters[counter] += value;
+}
+
+} // namespace detail
+
+void SetEnabled(bool value) {
+  detail::enabled.store(value, std::memory_order_relaxed);
+}
+
+void Reset() {
+  Registry &registry = GetRegistry();
+  std::lock_guard lock{registry.mutex};
+  registry.phases.clear();
+  registry.counters.clear();
+  total_allocations = 0;
+}
+
+uint64_t GetThreadAllocations() { return thread_allocations; }
+
+void WriteReport(std::ostream &out) {
+  Registry &registry = GetRegistry();
+  std::lock_guard lock{registry.mutex};
+  // counts may exceed int, they are formatted separately
+  auto count = [](uint64_t value) { return std::to_string(value); };
+  json::Writer writer{out};
+  writer.StartDict().Key("counters").StartDict();
+  auto counters = registry.counters;
+  counters.emplace("allocations", total_allocations.load());
+  for (const auto &[name, value] : counters) {
+    writer.Key(name).RawValue(count(value));
+  }
+  writer.EndDict().Key("phases").StartDict();
+  for (const auto &[name, stats] : registry.phases) {
+    writer.Key(name)
+        .StartDict()
+        .Key("allocations")
+        .RawValue(count(stats.allocations))
+        .Key("calls")
+        .RawValue(count(stats.calls))
+        .Key("max_ms")
+        .Value(ToMilliseconds(stats.max))
+        .Key("total_ms")
+        .Value(ToMilliseconds(stats.total))
+        .EndDict();
+  }
+  writer.EndDict().EndDict();
+  out << std::endl;
+}
+
+} // namespace profile
+
+// Replaced global allocation functions count allocations while
+// instrumentation is enabled; array and nothrow forms call these by default
+void *operator new(std::size_t size) {
+  if (profile::IsEnabled()) {
+    ++profile::thread_allocations;
+    profile::total_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
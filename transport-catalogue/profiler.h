@@ -0,0 +1,88 @@
+/*!
+ * \file profiler.h
+ * \brief Scoped timers and counters of hot program phases
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+/*!
+ * \brief Instrumentation that is collected only when enabled
+ *
+ * Disabled instrumentation costs a relaxed atomic load per timer, counter or
+ * memory allocation. Enabled one accumulates calls, durations and memory
+ * allocations of named phases plus named counters, all of them thread-safe.
+ */
+namespace profile {
+
+namespace detail {
+inline std::atomic<bool> enabled{false};
+
+void AddTime(std::string_view phase, std::chrono::nanoseconds duration,
+             uint64_t allocations);
+void AddCount(std::string_view counter, uint64_t value);
+} // namespace detail
+
+inline bool IsEnabled() {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+//! Starts or stops collecting, collected data is kept
+void SetEnabled(bool value);
+
+//! Drops everything collected so far
+void Reset();
+
+//! Adds value to named counter, names must outlive the report (literals)
+inline void Count(std::string_view counter, uint64_t value) {
+  if (IsEnabled()) {
+    detail::AddCount(counter, value);
+  }
+}
+
+//! Amount of memory allocations made by calling thread while enabled
+uint64_t GetThreadAllocations();
+
+/*!
+ * Writes collected data as JSON dictionary: "counters" maps names to values,
+ * "phases" maps names to "calls", "total_ms", "max_ms" and "allocations"
+ * (made by the thread that ran the phase). Keys are sorted
+ */
+void WriteReport(std::ostream &out);
+
+/*!
+ * \brief Adds lifetime of the object to named phase, if instrumentation was
+ * enabled at construction
+ */
+class ScopedTimer {
+public:
+  //! \param[in] phase name of phase, must outlive the report (literal)
+  explicit ScopedTimer(std::string_view phase) : phase_{phase} {
+    if (IsEnabled()) {
+      active_ = true;
+      allocations_ = GetThreadAllocations();
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+  ~ScopedTimer() {
+    if (active_) {
+      detail::AddTime(phase_, std::chrono::steady_clock::now() - start_,
+                      GetThreadAllocations() - allocations_);
+    }
+  }
+
+private:
+  std::string_view phase_;
+  bool active_{false};
+  uint64_t allocations_{};
+  std::chrono::steady_clock::time_point start_{};
+};
+
+} // namespace profile
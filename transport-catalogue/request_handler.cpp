@@ -1,84 +1,80 @@
 #include "request_handler.h"
 #include "domain.h"
-#include "json_builder.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <sstream>
 namespace core {
+namespace {
+/*!
+ * Writes Bus answer, value of request_id key is written by \p write_id, so
+ * that precomputed answers may leave it out
+ */
+template <typename WriteId>
+void WriteBusAnswer(json::Writer &writer, const data::BusStats &info,
+                    const WriteId &write_id) {
+  // keys are written in json::Dict (sorted) order
+  writer.StartDict()
+      .Key("curvature")
+      .Value(info.real_length / info.direct_lenght)
+      .Key("request_id");
+  write_id();
+  writer.Key("route_length")
+      .Value(info.real_length)
+      .Key("stop_count")
+      .Value(static_cast<int>(info.total_stops))
+      .Key("unique_stop_count")
+      .Value(static_cast<int>(info.unique_stops.size()))
+      .EndDict();
+}
+
+//! Writes Stop answer, see WriteBusAnswer()
+template <typename WriteId>
+void WriteStopAnswer(json::Writer &writer, const data::StopStats &info,
+                     const WriteId &write_id) {
+  // bus list is formatted by catalogue already
+  writer.StartDict()
+      .Key("buses")
+      .RawValue(writer.IsSingleLine() ? info.buses_json_line : info.buses_json)
+      .Key("request_id");
+  write_id();
+  writer.EndDict();
+}
+} // namespace
+
 void RequestHandler::InsertIntoQueue(ReqsQueue &&elem) {
   reqs_queue_.emplace_back(elem);
 }
 
 void RequestHandler::JsonPrint::operator()(
     const RequestHandler::RequestTypes::PrintBusStats &req) {
+  profile::ScopedTimer timer{"request.Bus"};
   auto bus_info = parent_.catalogue_.GetBusInfo(req.bus_name);
-  if (bus_info) {
-    arr_.emplace_back(
-        json::Builder()
-            .StartDict()
-            .Key("curvature")
-            .Value(bus_info->real_length / bus_info->direct_lenght)
-            .Key("request_id")
-            .Value(req.id)
-            .Key("route_length")
-            .Value(bus_info->real_length)
-            .Key("stop_count")
-            .Value(static_cast<int>(bus_info->total_stops))
-            .Key("unique_stop_count")
-            .Value(static_cast<int>(bus_info->unique_stops.size()))
-            .EndDict()
-            .Build());
-  } else {
-    arr_.emplace_back(json::Builder()
-                          .StartDict()
-                          .Key("request_id")
-                          .Value(req.id)
-                          .Key("error_message")
-                          .Value("not found")
-                          .EndDict()
-                          .Build());
+  if (!bus_info) {
+    PrintNotFound(req.id);
+    return;
   }
+  if (PrintPrecomputed(bus_info->bus_ptr->id, req.id)) {
+    return;
+  }
+  WriteBusAnswer(writer_, *bus_info, [this, &req] { writer_.Value(req.id); });
 }
 
 void RequestHandler::JsonPrint::operator()(
     const RequestHandler::RequestTypes::PrintStopStats &req) {
+  profile::ScopedTimer timer{"request.Stop"};
   auto stop_info = parent_.catalogue_.GetStopInfo(req.stop_name);
-  if (stop_info) {
-    if (stop_info->linked_buses.empty()) {
-      arr_.emplace_back(json::Builder()
-                            .StartDict()
-                            .Key("buses")
-                            .StartArray()
-                            .EndArray()
-                            .Key("request_id")
-                            .Value(req.id)
-                            .EndDict()
-                            .Build());
-    } else {
-      std::vector<data::Bus *> pbus_vec(stop_info->linked_buses.begin(),
-                                        stop_info->linked_buses.end());
-      std::sort(pbus_vec.begin(), pbus_vec.end(),
-                [](auto lhs, auto rhs) { return lhs->name < rhs->name; });
-      json::Array buses;
-      for (auto bus_ptr : pbus_vec) {
-        buses.emplace_back(bus_ptr->name);
-      }
-      arr_.emplace_back(json::Builder()
-                            .StartDict()
-                            .Key("buses")
-                            .Value(std::move(buses))
-                            .Key("request_id")
-                            .Value(req.id)
-                            .EndDict()
-                            .Build());
-    }
-  } else {
-    arr_.emplace_back(json::Builder()
-                          .StartDict()
-                          .Key("request_id")
-                          .Value(req.id)
-                          .Key("error_message")
-                          .Value("not found")
-                          .EndDict()
-                          .Build());
+  if (!stop_info) {
+    PrintNotFound(req.id);
+    return;
+  }
+  if (PrintPrecomputed(parent_.catalogue_.GetAllBusStats().size() +
+                           stop_info->stop_ptr->id,
+                       req.id)) {
+    return;
   }
+  WriteStopAnswer(writer_, *stop_info,
+                  [this, &req] { writer_.Value(req.id); });
 }
 
 void RequestHandler::JsonPrint::operator()(
@@ -88,15 +84,16 @@ void RequestHandler::JsonPrint::operator()(
 
 void RequestHandler::JsonPrint::operator()(
     const RequestHandler::RequestTypes::PrintMap &req) {
-  arr_.emplace_back(
-      json::Builder()
-          .StartDict()
-          .Key("map")
-          .Value(parent_.renderer_.RenderMap(parent_.GetCatalogueData()))
-          .Key("request_id")
-          .Value(req.id)
-          .EndDict()
-          .Build());
+  profile::ScopedTimer timer{"request.Map"};
+  const auto map = parent_.renderer_.GetMap(
+      parent_.catalogue_.GetVersion(),
+      [this] { return parent_.GetCatalogueData(); });
+  writer_.StartDict()
+      .Key("map")
+      .Value(*map)
+      .Key("request_id")
+      .Value(req.id)
+      .EndDict();
 }
 
 void RequestHandler::JsonPrint::operator()(
@@ -105,79 +102,230 @@ void RequestHandler::JsonPrint::operator()(
 }
 
 void RequestHandler::JsonPrint::operator()(const RequestTypes::Route &req) {
-  auto answer = parent_.trouter_.FindFastestRoute(req.from, req.to);
-  json::Array items{};
-  if (answer) {
-    for (data::RouteAnswer::Item &item : answer->items) {
-      if (auto b_ptr = std::get_if<data::RouteAnswer::Bus>(&item)) {
-        items.emplace_back(json::Builder()
-                               .StartDict()
-                               .Key("bus")
-                               .Value(std::string{b_ptr->bus->name})
-                               .Key("span_count")
-                               .Value(static_cast<int>(b_ptr->span_count))
-                               .Key("time")
-                               .Value(b_ptr->time)
-                               .Key("type")
-                               .Value("Bus")
-                               .EndDict()
-                               .Build());
-      } else if (auto w_ptr = std::get_if<data::RouteAnswer::Wait>(&item)) {
-        items.emplace_back(json::Builder()
-                               .StartDict()
-                               .Key("stop_name")
-                               .Value(std::string{w_ptr->stop->name})
-                               .Key("time")
-                               .Value(w_ptr->time)
-                               .Key("type")
-                               .Value("Wait")
-                               .EndDict()
-                               .Build());
+  profile::ScopedTimer timer{"request.Route"};
+  auto answer =
+      parent_.trouter_.FindFastestRoute(req.from, req.to, req.walking);
+  if (!answer) {
+    PrintNotFound(req.id);
+    return;
+  }
+  writer_.StartDict().Key("items").StartArray();
+  for (data::RouteAnswer::Item &item : answer->items) {
+    if (auto b_ptr = std::get_if<data::RouteAnswer::Bus>(&item)) {
+      writer_.StartDict()
+          .Key("bus")
+          .Value(b_ptr->bus->name)
+          .Key("span_count")
+          .Value(static_cast<int>(b_ptr->span_count))
+          .Key("time")
+          .Value(b_ptr->time)
+          .Key("type")
+          .Value("Bus")
+          .EndDict();
+    } else if (auto w_ptr = std::get_if<data::RouteAnswer::Wait>(&item)) {
+      writer_.StartDict()
+          .Key("stop_name")
+          .Value(w_ptr->stop->name)
+          .Key("time")
+          .Value(w_ptr->time)
+          .Key("type")
+          .Value("Wait")
+          .EndDict();
+    } else if (auto walk_ptr = std::get_if<data::RouteAnswer::Walk>(&item)) {
+      // route end point has no name, so its key is omitted
+      writer_.StartDict();
+      if (walk_ptr->from) {
+        writer_.Key("from").Value(walk_ptr->from->name);
       }
+      writer_.Key("time").Value(walk_ptr->time);
+      if (walk_ptr->to) {
+        writer_.Key("to").Value(walk_ptr->to->name);
+      }
+      writer_.Key("type").Value("Walk").EndDict();
     }
-    arr_.emplace_back(json::Builder()
-                          .StartDict()
-                          .Key("request_id")
-                          .Value(req.id)
-                          .Key("total_time")
-                          .Value(answer->total_time)
-                          .Key("items")
-                          .Value(std::move(items))
-                          .EndDict()
-                          .Build());
-  } else {
-    arr_.emplace_back(json::Builder()
-                          .StartDict()
-                          .Key("request_id")
-                          .Value(req.id)
-                          .Key("error_message")
-                          .Value("not found")
-                          .EndDict()
-                          .Build());
   }
+  writer_.EndArray()
+      .Key("request_id")
+      .Value(req.id)
+      .Key("total_time")
+      .Value(answer->total_time)
+      .EndDict();
+}
+
+void RequestHandler::JsonPrint::operator()(
+    const RequestTypes::NearestStops &req) {
+  profile::ScopedTimer timer{"request.NearestStops"};
+  writer_.StartDict().Key("request_id").Value(req.id).Key("stops").StartArray();
+  for (const auto &[stop, distance] :
+       parent_.catalogue_.GetNearestStops(req.pos, req.count)) {
+    writer_.StartDict()
+        .Key("distance")
+        .Value(distance)
+        .Key("name")
+        .Value(stop->name)
+        .EndDict();
+  }
+  writer_.EndArray().EndDict();
+}
+
+void RequestHandler::JsonPrint::operator()(
+    const RequestTypes::StopsInBox &req) {
+  profile::ScopedTimer timer{"request.StopsInBox"};
+  auto stops = parent_.catalogue_.GetStopsInBox(req.min, req.max);
+  std::sort(stops.begin(), stops.end(),
+            [](auto lhs, auto rhs) { return lhs->name < rhs->name; });
+  writer_.StartDict().Key("request_id").Value(req.id).Key("stops").StartArray();
+  for (const auto stop : stops) {
+    writer_.Value(stop->name);
+  }
+  writer_.EndArray().EndDict();
+}
+
+void RequestHandler::JsonPrint::PrintNotFound(int id) {
+  writer_.StartDict()
+      .Key("error_message")
+      .Value("not found")
+      .Key("request_id")
+      .Value(id)
+      .EndDict();
+}
+
+bool RequestHandler::JsonPrint::PrintPrecomputed(size_t answer, int id) {
+  const auto *answers = parent_.catalogue_.GetPrecomputedAnswers();
+  if (!answers) {
+    return false;
+  }
+  const std::string_view text{answers->text};
+  const size_t entry = 2 * answer + (writer_.IsSingleLine() ? 1 : 0);
+  const uint32_t begin = answers->offsets[2 * entry];
+  const uint32_t splice = answers->offsets[2 * entry + 1];
+  const uint32_t end = answers->offsets[2 * entry + 2];
+  writer_.RawValue(text.substr(begin, splice - begin), id,
+                   text.substr(splice, end - splice));
+  return true;
 }
 
 void RequestHandler::ProcessAllRequests(input_info::OutputFormat format) {
-  json::Array result;
-  JsonPrint visitor{*this, result};
-  for (const auto &elem : reqs_queue_) {
-    std::visit(visitor, elem);
+  profile::ScopedTimer timer{"process_requests"};
+  // answers are still produced when output is disabled, stream without
+  // buffer discards them
+  std::ostream discard{nullptr};
+  json::Writer writer{
+      format == input_info::OutputFormat::None ? discard : outstream_, 0,
+      format == input_info::OutputFormat::JsonLine};
+  writer.StartArray();
+  if (thread_count_ == 1) {
+    JsonPrint visitor{*this, writer};
+    for (const auto &elem : reqs_queue_) {
+      std::visit(visitor, elem);
+    }
+  } else {
+    ProcessInParallel(writer);
   }
-  if (format != input_info::OutputFormat::None)
-    json::Print(json::Document{result}, outstream_);
+  writer.EndArray();
   Clear();
 }
 
+void RequestHandler::SetThreadCount(size_t count) { thread_count_ = count; }
+
+void RequestHandler::ProcessInParallel(json::Writer &writer) {
+  std::vector<std::string> answers;
+  size_t begin = 0;
+  while (begin < reqs_queue_.size()) {
+    if (IsSettingsUpdate(reqs_queue_[begin])) {
+      std::visit(JsonPrint{*this, writer}, reqs_queue_[begin]);
+      ++begin;
+      continue;
+    }
+    size_t end = begin;
+    bool has_routes = false;
+    while (end < reqs_queue_.size() && end - begin < BATCH_SIZE &&
+           !IsSettingsUpdate(reqs_queue_[end])) {
+      has_routes |=
+          std::holds_alternative<RequestTypes::Route>(reqs_queue_[end]);
+      ++end;
+    }
+    // lazy graph generation must not happen inside of worker threads
+    if (has_routes) {
+      trouter_.PrepareRouting();
+    }
+
+    answers.assign(end - begin, {});
+    parallel::For(end - begin, thread_count_,
+                  [this, begin, &answers, &writer](size_t i) {
+                    // answer is an element of the outermost array
+                    std::ostringstream out;
+                    json::Writer answer_writer{out, 1,
+                                               writer.IsSingleLine()};
+                    std::visit(JsonPrint{*this, answer_writer},
+                               reqs_queue_[begin + i]);
+                    answers[i] = out.str();
+                  });
+    for (const auto &answer : answers) {
+      writer.RawValue(answer);
+    }
+    begin = end;
+  }
+}
+
+bool RequestHandler::IsSettingsUpdate(const ReqsQueue &elem) {
+  return std::holds_alternative<RequestTypes::UpdateMapRenderSettings>(elem) ||
+         std::holds_alternative<RequestTypes::UpdateRoutingSettings>(elem);
+}
+
 void RequestHandler::Clear() { reqs_queue_.clear(); }
 
+data::PrecomputedAnswers RequestHandler::PrecomputeAnswers() const {
+  profile::ScopedTimer timer{"precompute_answers"};
+  data::PrecomputedAnswers answers;
+  std::ostringstream out;
+  answers.offsets.push_back(0);
+  const auto mark = [&out, &answers] {
+    answers.offsets.push_back(static_cast<uint32_t>(out.tellp()));
+  };
+  // answer is written in both layouts as an element of the outermost array,
+  // request_id value is left out and its position is marked instead
+  const auto add = [&out, &mark](const auto &write_answer) {
+    for (const bool single_line : {false, true}) {
+      json::Writer writer{out, 1, single_line};
+      write_answer(writer, [&writer, &mark] {
+        mark();
+        writer.RawValue({});
+      });
+      mark();
+    }
+  };
+  for (const auto &stats : catalogue_.GetAllBusStats()) {
+    add([&stats](json::Writer &writer, const auto &write_id) {
+      WriteBusAnswer(writer, stats, write_id);
+    });
+  }
+  for (const data::Stop *stop : catalogue_.GetAllStops()) {
+    const auto stats = catalogue_.GetStopInfo(stop->name);
+    add([&stats](json::Writer &writer, const auto &write_id) {
+      WriteStopAnswer(writer, *stats, write_id);
+    });
+  }
+  answers.text = out.str();
+  return answers;
+}
+
 data::RoutesData RequestHandler::GetCatalogueData() const {
-  std::unordered_set<const data::Stop *> stops_set;
+  const auto all_stops = catalogue_.GetAllStops();
+  std::vector<bool> is_used(all_stops.size(), false);
   std::vector<const data::BusStats *> buses;
-  for (const auto &[_, stats] : catalogue_.GetBusStatsMap()) {
-    stops_set.insert(stats.unique_stops.begin(), stats.unique_stops.end());
+  for (const auto &stats : catalogue_.GetAllBusStats()) {
+    for (const data::StopId stop : stats.unique_stops) {
+      is_used[stop] = true;
+    }
     buses.push_back(&stats);
   }
-  std::vector<const data::Stop *> stops{stops_set.begin(), stops_set.end()};
+  std::vector<const data::Stop *> stops;
+  for (const data::Stop *stop : all_stops) {
+    if (is_used[stop->id]) {
+      stops.push_back(stop);
+    }
+  }
   return {std::move(stops), std::move(buses)};
 }
 } // namespace core
\ No newline at end of file
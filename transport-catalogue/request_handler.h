@@ -14,6 +14,7 @@
 
 #include "domain.h"
 #include "json.h"
+#include "json_writer.h"
 #include "map_renderer.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
@@ -59,8 +60,22 @@ public:
 
     struct Route {
       int id;
-      std::string_view from;
-      std::string_view to;
+      core::TransportRouter::Place from;
+      core::TransportRouter::Place to;
+      //! Only used when route ends are points
+      core::TransportRouter::Walking walking{};
+    };
+
+    struct NearestStops {
+      int id;
+      geo::Coordinates pos;
+      size_t count;
+    };
+
+    struct StopsInBox {
+      int id;
+      geo::Coordinates min;
+      geo::Coordinates max;
     };
   };
 
@@ -69,7 +84,8 @@ public:
       std::variant<RequestTypes::PrintBusStats, RequestTypes::PrintStopStats,
                    RequestTypes::UpdateMapRenderSettings,
                    RequestTypes::PrintMap, RequestTypes::UpdateRoutingSettings,
-                   RequestTypes::Route>;
+                   RequestTypes::Route, RequestTypes::NearestStops,
+                   RequestTypes::StopsInBox>;
 
   /*!
    * Constructor for the class
@@ -92,10 +108,30 @@ public:
    */
   data::RoutesData GetCatalogueData() const;
 
+  /*!
+   * Formats answers to Bus and Stop requests for every bus and stop of
+   * catalogue, to be stored with database (see
+   * core::TransportCatalogue::SetPrecomputedAnswers()). Once stored, these
+   * requests are answered by inserting request_id into ready text
+   */
+  data::PrecomputedAnswers PrecomputeAnswers() const;
+
+  /*!
+   * Sets amount of threads used to answer requests, 0 means
+   * std::thread::hardware_concurrency(). Answers are printed in request order
+   * regardless of this setting
+   */
+  void SetThreadCount(size_t count);
+  size_t GetThreadCount() const { return thread_count_; }
+
   //! Processes each element from RequestHandler::reqs_queue_
   void ProcessAllRequests(
       input_info::OutputFormat format = input_info::OutputFormat::Json);
 
+  //! Clears RequestHandler::reqs_queue_, e.g. to drop requests of a
+  //! document that failed to be processed
+  void Clear();
+
 private:
   //! Stream to which information will be output
   std::ostream &outstream_;
@@ -105,29 +141,52 @@ private:
   graphics::MapRenderer &renderer_;
   //! Transport router to handle fastest path requests when needed
   core::TransportRouter &trouter_;
+  //! Threads used by ProcessAllRequests(), 1 means sequential processing
+  size_t thread_count_{1};
+  //! Maximum amount of answers kept in memory before being printed when
+  //! processing in parallel
+  static constexpr size_t BATCH_SIZE = 1024;
 
   //! Functor used to respond to RequestHandler::reqs_queue_ requests in JSON
-  //! format
+  //! format, each answer is written as soon as it is ready
   struct JsonPrint {
   public:
-    explicit JsonPrint(RequestHandler &parent, json::Array &arr)
-        : parent_{parent}, arr_{arr} {};
+    explicit JsonPrint(RequestHandler &parent, json::Writer &writer)
+        : parent_{parent}, writer_{writer} {};
     void operator()(const RequestTypes::PrintBusStats &req);
     void operator()(const RequestTypes::PrintStopStats &req);
     void operator()(const RequestTypes::UpdateMapRenderSettings &req);
     void operator()(const RequestTypes::PrintMap &req);
     void operator()(const RequestTypes::UpdateRoutingSettings &req);
     void operator()(const RequestTypes::Route &req);
+    void operator()(const RequestTypes::NearestStops &req);
+    void operator()(const RequestTypes::StopsInBox &req);
 
   private:
     RequestHandler &parent_;
-    json::Array &arr_;
+    json::Writer &writer_;
+
+    void PrintNotFound(int id);
+
+    /*!
+     * Writes precomputed answer in layout of writer_
+     * \param[in] answer bus id, or bus count plus stop id
+     * \return false if answers were not precomputed
+     */
+    bool PrintPrecomputed(size_t answer, int id);
   };
 
   //! Queue with all TransportCatalogue NON-state-changing requests
   std::vector<ReqsQueue> reqs_queue_;
 
-  //! Clears RequestHandler::reqs_queue_
-  void Clear();
+  /*!
+   * Answers requests in batches on thread_count_ threads and prints them in
+   * request order. Settings updates are applied alone, between batches, so
+   * every answer is the same as in sequential processing
+   */
+  void ProcessInParallel(json::Writer &writer);
+
+  static bool IsSettingsUpdate(const ReqsQueue &elem);
+
 };
 } // namespace core
\ No newline at end of file
@@ -6,12 +6,17 @@
 #pragma once
 
 #include "graph.h"
+#include "parallel.h"
+#include "profiler.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <iterator>
+#include <limits>
 #include <optional>
+#include <queue>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
@@ -19,119 +24,393 @@
 
 namespace graph {
 
+/*!
+ * Answers routes from all-pairs table computed by Router beforehand and stored
+ * elsewhere, e.g. in memory-mapped database file. Table is not owned and is
+ * laid out row by row: weights hold infinity for unreachable pairs, prev_edges
+ * hold NO_EDGE if route has no previous edge.
+ */
+template <typename Weight> class RouterView {
+private:
+  using Graph = CsrGraph<Weight>;
+
+public:
+  using RouteInfo = graph::RouteInfo<Weight>;
+  static constexpr uint32_t NO_EDGE = UINT32_MAX;
+
+  RouterView(const Graph &graph, const Weight *weights,
+             const uint32_t *prev_edges)
+      : graph_(graph), weights_(weights), prev_edges_(prev_edges) {}
+
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+  const Weight *GetWeights() const { return weights_; }
+  const uint32_t *GetPrevEdges() const { return prev_edges_; }
+
+private:
+  const Graph &graph_;
+  const Weight *weights_;
+  const uint32_t *prev_edges_;
+};
+
+/*!
+ * Computes single row of all-pairs table (see RouterView) by single-source
+ * Dijkstra's search over binary heap
+ * \param[out] weights,prev_edges rows of graph vertex count items, which are
+ * overwritten
+ */
+template <typename Weight>
+void ComputeRoutesFrom(const CsrGraph<Weight> &graph, VertexId from,
+                       Weight *weights, uint32_t *prev_edges);
+
+template <typename Weight>
+std::optional<typename RouterView<Weight>::RouteInfo>
+RouterView<Weight>::BuildRoute(VertexId from, VertexId to) const {
+  const size_t vertex_count = graph_.GetVertexCount();
+  if (from >= vertex_count || to >= vertex_count) {
+    throw std::out_of_range("Vertex id is out of range");
+  }
+  const Weight *weights_row = weights_ + from * vertex_count;
+  const uint32_t *prev_edges_row = prev_edges_ + from * vertex_count;
+  if (weights_row[to] == std::numeric_limits<Weight>::infinity()) {
+    return std::nullopt;
+  }
+  std::vector<EdgeId> edges;
+  for (uint32_t edge_id = prev_edges_row[to]; edge_id != NO_EDGE;
+       edge_id = prev_edges_row[graph_.GetEdgeSource(edge_id)]) {
+    edges.push_back(edge_id);
+  }
+  std::reverse(edges.begin(), edges.end());
+
+  return RouteInfo{weights_row[to], std::move(edges)};
+}
+
+/*!
+ * All-pairs router: routes between every pair of vertices are precomputed
+ * once (Floyd–Warshall), then each BuildRoute() call only walks predecessors.
+ */
 template <typename Weight> class Router {
 private:
-  using Graph = DirectedWeightedGraph<Weight>;
+  using Graph = CsrGraph<Weight>;
 
 public:
-  explicit Router(const Graph &graph);
+  /*!
+   * Computes all routes with blocked Floyd–Warshall
+   * \param[in] graph finished graph, must outlive router
+   * \param[in] thread_count worker threads used for computation, 0 means
+   * std::thread::hardware_concurrency()
+   */
+  explicit Router(const Graph &graph, size_t thread_count = 0);
 
-  struct RouteInfo {
-    Weight weight;
-    std::vector<EdgeId> edges;
-  };
+  using RouteInfo = graph::RouteInfo<Weight>;
+
+  static constexpr uint32_t NO_EDGE = RouterView<Weight>::NO_EDGE;
 
-  struct RouteInternalData {
-    Weight weight;
-    std::optional<EdgeId> prev_edge;
+  /*!
+   * Row-major V x V table of routes: weight is infinity for unreachable
+   * pairs, prev_edge (last edge of route) is NO_EDGE for empty routes
+   */
+  struct RoutesTable {
+    size_t size;
+    std::vector<Weight> weights;
+    std::vector<uint32_t> prev_edges;
   };
-  using RoutesInternalData =
-      std::vector<std::vector<std::optional<RouteInternalData>>>;
 
-  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+  //! Adopts previously computed routes, no recomputation is performed
+  Router(const Graph &graph, RoutesTable &&table);
 
-  const RoutesInternalData &GetRoutesInternalData() const {
-    return routes_internal_data_;
-  }
+  static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+  /*!
+   * Derives routes from the table of previous version of the graph. Rows
+   * whose routes can't have changed are carried over, the others are
+   * recomputed by single-source searches. Row is carried over if none of its
+   * routes runs along removed edge and no added edge shortens any of them
+   * \param[in] previous routes of previous graph, only read by constructor
+   * \param[in] vertex_ids id of every previous vertex in graph, NO_VERTEX for
+   * removed vertices
+   * \param[in] edge_ids id of every previous edge in graph, NO_EDGE for edges
+   * which were removed or changed
+   */
+  Router(const Graph &graph, const RouterView<Weight> &previous,
+         const std::vector<uint32_t> &vertex_ids,
+         const std::vector<uint32_t> &edge_ids, size_t thread_count = 0);
 
-  Router &SetRouterInternalData(RoutesInternalData &&data) {
-    routes_internal_data_ = std::move(data);
-    return *this;
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const {
+    return RouterView<Weight>(graph_, table_.weights.data(),
+                              table_.prev_edges.data())
+        .BuildRoute(from, to);
   }
 
+  const RoutesTable &GetRoutesTable() const { return table_; }
+
 private:
-  void InitializeRoutesInternalData(const Graph &graph) {
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-      routes_internal_data_[vertex][vertex] =
-          RouteInternalData{ZERO_WEIGHT, std::nullopt};
-      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
-        const auto &edge = graph.GetEdge(edge_id);
-        if (edge.weight < ZERO_WEIGHT) {
-          throw std::domain_error("Edges' weights should be non-negative");
-        }
-        auto &route_internal_data = routes_internal_data_[vertex][edge.to];
-        if (!route_internal_data || route_internal_data->weight > edge.weight) {
-          route_internal_data = RouteInternalData{edge.weight, edge_id};
-        }
+  static constexpr Weight INFINITE_WEIGHT =
+      std::numeric_limits<Weight>::infinity();
+  //! Side of square tile, 64 x 64 weights fit into L1 cache
+  static constexpr size_t BLOCK_SIZE = 64;
+
+  static RoutesTable InitializeRoutesTable(const Graph &graph);
+
+  /*!
+   * Relaxes tile (row_block, col_block) through every vertex of via_block.
+   * Tiles read and written may coincide, which is what the first two phases
+   * of blocked Floyd–Warshall rely on
+   */
+  static void RelaxBlock(RoutesTable &routes, size_t via_block,
+                         size_t row_block, size_t col_block);
+
+  static void ComputeAllPairs(RoutesTable &routes, size_t thread_count);
+
+  /*!
+   * Copies previous row of \p previous_from into row of \p from, unless some
+   * graph change makes it stale (see the constructor)
+   * \return false if row is stale, it is left partially filled then
+   */
+  bool CarryOverRow(const RouterView<Weight> &previous, VertexId previous_from,
+                    VertexId from, const std::vector<uint32_t> &vertex_ids,
+                    const std::vector<uint32_t> &edge_ids,
+                    const std::vector<EdgeId> &added_edges);
+
+  static constexpr Weight ZERO_WEIGHT{};
+  const Graph &graph_;
+  RoutesTable table_;
+};
+
+template <typename Weight>
+void ComputeRoutesFrom(const CsrGraph<Weight> &graph, VertexId from,
+                       Weight *weights, uint32_t *prev_edges) {
+  using QueueItem = std::pair<Weight, VertexId>;
+  const size_t vertex_count = graph.GetVertexCount();
+  std::fill(weights, weights + vertex_count,
+            std::numeric_limits<Weight>::infinity());
+  std::fill(prev_edges, prev_edges + vertex_count, RouterView<Weight>::NO_EDGE);
+  std::vector<bool> settled(vertex_count, false);
+  std::priority_queue<QueueItem, std::vector<QueueItem>,
+                      std::greater<QueueItem>>
+      queue;
+
+  weights[from] = Weight{};
+  queue.emplace(Weight{}, from);
+  while (!queue.empty()) {
+    const auto [weight, vertex] = queue.top();
+    queue.pop();
+    if (settled[vertex]) {
+      continue;
+    }
+    settled[vertex] = true;
+    for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+      const VertexId target = graph.GetEdgeTarget(edge_id);
+      const Weight candidate = weight + graph.GetEdgeWeight(edge_id);
+      if (candidate < weights[target]) {
+        weights[target] = candidate;
+        prev_edges[target] = static_cast<uint32_t>(edge_id);
+        queue.emplace(candidate, target);
       }
     }
   }
+}
+
+template <typename Weight>
+Router<Weight>::Router(const Graph &graph, size_t thread_count)
+    : graph_(graph), table_(InitializeRoutesTable(graph)) {
+  ComputeAllPairs(table_, parallel::GetThreadCount(thread_count));
+}
 
-  void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
-                  const RouteInternalData &route_from,
-                  const RouteInternalData &route_to) {
-    auto &route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-    const Weight candidate_weight = route_from.weight + route_to.weight;
-    if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-      route_relaxing = {candidate_weight, route_to.prev_edge
-                                              ? route_to.prev_edge
-                                              : route_from.prev_edge};
+template <typename Weight>
+typename Router<Weight>::RoutesTable
+Router<Weight>::InitializeRoutesTable(const Graph &graph) {
+  const size_t vertex_count = graph.GetVertexCount();
+  RoutesTable routes{
+      vertex_count,
+      std::vector<Weight>(vertex_count * vertex_count, INFINITE_WEIGHT),
+      std::vector<uint32_t>(vertex_count * vertex_count, NO_EDGE)};
+  for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+    const size_t row = vertex * vertex_count;
+    routes.weights[row + vertex] = ZERO_WEIGHT;
+    for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+      const Weight weight = graph.GetEdgeWeight(edge_id);
+      if (weight < ZERO_WEIGHT) {
+        throw std::domain_error("Edges' weights should be non-negative");
+      }
+      const size_t cell = row + graph.GetEdgeTarget(edge_id);
+      if (routes.weights[cell] > weight) {
+        routes.weights[cell] = weight;
+        routes.prev_edges[cell] = static_cast<uint32_t>(edge_id);
+      }
     }
   }
+  return routes;
+}
+
+template <typename Weight>
+void Router<Weight>::RelaxBlock(RoutesTable &routes, size_t via_block,
+                                size_t row_block, size_t col_block) {
+  const size_t size = routes.size;
+  const size_t via_end = std::min(size, (via_block + 1) * BLOCK_SIZE);
+  const size_t row_end = std::min(size, (row_block + 1) * BLOCK_SIZE);
+  const size_t col_begin = col_block * BLOCK_SIZE;
+  const size_t col_end = std::min(size, col_begin + BLOCK_SIZE);
+  Weight *weights = routes.weights.data();
+  uint32_t *prev_edges = routes.prev_edges.data();
 
-  void RelaxRoutesInternalDataThroughVertex(size_t vertex_count,
-                                            VertexId vertex_through) {
-    for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-      if (const auto &route_from =
-              routes_internal_data_[vertex_from][vertex_through]) {
-        for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-          if (const auto &route_to =
-                  routes_internal_data_[vertex_through][vertex_to]) {
-            RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-          }
+  for (size_t via = via_block * BLOCK_SIZE; via < via_end; ++via) {
+    const Weight *via_weights = weights + via * size;
+    const uint32_t *via_prev_edges = prev_edges + via * size;
+    for (size_t from = row_block * BLOCK_SIZE; from < row_end; ++from) {
+      Weight *from_weights = weights + from * size;
+      uint32_t *from_prev_edges = prev_edges + from * size;
+      const Weight to_via = from_weights[via];
+      if (to_via == INFINITE_WEIGHT) {
+        continue;
+      }
+      const uint32_t to_via_prev_edge = from_prev_edges[via];
+      for (size_t to = col_begin; to < col_end; ++to) {
+        const Weight candidate = to_via + via_weights[to];
+        if (candidate < from_weights[to]) {
+          from_weights[to] = candidate;
+          from_prev_edges[to] = via_prev_edges[to] != NO_EDGE
+                                    ? via_prev_edges[to]
+                                    : to_via_prev_edge;
         }
       }
     }
   }
-
-  static constexpr Weight ZERO_WEIGHT{};
-  const Graph &graph_;
-  RoutesInternalData routes_internal_data_;
-};
+}
 
 template <typename Weight>
-Router<Weight>::Router(const Graph &graph)
-    : graph_(graph),
-      routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(
-                                graph.GetVertexCount())) {
-  InitializeRoutesInternalData(graph);
+void Router<Weight>::ComputeAllPairs(RoutesTable &routes,
+                                     size_t thread_count) {
+  const size_t block_count = (routes.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  for (size_t via = 0; via < block_count; ++via) {
+    // 1: tile on the diagonal depends only on itself
+    RelaxBlock(routes, via, via, via);
+    // 2: tiles in the same block row or column depend on themselves and
+    // on the diagonal tile
+    parallel::For(block_count, thread_count, [&routes, via](size_t other) {
+      if (other != via) {
+        RelaxBlock(routes, via, via, other);
+        RelaxBlock(routes, via, other, via);
+      }
+    });
+    // 3: every other tile depends on tiles finished in phase 2, so block
+    // rows are independent
+    parallel::For(block_count, thread_count,
+                  [&routes, via, block_count](size_t row) {
+                    if (row == via) {
+                      return;
+                    }
+                    for (size_t col = 0; col < block_count; ++col) {
+                      if (col != via) {
+                        RelaxBlock(routes, via, row, col);
+                      }
+                    }
+                  });
+  }
+}
 
-  const size_t vertex_count = graph.GetVertexCount();
-  for (VertexId vertex_through = 0; vertex_through < vertex_count;
-       ++vertex_through) {
-    RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+template <typename Weight>
+Router<Weight>::Router(const Graph &graph, RoutesTable &&table)
+    : graph_(graph), table_(std::move(table)) {
+  const size_t cell_count = graph.GetVertexCount() * graph.GetVertexCount();
+  if (table_.size != graph.GetVertexCount() ||
+      table_.weights.size() != cell_count ||
+      table_.prev_edges.size() != cell_count) {
+    throw std::invalid_argument("Routes table does not match graph vertices");
   }
 }
 
 template <typename Weight>
-std::optional<typename Router<Weight>::RouteInfo>
-Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-  const auto &route_internal_data = routes_internal_data_.at(from).at(to);
-  if (!route_internal_data) {
-    return std::nullopt;
+Router<Weight>::Router(const Graph &graph, const RouterView<Weight> &previous,
+                       const std::vector<uint32_t> &vertex_ids,
+                       const std::vector<uint32_t> &edge_ids,
+                       size_t thread_count)
+    : graph_(graph) {
+  const size_t size = graph.GetVertexCount();
+  table_ = {size, std::vector<Weight>(size * size, INFINITE_WEIGHT),
+            std::vector<uint32_t>(size * size, NO_EDGE)};
+
+  std::vector<bool> is_kept(graph.GetEdgeCount(), false);
+  for (const uint32_t edge_id : edge_ids) {
+    if (edge_id != NO_EDGE) {
+      is_kept.at(edge_id) = true;
+    }
   }
-  const Weight weight = route_internal_data->weight;
-  std::vector<EdgeId> edges;
-  for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge; edge_id;
-       edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]
-                     ->prev_edge) {
-    edges.push_back(*edge_id);
+  std::vector<EdgeId> added_edges;
+  for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+    if (is_kept[edge_id]) {
+      continue;
+    }
+    if (graph.GetEdgeWeight(edge_id) < ZERO_WEIGHT) {
+      throw std::domain_error("Edges' weights should be non-negative");
+    }
+    added_edges.push_back(edge_id);
   }
-  std::reverse(edges.begin(), edges.end());
 
-  return RouteInfo{weight, std::move(edges)};
+  // rows of added vertices have nothing to carry over
+  std::vector<char> is_stale(size, true);
+  thread_count = parallel::GetThreadCount(thread_count);
+  parallel::For(vertex_ids.size(), thread_count, [&](size_t previous_from) {
+    const uint32_t from = vertex_ids[previous_from];
+    if (from != NO_VERTEX) {
+      is_stale.at(from) = !CarryOverRow(previous, previous_from, from,
+                                        vertex_ids, edge_ids, added_edges);
+    }
+  });
+
+  std::vector<VertexId> stale_rows;
+  for (VertexId vertex = 0; vertex < size; ++vertex) {
+    if (is_stale[vertex]) {
+      stale_rows.push_back(vertex);
+    }
+  }
+  profile::Count("routes_rows_recomputed", stale_rows.size());
+  auto recompute_row = [this, &stale_rows](size_t index) {
+    const size_t row = stale_rows[index] * table_.size;
+    ComputeRoutesFrom(graph_, stale_rows[index], table_.weights.data() + row,
+                      table_.prev_edges.data() + row);
+  };
+  parallel::For(stale_rows.size(), thread_count, recompute_row);
+}
+
+template <typename Weight>
+bool Router<Weight>::CarryOverRow(const RouterView<Weight> &previous,
+                                  VertexId previous_from, VertexId from,
+                                  const std::vector<uint32_t> &vertex_ids,
+                                  const std::vector<uint32_t> &edge_ids,
+                                  const std::vector<EdgeId> &added_edges) {
+  const size_t previous_size = vertex_ids.size();
+  const Weight *previous_weights =
+      previous.GetWeights() + previous_from * previous_size;
+  const uint32_t *previous_prev_edges =
+      previous.GetPrevEdges() + previous_from * previous_size;
+  Weight *weights = table_.weights.data() + from * table_.size;
+  uint32_t *prev_edges = table_.prev_edges.data() + from * table_.size;
+
+  for (size_t previous_to = 0; previous_to < previous_size; ++previous_to) {
+    const uint32_t to = vertex_ids[previous_to];
+    const uint32_t prev_edge = previous_prev_edges[previous_to];
+    if (prev_edge != NO_EDGE) {
+      // route tree of the row is formed by its previous edges, so a removed
+      // edge which is not among them is not used by any route
+      if (edge_ids.at(prev_edge) == NO_EDGE) {
+        return false;
+      }
+      weights[to] = previous_weights[previous_to];
+      prev_edges[to] = edge_ids[prev_edge];
+    } else if (to != NO_VERTEX) {
+      weights[to] = previous_weights[previous_to];
+    }
+  }
+  // carried over weights are optimal unless an added edge relaxes them
+  for (const EdgeId edge_id : added_edges) {
+    if (weights[graph_.GetEdgeSource(edge_id)] +
+            graph_.GetEdgeWeight(edge_id) <
+        weights[graph_.GetEdgeTarget(edge_id)]) {
+      return false;
+    }
+  }
+  return true;
 }
 
-} // namespace graph
\ No newline at end of file
+} // namespace graph
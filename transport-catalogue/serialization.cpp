@@ -1,10 +1,11 @@
 #include "serialization.h"
 #include "domain.h"
+#include "profiler.h"
 
 namespace serialization {
 
 void Serializer::SerializeStops(const std::deque<data::Stop> &stops) {
-  size_t counter{0};
+  // stops are written in order of ids, so indexes are ids
   for (const auto &stop : stops) {
     Coordinates sr_coords;
     sr_coords.set_lat(stop.pos.lat);
@@ -13,58 +14,78 @@ void Serializer::SerializeStops(const std::deque<data::Stop> &stops) {
     Stop sr_stop;
     sr_stop.set_name(stop.name);
     *sr_stop.mutable_coordinates() = std::move(sr_coords);
-    stop_to_index_[stop.name] = counter++;
 
     *sr_catalogue_.add_stops() = std::move(sr_stop);
   }
 }
 
 void Serializer::SerializeBuses(const std::deque<data::Bus> &buses) {
-  size_t counter{0};
   for (const auto &bus : buses) {
     Bus sr_bus;
     sr_bus.set_name(bus.name);
     sr_bus.set_is_circular(bus.is_circular);
     for (auto &stop_ptr : bus.stops) {
-      sr_bus.add_stop_indexes(stop_to_index_.at(stop_ptr->name));
+      sr_bus.add_stop_indexes(stop_ptr->id);
     }
-    bus_to_index_[bus.name] = counter++;
 
     *sr_catalogue_.add_buses() = std::move(sr_bus);
   }
 }
 
-void Serializer::SerializeStopStats(const data::StopStorage &stop_stats) {
-  for (const auto &[key, val] : stop_stats) {
+void Serializer::SerializeStopStats(
+    const std::vector<data::StopStats> &stop_stats) {
+  // catalogue keeps buses of stops ordered by name
+  sr_catalogue_.set_linked_buses_by_name(true);
+  for (const auto &val : stop_stats) {
     StopStats sr_stop_stats;
-    sr_stop_stats.set_stop_index(stop_to_index_.at(key));
-    for (const auto &bus : val.linked_buses) {
-      sr_stop_stats.add_linked_buses_indexes(bus_to_index_.at(bus->name));
+    sr_stop_stats.set_stop_index(val.stop_ptr->id);
+    for (const data::BusId bus : val.linked_buses) {
+      sr_stop_stats.add_linked_buses_indexes(bus);
     }
-    for (const auto &stop : val.linked_stops) {
-      sr_stop_stats.add_linked_stops_indexes(
-          stop_to_index_.at(stop.first->name));
-      sr_stop_stats.add_linked_stops_distances(stop.second);
+    for (size_t i = 0; i < val.linked_stops.size(); ++i) {
+      sr_stop_stats.add_linked_stops_indexes(val.linked_stops[i]);
+      sr_stop_stats.add_linked_stops_distances(val.linked_distances[i]);
     }
     *sr_catalogue_.add_stopname_to_stop_stats() = std::move(sr_stop_stats);
   }
 }
 
-void Serializer::SerializeBusStats(const data::BusStorage &bus_stats) {
-  for (const auto &[key, val] : bus_stats) {
+void Serializer::SerializeBusStats(
+    const std::vector<data::BusStats> &bus_stats) {
+  for (const auto &val : bus_stats) {
     BusStats sr_bus_stats;
-    sr_bus_stats.set_bus_index(bus_to_index_.at(key));
+    sr_bus_stats.set_bus_index(val.bus_ptr->id);
     sr_bus_stats.set_direct_length(val.direct_lenght);
     sr_bus_stats.set_real_length(val.real_length);
     sr_bus_stats.set_total_stops(val.total_stops);
-    for (const auto &stop : val.unique_stops) {
-      sr_bus_stats.add_uniq_stops_indexes(stop_to_index_.at(stop->name));
+    for (const data::StopId stop : val.unique_stops) {
+      sr_bus_stats.add_uniq_stops_indexes(stop);
     }
 
     *sr_catalogue_.add_busname_to_bus_stats() = std::move(sr_bus_stats);
   }
 }
 
+void Serializer::SerializeStopIndex(const geo::GridIndex &index) {
+  const auto &grid = index.GetGrid();
+  StopIndex sr_index;
+  sr_index.set_min_lat(grid.min.lat);
+  sr_index.set_min_lng(grid.min.lng);
+  sr_index.set_lat_step(grid.lat_step);
+  sr_index.set_lng_step(grid.lng_step);
+  sr_index.set_rows(grid.rows);
+  sr_index.set_cols(grid.cols);
+  const size_t cell_count = static_cast<size_t>(grid.rows) * grid.cols;
+  sr_index.add_cell_offsets(0);
+  for (size_t cell = 0; cell < cell_count; ++cell) {
+    for (const uint32_t stop : index.GetCell(cell)) {
+      sr_index.add_stop_indexes(stop);
+    }
+    sr_index.add_cell_offsets(sr_index.stop_indexes_size());
+  }
+  *sr_catalogue_.mutable_stop_index() = std::move(sr_index);
+}
+
 void Serializer::SerializeRenderSettings(
     const input_info::RenderSettings &settings) {
   RenderSettings sr_settings;
@@ -92,6 +113,18 @@ void Serializer::SerializeRenderSettings(
   *(sr_catalogue_.mutable_render_settings()) = sr_settings;
 }
 
+void Serializer::SerializePrecomputedAnswers(
+    const data::PrecomputedAnswers &answers) {
+  auto &sr_answers = *sr_catalogue_.mutable_answers();
+  sr_answers.set_text(answers.text);
+  *sr_answers.mutable_offsets() = {answers.offsets.begin(),
+                                   answers.offsets.end()};
+}
+
+void Serializer::SerializeRenderedMap(const std::string &svg) {
+  sr_catalogue_.set_rendered_map(svg);
+}
+
 void Serializer::SerializeVertexIds(
     const std::vector<data::Vertex> &id_to_vertex) {
   for (const auto &vertex : id_to_vertex) {
@@ -102,50 +135,92 @@ void Serializer::SerializeVertexIds(
   }
 }
 
+void Serializer::SerializeRoutingAlgorithm(
+    input_info::RoutingAlgorithm algorithm) {
+  switch (algorithm) {
+  case input_info::RoutingAlgorithm::AllPairs:
+    sr_catalogue_.mutable_router()->set_algorithm(ALL_PAIRS);
+    break;
+  case input_info::RoutingAlgorithm::Dijkstra:
+    sr_catalogue_.mutable_router()->set_algorithm(DIJKSTRA);
+    break;
+  case input_info::RoutingAlgorithm::ContractionHierarchies:
+    sr_catalogue_.mutable_router()->set_algorithm(CONTRACTION_HIERARCHIES);
+    break;
+  case input_info::RoutingAlgorithm::LazyAllPairs:
+    sr_catalogue_.mutable_router()->set_algorithm(LAZY_ALL_PAIRS);
+    break;
+  }
+}
+
+void Serializer::SerializeLazyCacheRows(size_t rows) {
+  sr_catalogue_.mutable_router()->set_lazy_cache_rows(
+      static_cast<uint32_t>(rows));
+}
+
+void Serializer::SerializeRoutingSettings(double bus_wait_time,
+                                          double bus_velocity) {
+  Router &sr_router = *sr_catalogue_.mutable_router();
+  sr_router.set_bus_wait_time(bus_wait_time);
+  sr_router.set_bus_velocity(bus_velocity);
+}
+
 void Serializer::SerializeGraphRouterInternals(
-    const graph::Router<double>::RoutesInternalData &routes_data) {
+    const graph::Router<double>::RoutesTable &routes_table) {
   Router &sr_router = *sr_catalogue_.mutable_router();
-  for (const auto &data_list : routes_data) {
-    RouteInternalDataList sr_data_list;
-    for (const auto &data : data_list) {
-      RouteInternalData sr_data;
-      if (data) {
-        sr_data.set_weight(data->weight);
-      } else {
-        sr_data.set_weight(-1);
-        *(sr_data_list.add_route_data()) = sr_data;
-        continue;
-      }
-      if (data->prev_edge) {
-        sr_data.set_prev_edge(*(data->prev_edge));
-        sr_data.set_has_prev_edge(true);
-      } else {
-        sr_data.clear_prev_edge();
-        sr_data.set_has_prev_edge(false);
-      }
-      *(sr_data_list.add_route_data()) = std::move(sr_data);
-    }
-    *(sr_router.add_routes_data_list()) = std::move(sr_data_list);
+  sr_router.mutable_route_weight()->Reserve(
+      static_cast<int>(routes_table.weights.size()));
+  for (double weight : routes_table.weights) {
+    sr_router.add_route_weight(weight);
+  }
+  sr_router.mutable_route_prev_edge()->Reserve(
+      static_cast<int>(routes_table.prev_edges.size()));
+  for (uint32_t prev_edge : routes_table.prev_edges) {
+    sr_router.add_route_prev_edge(prev_edge);
   }
 }
 
-void Serializer::SerializeGraph(
-    const graph::DirectedWeightedGraph<double> &graph) {
+void Serializer::SerializeGraph(const graph::CsrGraph<double> &graph) {
   Graph &sr_graph = *sr_catalogue_.mutable_router()->mutable_graph();
+  sr_graph.set_vertex_count(graph.GetVertexCount());
   for (size_t i = 0; i < graph.GetEdgeCount(); ++i) {
     *(sr_graph.add_edge()) = SerializeEdge(graph.GetEdge(i));
   }
+}
 
-  for (size_t i = 0; i < graph.GetVertexCount(); ++i) {
-    *(sr_graph.add_incidence_lists()) =
-        SerializeIncidenceLists(graph.GetIncidentEdges(i));
+void Serializer::SerializeContractionHierarchy(
+    const graph::ContractionHierarchy<double> &hierarchy) {
+  ContractionHierarchy &sr_hierarchy =
+      *sr_catalogue_.mutable_router()->mutable_hierarchy();
+  for (size_t rank : hierarchy.GetRanks()) {
+    sr_hierarchy.add_rank(rank);
+  }
+  for (const auto &shortcut : hierarchy.GetShortcuts()) {
+    Shortcut &sr_shortcut = *sr_hierarchy.add_shortcut();
+    sr_shortcut.set_from(shortcut.from);
+    sr_shortcut.set_to(shortcut.to);
+    sr_shortcut.set_weight(shortcut.weight);
+    sr_shortcut.set_first(shortcut.first);
+    sr_shortcut.set_second(shortcut.second);
   }
 }
 
 void Serializer::SerializeToOstream(std::ostream *out) const {
+  profile::ScopedTimer timer{"serialize_proto"};
+  profile::Count("bytes_written", sr_catalogue_.ByteSizeLong());
   sr_catalogue_.SerializeToOstream(out);
 }
 
+void Serializer::SerializeToFlatOstream(std::ostream *out) const {
+  profile::ScopedTimer timer{"serialize_flat"};
+  const auto begin = out->tellp();
+  WriteFlatBase(sr_catalogue_, *out);
+  const auto end = out->tellp();
+  if (begin != -1 && end != -1) {
+    profile::Count("bytes_written", static_cast<uint64_t>(end - begin));
+  }
+}
+
 serialization::Color
 Serializer::SerializeColor(const graphics::svg::Color &color) {
   Color sr_color;
@@ -180,13 +255,4 @@ Edge Serializer::SerializeEdge(const graph::Edge<double> &edge) {
   return sr_edge;
 }
 
-IncidenceList Serializer::SerializeIncidenceLists(
-    graph::DirectedWeightedGraph<double>::IncidentEdgesRange range) {
-  IncidenceList sr_list;
-  for (auto it = range.begin(); it != range.end(); ++it) {
-    sr_list.add_edge_id(*it);
-  }
-  return sr_list;
-}
-
 } // namespace serialization
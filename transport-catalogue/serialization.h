@@ -1,7 +1,10 @@
 #pragma once
 
+#include "contraction_hierarchy.h"
 #include "domain.h"
+#include "flat_base.h"
 #include "graph.h"
+#include "grid_index.h"
 #include "json.h"
 #include "router.h"
 
@@ -16,27 +19,35 @@ class Serializer {
 public:
   void SerializeStops(const std::deque<data::Stop> &stops);
   void SerializeBuses(const std::deque<data::Bus> &buses);
-  void SerializeStopStats(const data::StopStorage &stop_stats);
-  void SerializeBusStats(const data::BusStorage &bus_stats);
+  void SerializeStopStats(const std::vector<data::StopStats> &stop_stats);
+  void SerializeBusStats(const std::vector<data::BusStats> &bus_stats);
+  //! Point indexes of the index must match stops order
+  void SerializeStopIndex(const geo::GridIndex &index);
+  void SerializePrecomputedAnswers(const data::PrecomputedAnswers &answers);
 
   void SerializeRenderSettings(const input_info::RenderSettings &settings);
+  void SerializeRenderedMap(const std::string &svg);
 
   void SerializeVertexIds(const std::vector<data::Vertex> &id_to_vertex);
+  void SerializeRoutingAlgorithm(input_info::RoutingAlgorithm algorithm);
+  void SerializeLazyCacheRows(size_t rows);
+  //! \param[in] bus_velocity in meters per minute
+  void SerializeRoutingSettings(double bus_wait_time, double bus_velocity);
   void SerializeGraphRouterInternals(
-      const graph::Router<double>::RoutesInternalData &routes_data);
-  void SerializeGraph(const graph::DirectedWeightedGraph<double> &graph);
+      const graph::Router<double>::RoutesTable &routes_table);
+  void SerializeGraph(const graph::CsrGraph<double> &graph);
+  void SerializeContractionHierarchy(
+      const graph::ContractionHierarchy<double> &hierarchy);
 
   void SerializeToOstream(std::ostream *out) const;
+  //! Writes the same database in memory-mappable layout (see flat_base.h)
+  void SerializeToFlatOstream(std::ostream *out) const;
 
 private:
   TrCatalogue sr_catalogue_;
-  std::unordered_map<std::string_view, size_t> stop_to_index_;
-  std::unordered_map<std::string_view, size_t> bus_to_index_;
 
   static Color SerializeColor(const graphics::svg::Color &color);
   static Edge SerializeEdge(const graph::Edge<double> &edge);
-  static IncidenceList SerializeIncidenceLists(
-      graph::DirectedWeightedGraph<double>::IncidentEdgesRange range);
 };
 
 } // namespace serialization
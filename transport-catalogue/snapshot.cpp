@@ -0,0 +1,106 @@
+#include "snapshot.h"
+#include "profiler.h"
+#include "request_handler.h"
+
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace core {
+
+std::unique_ptr<serialization::FlatBase>
+ImportBase(const std::string &file, TransportCatalogue &database,
+           graphics::MapRenderer &renderer, TransportRouter &router) {
+  if (serialization::FlatBase::IsFlatFile(file)) {
+    auto base = std::make_unique<serialization::FlatBase>(file);
+    database.ImportDataBase(*base);
+    renderer.ImportRenderSettings(*base);
+    renderer.ImportMap(*base, database.GetVersion());
+    router.ImportState(*base);
+    return base;
+  }
+
+  std::ifstream in(file, std::ios::binary);
+  serialization::TrCatalogue sr_catalogue;
+  if (!in || !sr_catalogue.ParseFromIstream(&in)) {
+    throw std::runtime_error("Can't read database file " + file);
+  }
+
+  database.ImportDataBase(sr_catalogue);
+  renderer.ImportRenderSettings(sr_catalogue);
+  renderer.ImportMap(sr_catalogue, database.GetVersion());
+  router.ImportState(sr_catalogue);
+  return nullptr;
+}
+
+Snapshot::Snapshot(std::string path) : file{std::move(path)} {
+  profile::ScopedTimer timer{"load_snapshot"};
+  flat_base = ImportBase(file, database, renderer, router);
+}
+
+void Snapshot::Warm() {
+  if (!renderer.HasPalette()) {
+    return;
+  }
+  // answers are not printed, handler only collects routes to be drawn
+  std::ostream discard{nullptr};
+  const RequestHandler req_handler{discard, database, renderer, router};
+  renderer.GetMap(database.GetVersion(),
+                  [&req_handler] { return req_handler.GetCatalogueData(); });
+}
+
+SnapshotHolder::~SnapshotHolder() { Wait(); }
+
+std::shared_ptr<Snapshot> SnapshotHolder::Acquire() const {
+  return std::atomic_load(&current_);
+}
+
+void SnapshotHolder::Load(const std::string &file) {
+  Publish(std::make_shared<Snapshot>(file));
+}
+
+bool SnapshotHolder::StartLoading(const std::string &file) {
+  if (loading_.exchange(true)) {
+    return false;
+  }
+  // previous loading thread has finished, but may not be joined yet
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+  loader_ = std::thread([this, file] {
+    try {
+      auto next = std::make_shared<Snapshot>(file);
+      next->Warm();
+      // previous snapshot is destroyed here, unless some reader still
+      // holds it; then the last one of them destroys it
+      Publish(std::move(next));
+    } catch (const std::exception &e) {
+      std::lock_guard guard(error_mutex_);
+      load_error_ = e.what();
+    }
+    loading_ = false;
+  });
+  return true;
+}
+
+bool SnapshotHolder::IsLoading() const { return loading_; }
+
+void SnapshotHolder::Wait() {
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+}
+
+std::optional<std::string> SnapshotHolder::TakeLoadError() {
+  std::lock_guard guard(error_mutex_);
+  return std::exchange(load_error_, std::nullopt);
+}
+
+std::shared_ptr<Snapshot>
+SnapshotHolder::Publish(std::shared_ptr<Snapshot> next) {
+  profile::Count("snapshots_published", 1);
+  return std::atomic_exchange(&current_, std::move(next));
+}
+
+} // namespace core
@@ -0,0 +1,110 @@
+/*!
+ * \file snapshot.h
+ * \brief Loaded databases shared by request processing and replaced at once
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "map_renderer.h"
+#include "serialization.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+namespace core {
+
+/*!
+ * Loads database written by make_base, format is recognized by file signature
+ * \return mapping of flat database file, which has to stay alive while
+ * requests are processed (nullptr for protobuf files)
+ * \throw std::runtime_error if file can't be read
+ */
+std::unique_ptr<serialization::FlatBase>
+ImportBase(const std::string &file, TransportCatalogue &database,
+           graphics::MapRenderer &renderer, TransportRouter &router);
+
+/*!
+ * \brief Everything needed to answer stat requests, loaded from one database
+ * file
+ *
+ * Snapshot is not changed by loading of other databases, so requests keep
+ * using it for as long as they hold the pointer.
+ */
+struct Snapshot {
+  //! \param[in] path database written by make_base or update_base
+  explicit Snapshot(std::string path);
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+
+  /*!
+   * Renders map image unless database file stored one (or settings have no
+   * route colors), so the first "Map" request is answered at once
+   */
+  void Warm();
+
+  std::string file;
+  //! Declared before the objects that read the mapping, so it outlives them
+  std::unique_ptr<serialization::FlatBase> flat_base;
+  TransportCatalogue database{};
+  TransportRouter router{database};
+  graphics::MapRenderer renderer{};
+};
+
+/*!
+ * \brief Holds current Snapshot, replaces it with the one loaded in
+ * background thread
+ *
+ * Readers take current snapshot by a single atomic load and are never blocked
+ * by loading. Published snapshot replaces previous one by a single atomic
+ * exchange, so neither step stalls request processing. Previous snapshot is
+ * destroyed by loading thread, or by its last reader if it is still held.
+ */
+class SnapshotHolder {
+public:
+  SnapshotHolder() = default;
+  SnapshotHolder(const SnapshotHolder &) = delete;
+  SnapshotHolder &operator=(const SnapshotHolder &) = delete;
+  //! Waits for loading in progress
+  ~SnapshotHolder();
+
+  //! Current snapshot, nullptr if none was published yet
+  std::shared_ptr<Snapshot> Acquire() const;
+
+  //! Loads database in calling thread and publishes it
+  void Load(const std::string &file);
+
+  /*!
+   * Loads database in background thread and publishes it once it is ready,
+   * current snapshot is used meanwhile. Failed loading keeps current one
+   * \return false if other loading is in progress (nothing is started)
+   */
+  bool StartLoading(const std::string &file);
+
+  bool IsLoading() const;
+
+  //! Waits for loading in progress, if any
+  void Wait();
+
+  //! Error message of the last failed background loading, which is cleared
+  std::optional<std::string> TakeLoadError();
+
+private:
+  //! Only accessed by atomic operations
+  std::shared_ptr<Snapshot> current_;
+  std::thread loader_;
+  std::atomic<bool> loading_{false};
+  //! Guards load_error_
+  std::mutex error_mutex_;
+  std::optional<std::string> load_error_;
+
+  //! \return previous snapshot
+  std::shared_ptr<Snapshot> Publish(std::shared_ptr<Snapshot> next);
+};
+
+} // namespace core
@@ -1,11 +1,47 @@
 #include "svg.h"
 
+#include <charconv>
+
 namespace graphics::svg {
 
 using namespace std::literals;
 
+// ---------- OutputBuffer ------------------
+
+OutputBuffer &OutputBuffer::operator<<(std::string_view text) {
+  str_.append(text);
+  return *this;
+}
+
+OutputBuffer &OutputBuffer::operator<<(char ch) {
+  str_.push_back(ch);
+  return *this;
+}
+
+OutputBuffer &OutputBuffer::operator<<(double value) {
+  char buffer[32];
+  // general format with precision 6 is printf's %g, which std::ostream uses
+  // by default
+  const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                    std::chars_format::general, 6);
+  str_.append(buffer, result.ptr);
+  return *this;
+}
+
+OutputBuffer &OutputBuffer::operator<<(unsigned value) {
+  char buffer[16];
+  const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  str_.append(buffer, result.ptr);
+  return *this;
+}
+
+OutputBuffer &OutputBuffer::Fill(size_t count, char ch) {
+  str_.append(count, ch);
+  return *this;
+}
+
 void Object::Render(const RenderContext &context) const {
-  context.out << std::endl;
+  context.out << '\n';
   context.RenderIndent();
   RenderObject(context);
 }
@@ -37,6 +73,11 @@ Polyline &Polyline::AddPoint(Point point) {
   return *this;
 }
 
+Polyline &Polyline::ClearPoints() {
+  points_.clear();
+  return *this;
+}
+
 void Polyline::RenderObject(const RenderContext &context) const {
   auto &out = context.out;
   out << R"(<polyline points=")";
@@ -81,8 +122,8 @@ Text &Text::SetFontWeight(std::string font_weight) {
   return *this;
 }
 
-Text &Text::SetData(std::string data) {
-  data_ = std::move(data);
+Text &Text::SetData(std::string_view data) {
+  data_.assign(data);
   return *this;
 }
 
@@ -98,14 +139,14 @@ void Text::RenderObject(const RenderContext &context) const {
     out << R"( font-weight=")" << *font_weight_ << '"';
   RenderAttrs(out);
   out << '>';
-  for (auto ch : data_) {
-    if (SymbolsToReplace.count(ch)) {
-      out << SymbolsToReplace.at(ch);
-    } else {
-      out << ch;
-    }
+  // runs without special symbols are written at once
+  std::string_view rest = data_;
+  for (size_t pos = rest.find_first_of(R"("'<>&)"); pos != rest.npos;
+       pos = rest.find_first_of(R"("'<>&)")) {
+    out << rest.substr(0, pos) << SymbolsToReplace.at(rest[pos]);
+    rest.remove_prefix(pos + 1);
   }
-  out << R"(</text>)";
+  out << rest << R"(</text>)";
 }
 
 // ---------- Document ------------------
@@ -115,41 +156,75 @@ void Document::AddPtr(std::unique_ptr<Object> &&obj) {
 }
 
 void Document::Render(std::ostream &out) const {
-  out << R"(<?xml version="1.0" encoding="UTF-8" ?>)" << '\n'
-      << R"(<svg xmlns="http://www.w3.org/2000/svg" version="1.1">)";
+  std::string str;
+  DocumentWriter writer{str};
   for (auto &obj : objects_) {
-    obj->Render(RenderContext{out}.Indented());
+    writer.Add(*obj);
   }
-  out << '\n' << R"(</svg>)";
+  writer.Finish();
+  out << str;
 }
 
-std::ostream &operator<<(std::ostream &out, const StrokeLineCap &linecap) {
-  out << svg::LineCapStr.at(linecap);
+// ---------- DocumentWriter ------------------
+
+DocumentWriter::DocumentWriter(std::string &out) : out_{out} {
+  out_ << R"(<?xml version="1.0" encoding="UTF-8" ?>)" << '\n'
+       << R"(<svg xmlns="http://www.w3.org/2000/svg" version="1.1">)";
+}
+
+DocumentWriter &DocumentWriter::Add(const Object &obj) {
+  obj.Render(RenderContext{out_}.Indented());
+  return *this;
+}
+
+void DocumentWriter::Finish() { out_ << '\n' << R"(</svg>)"; }
+
+OutputBuffer &operator<<(OutputBuffer &out, const StrokeLineCap &linecap) {
+  return out << svg::LineCapStr.at(linecap);
+}
+OutputBuffer &operator<<(OutputBuffer &out, const StrokeLineJoin &linejoin) {
+  return out << svg::LineJoinStr.at(linejoin);
+}
+OutputBuffer &operator<<(OutputBuffer &out, const Rgb &rgb) {
+  return out << "rgb(" << unsigned(rgb.red) << ',' << unsigned(rgb.green)
+             << ',' << unsigned(rgb.blue) << ')';
+}
+OutputBuffer &operator<<(OutputBuffer &out, const Rgba &rgba) {
+  return out << "rgba(" << unsigned(rgba.red) << ',' << unsigned(rgba.green)
+             << ',' << unsigned(rgba.blue) << ',' << rgba.opacity << ')';
+}
+OutputBuffer &operator<<(OutputBuffer &out, const Color &color) {
+  std::visit(svg::ColorPrinter{out}, color);
   return out;
 }
+
+namespace {
+//! std::ostream output is formatted by OutputBuffer, so both are the same
+template <typename T>
+std::ostream &PrintToStream(std::ostream &out, const T &value) {
+  std::string str;
+  OutputBuffer buffer{str};
+  buffer << value;
+  return out << str;
+}
+} // namespace
+
+std::ostream &operator<<(std::ostream &out, const StrokeLineCap &linecap) {
+  return PrintToStream(out, linecap);
+}
 std::ostream &operator<<(std::ostream &out, const StrokeLineJoin &linejoin) {
-  out << svg::LineJoinStr.at(linejoin);
-  return out;
+  return PrintToStream(out, linejoin);
 }
 std::ostream &operator<<(std::ostream &out, const Rgb &rgb) {
-  out << "rgb(" << unsigned(rgb.red) << ',' << unsigned(rgb.green) << ','
-      << unsigned(rgb.blue) << ')';
-  return out;
+  return PrintToStream(out, rgb);
 }
 std::ostream &operator<<(std::ostream &out, const Rgba &rgba) {
-  out << "rgba(" << unsigned(rgba.red) << ',' << unsigned(rgba.green) << ','
-      << unsigned(rgba.blue) << ',' << rgba.opacity << ')';
-  return out;
+  return PrintToStream(out, rgba);
 }
 std::ostream &operator<<(std::ostream &out, const Color &color) {
-  std::visit(svg::ColorPrinter{out}, color);
-  return out;
-}
-void RenderContext::RenderIndent() const {
-  for (int i = 0; i < indent; ++i) {
-    out.put(' ');
-  }
+  return PrintToStream(out, color);
 }
+void RenderContext::RenderIndent() const { out.Fill(indent, ' '); }
 RenderContext RenderContext::Indented() const {
   return {out, indent_step, indent + indent_step};
 }
@@ -10,6 +10,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -108,6 +109,38 @@ const std::unordered_map<char, std::string> SymbolsToReplace = {
 using Color = std::variant<std::monostate, std::string, Rgb, Rgba>;
 const Color NoneColor{"none"};
 
+/*!
+ * Appends SVG text to the end of string. Numbers are formatted by
+ * std::to_chars, the result is the same as with default std::ostream
+ * formatting (6 significant digits)
+ */
+class OutputBuffer {
+public:
+  explicit OutputBuffer(std::string &str) : str_{str} {}
+
+  OutputBuffer &operator<<(std::string_view text);
+  OutputBuffer &operator<<(const std::string &text) {
+    return *this << std::string_view{text};
+  }
+  OutputBuffer &operator<<(const char *text) {
+    return *this << std::string_view{text};
+  }
+  OutputBuffer &operator<<(char ch);
+  OutputBuffer &operator<<(double value);
+  OutputBuffer &operator<<(unsigned value);
+  //! Appends \p count copies of \p ch
+  OutputBuffer &Fill(size_t count, char ch);
+
+private:
+  std::string &str_;
+};
+
+OutputBuffer &operator<<(OutputBuffer &out, const StrokeLineCap &linecap);
+OutputBuffer &operator<<(OutputBuffer &out, const StrokeLineJoin &linejoin);
+OutputBuffer &operator<<(OutputBuffer &out, const svg::Rgb &rgb);
+OutputBuffer &operator<<(OutputBuffer &out, const svg::Rgba &rgba);
+OutputBuffer &operator<<(OutputBuffer &out, const svg::Color &color);
+
 std::ostream &operator<<(std::ostream &out, const StrokeLineCap &linecap);
 std::ostream &operator<<(std::ostream &out, const StrokeLineJoin &linejoin);
 std::ostream &operator<<(std::ostream &out, const svg::Rgb &rgb);
@@ -116,14 +149,14 @@ std::ostream &operator<<(std::ostream &out, const svg::Color &color);
 
 //! Used to store and print indentation in render calls
 struct RenderContext {
-  RenderContext(std::ostream &outs) : out(outs) {}
-  RenderContext(std::ostream &outs, int ind_step, int ind = 0)
+  RenderContext(OutputBuffer &outs) : out(outs) {}
+  RenderContext(OutputBuffer &outs, int ind_step, int ind = 0)
       : out(outs), indent_step(ind_step), indent(ind) {}
 
   RenderContext Indented() const;
   void RenderIndent() const;
 
-  std::ostream &out;
+  OutputBuffer &out;
   int indent_step{2};
   int indent{0};
 };
@@ -171,7 +204,7 @@ template <typename OutStream> struct ColorPrinter {
 public:
   explicit ColorPrinter(OutStream &out) : out_{out} {}
   void operator()(std::monostate) { out_ << NoneColor; }
-  void operator()(std::string color) { out_ << color; }
+  void operator()(const std::string &color) { out_ << color; }
   void operator()(svg::Rgb color) { out_ << color; }
   void operator()(svg::Rgba color) { out_ << color; }
 
@@ -192,7 +225,7 @@ public:
 
 protected:
   ~PathProps() = default;
-  void RenderAttrs(std::ostream &out) const;
+  void RenderAttrs(OutputBuffer &out) const;
 
 private:
   std::optional<Color> fill_color_ = std::nullopt;
@@ -227,6 +260,9 @@ private:
 class Polyline final : public Object, public PathProps<Polyline> {
 public:
   Polyline &AddPoint(Point point);
+  //! Removes all points, so the polyline can be reused for another path
+  //! without reallocation
+  Polyline &ClearPoints();
 
 private:
   std::vector<Point> points_;
@@ -244,7 +280,7 @@ public:
   Text &SetFontSize(uint32_t size);
   Text &SetFontFamily(std::string font_family);
   Text &SetFontWeight(std::string font_weight);
-  Text &SetData(std::string data);
+  Text &SetData(std::string_view data);
 
 private:
   Point position_{0, 0};
@@ -267,6 +303,23 @@ public:
   void Render(std::ostream &out) const;
 };
 
+/*!
+ * SVG picture which is written to string as soon as objects are added.
+ * Nothing is stored, so the same object may be modified and added again
+ * instead of creating new ones. Output is the same as Document::Render()
+ */
+class DocumentWriter {
+public:
+  //! Writes SVG header to the end of \p out
+  explicit DocumentWriter(std::string &out);
+  DocumentWriter &Add(const Object &obj);
+  //! Writes closing tag, nothing may be added afterwards
+  void Finish();
+
+private:
+  OutputBuffer out_;
+};
+
 template <typename T> void ObjectContainer::Add(T obj) {
   objects_.emplace_back(std::make_unique<T>(std::move(obj)));
 }
@@ -294,7 +347,7 @@ Owner &PathProps<Owner>::SetStrokeLineJoin(StrokeLineJoin line_join) {
   return AsOwner();
 }
 template <typename Owner>
-void PathProps<Owner>::RenderAttrs(std::ostream &out) const {
+void PathProps<Owner>::RenderAttrs(OutputBuffer &out) const {
   using namespace std::literals;
   if (fill_color_) {
     out << " fill=\""sv << *fill_color_ << "\""sv;
@@ -306,11 +359,10 @@ void PathProps<Owner>::RenderAttrs(std::ostream &out) const {
     out << " stroke-width=\""sv << *stroke_width_ << "\""sv;
   }
   if (stroke_linecap_) {
-    out << " stroke-linecap=\""sv << LineCapStr.at(*stroke_linecap_) << "\""sv;
+    out << " stroke-linecap=\""sv << *stroke_linecap_ << "\""sv;
   }
   if (stroke_linejoin_) {
-    out << " stroke-linejoin=\""sv << LineJoinStr.at(*stroke_linejoin_)
-        << "\""sv;
+    out << " stroke-linejoin=\""sv << *stroke_linejoin_ << "\""sv;
   }
 }
 template <typename Owner> Owner &PathProps<Owner>::AsOwner() {
@@ -1,176 +1,544 @@
 #include "transport_catalogue.h"
 #include "domain.h"
+#include "json_writer.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
 
 namespace core {
+namespace {
+//! Versions are shared by all catalogues, so that results derived from one
+//! catalogue are never taken for results of another
+uint64_t NextVersion() {
+  static std::atomic<uint64_t> last_version{0};
+  return ++last_version;
+}
+
+//! Sorted ids without repeats
+std::vector<data::StopId> ToUniqueIds(std::vector<data::StopId> ids) {
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+/*!
+ * Checks range of flat base section, which is read from the file
+ * \throw std::runtime_error if [begin, end) is not inside of \p size items
+ */
+void CheckFlatRange(uint32_t begin, uint32_t end, size_t size) {
+  if (begin > end || end > size) {
+    throw std::runtime_error("Flat base range is out of section");
+  }
+}
+
+//! Stop answers are dictionaries in array of answers, so their bus lists are
+//! nested at the second level
+constexpr size_t STOP_BUSES_LEVEL = 2;
+} // namespace
+
 void TransportCatalogue::ImportDataBase(
     const serialization::TrCatalogue &sr_catalogue) {
-  std::unordered_map<size_t, data::Stop *> id_to_stop_ptr;
-  std::unordered_map<size_t, data::Bus *> id_to_bus_ptr;
-
-  // Clear previous data
-  stops_.clear();
-  buses_.clear();
-  busname_to_bus_stats_.clear();
-  stopname_to_stop_stats_.clear();
+  profile::ScopedTimer timer{"import_catalogue"};
+  Clear();
 
   // list of stops
-  size_t counter{0};
   for (const auto &sr_stop : sr_catalogue.stops()) {
-    id_to_stop_ptr[counter++] = &stops_.emplace_back(
+    auto &stop = stops_.emplace_back(
         data::Stop()
+            .SetId(static_cast<data::StopId>(stops_.size()))
             .SetStopName(sr_stop.name())
             .SetCoordinates(
                 {sr_stop.coordinates().lat(), sr_stop.coordinates().lng()}));
+    stop_ids_[stop.name] = stop.id;
   }
+  const auto &sr_index = sr_catalogue.stop_index();
+  stop_index_.Restore({{sr_index.min_lat(), sr_index.min_lng()},
+                       sr_index.lat_step(),
+                       sr_index.lng_step(),
+                       sr_index.rows(),
+                       sr_index.cols()},
+                      GetStopPositions(), sr_index.cell_offsets(),
+                      sr_index.stop_indexes());
 
   // list of buses
-  counter = 0;
   for (const auto &sr_bus : sr_catalogue.buses()) {
-    auto &bus = buses_.emplace_back(data::Bus()
-                                        .SetBusName(sr_bus.name())
-                                        .SetCircular(sr_bus.is_circular()));
+    auto &bus = buses_.emplace_back(
+        data::Bus()
+            .SetId(static_cast<data::BusId>(buses_.size()))
+            .SetBusName(sr_bus.name())
+            .SetCircular(sr_bus.is_circular()));
     for (const auto &stop : sr_bus.stop_indexes()) {
-      bus.AddStop(id_to_stop_ptr.at(stop));
+      bus.AddStop(&stops_.at(stop));
     }
-    id_to_bus_ptr[counter++] = &bus;
+    bus_ids_[bus.name] = bus.id;
   }
 
-  // stop stats
+  // linked stops
   for (const auto &sr_stop_stats : sr_catalogue.stopname_to_stop_stats()) {
-    const auto stop_ptr = id_to_stop_ptr.at(sr_stop_stats.stop_index());
-    auto &stop_stats =
-        stopname_to_stop_stats_[stop_ptr->name].SetStop(stop_ptr);
-
-    // linked buses
-    for (const auto &linked_bus_index : sr_stop_stats.linked_buses_indexes()) {
-      const auto linked_bus_ptr = id_to_bus_ptr.at(linked_bus_index);
-      stop_stats.AddLinkedBus(linked_bus_ptr);
-    }
-
-    // linked stops
+    const data::StopId from = stops_.at(sr_stop_stats.stop_index()).id;
     for (int i{0}; i < sr_stop_stats.linked_stops_indexes_size(); ++i) {
-      const auto linked_stop_ptr =
-          id_to_stop_ptr.at(sr_stop_stats.linked_stops_indexes(i));
-      const auto linked_stop_dist = sr_stop_stats.linked_stops_distances(i);
-      stop_stats.SetLinkedStopDistance(linked_stop_ptr, linked_stop_dist);
+      pending_links_.push_back(
+          {from, stops_.at(sr_stop_stats.linked_stops_indexes(i)).id,
+           sr_stop_stats.linked_stops_distances(i)});
     }
   }
+  BuildLinkRows();
+  for (auto &bus : buses_) {
+    ComputeBusDistances(bus);
+  }
 
   // bus stats
+  bus_stats_.resize(buses_.size());
+  for (auto &bus : buses_) {
+    bus_stats_[bus.id].SetBus(&bus);
+  }
   for (const auto &sr_bus_stats : sr_catalogue.busname_to_bus_stats()) {
-    const auto bus_ptr = id_to_bus_ptr.at(sr_bus_stats.bus_index());
-    auto &bus_stats = busname_to_bus_stats_[bus_ptr->name]
-                          .SetBus(bus_ptr)
-                          .SetTotalStops(sr_bus_stats.total_stops())
-                          .SetDirectLength(sr_bus_stats.direct_length())
-                          .SetRealLength(sr_bus_stats.real_length());
-
-    // unique stops
-    std::unordered_set<data::Stop *> uniq_stops;
+    auto &bus = buses_.at(sr_bus_stats.bus_index());
+    std::vector<data::StopId> uniq_stops;
     for (const auto &uniq_stop : sr_bus_stats.uniq_stops_indexes()) {
-      uniq_stops.insert(id_to_stop_ptr.at(uniq_stop));
+      uniq_stops.push_back(stops_.at(uniq_stop).id);
+    }
+    bus_stats_[bus.id]
+        .SetTotalStops(sr_bus_stats.total_stops())
+        .SetUniqueStops(ToUniqueIds(std::move(uniq_stops)))
+        .SetDirectLength(sr_bus_stats.direct_length())
+        .SetRealLength(sr_bus_stats.real_length());
+  }
+
+  // linked buses are stored ordered by name, bases written before that are
+  // restored from unique stops of buses
+  if (sr_catalogue.linked_buses_by_name()) {
+    // stop stats may come in any order
+    adjacency_.bus_offsets.assign(stops_.size() + 1, 0);
+    for (const auto &sr_stop_stats : sr_catalogue.stopname_to_stop_stats()) {
+      adjacency_.bus_offsets.at(sr_stop_stats.stop_index() + 1) =
+          sr_stop_stats.linked_buses_indexes_size();
+    }
+    std::partial_sum(adjacency_.bus_offsets.begin(),
+                     adjacency_.bus_offsets.end(),
+                     adjacency_.bus_offsets.begin());
+    adjacency_.buses.resize(adjacency_.bus_offsets.back());
+    for (const auto &sr_stop_stats : sr_catalogue.stopname_to_stop_stats()) {
+      uint32_t next = adjacency_.bus_offsets[sr_stop_stats.stop_index()];
+      for (const auto &bus : sr_stop_stats.linked_buses_indexes()) {
+        adjacency_.buses[next++] = buses_.at(bus).id;
+      }
+    }
+  } else {
+    BuildBusRows();
+  }
+  BuildBusListsJson();
+  adjacency_ready_ = true;
+
+  if (sr_catalogue.has_answers()) {
+    const auto &sr_answers = sr_catalogue.answers();
+    SetPrecomputedAnswers(
+        {sr_answers.text(),
+         {sr_answers.offsets().begin(), sr_answers.offsets().end()}});
+  }
+}
+
+void TransportCatalogue::ImportDataBase(const serialization::FlatBase &base) {
+  profile::ScopedTimer timer{"import_catalogue"};
+  using serialization::flat::Section;
+  Clear();
+
+  const auto flat_stops = base.GetSection<serialization::flat::Stop>(
+      Section::Stops);
+  const auto flat_buses = base.GetSection<serialization::flat::Bus>(
+      Section::Buses);
+  const auto bus_stops = base.GetSection<uint32_t>(Section::BusStops);
+  const auto unique_stops = base.GetSection<uint32_t>(Section::UniqueStops);
+  const auto linked_stops =
+      base.GetSection<serialization::flat::Link>(Section::LinkedStops);
+  const auto linked_buses = base.GetSection<uint32_t>(Section::LinkedBuses);
+
+  // indexes in the file match ids
+  stop_ids_.reserve(flat_stops.size());
+  for (const auto &flat_stop : flat_stops) {
+    auto &stop = stops_.emplace_back(
+        data::Stop()
+            .SetId(static_cast<data::StopId>(stops_.size()))
+            .SetStopName(base.GetString(flat_stop.name_offset,
+                                        flat_stop.name_size))
+            .SetCoordinates({flat_stop.lat, flat_stop.lng}));
+    stop_ids_[stop.name] = stop.id;
+  }
+  const auto grid = base.GetSection<serialization::flat::Grid>(
+      Section::StopGrid);
+  if (grid.size() != 1) {
+    throw std::runtime_error("Flat base has no stop grid");
+  }
+  stop_index_.Restore({{grid[0].min_lat, grid[0].min_lng},
+                       grid[0].lat_step,
+                       grid[0].lng_step,
+                       grid[0].rows,
+                       grid[0].cols},
+                      GetStopPositions(),
+                      base.GetSection<uint32_t>(Section::StopCells),
+                      base.GetSection<uint32_t>(Section::CellStops));
+  bus_ids_.reserve(flat_buses.size());
+  for (const auto &flat_bus : flat_buses) {
+    auto &bus = buses_.emplace_back(
+        data::Bus()
+            .SetId(static_cast<data::BusId>(buses_.size()))
+            .SetBusName(base.GetString(flat_bus.name_offset,
+                                       flat_bus.name_size))
+            .SetCircular(flat_bus.is_circular));
+    CheckFlatRange(flat_bus.stops_begin, flat_bus.stops_end, bus_stops.size());
+    CheckFlatRange(flat_bus.unique_begin, flat_bus.unique_end,
+                   unique_stops.size());
+    bus.stops.reserve(flat_bus.stops_end - flat_bus.stops_begin);
+    for (uint32_t i = flat_bus.stops_begin; i < flat_bus.stops_end; ++i) {
+      bus.AddStop(&stops_.at(bus_stops[i]));
+    }
+    bus_ids_[bus.name] = bus.id;
+  }
+
+  // links are laid out by stop already, merging only sorts them
+  pending_links_.reserve(linked_stops.size());
+  for (size_t index = 0; index < stops_.size(); ++index) {
+    const auto &flat_stop = flat_stops[index];
+    CheckFlatRange(flat_stop.links_begin, flat_stop.links_end,
+                   linked_stops.size());
+    for (uint32_t i = flat_stop.links_begin; i < flat_stop.links_end; ++i) {
+      pending_links_.push_back({static_cast<data::StopId>(index),
+                                stops_.at(linked_stops[i].stop).id,
+                                linked_stops[i].distance});
+    }
+  }
+  BuildLinkRows();
+  for (auto &bus : buses_) {
+    ComputeBusDistances(bus);
+  }
+
+  bus_stats_.reserve(buses_.size());
+  for (size_t index = 0; index < buses_.size(); ++index) {
+    const auto &flat_bus = flat_buses[index];
+    std::vector<data::StopId> uniq_stops;
+    uniq_stops.reserve(flat_bus.unique_end - flat_bus.unique_begin);
+    for (uint32_t i = flat_bus.unique_begin; i < flat_bus.unique_end; ++i) {
+      uniq_stops.push_back(stops_.at(unique_stops[i]).id);
+    }
+    bus_stats_.emplace_back()
+        .SetBus(&buses_[index])
+        .SetTotalStops(flat_bus.total_stops)
+        .SetUniqueStops(ToUniqueIds(std::move(uniq_stops)))
+        .SetDirectLength(flat_bus.direct_length)
+        .SetRealLength(flat_bus.real_length);
+  }
+
+  // linked buses are laid out by stop and ordered by name already
+  adjacency_.bus_offsets.reserve(stops_.size() + 1);
+  adjacency_.bus_offsets.push_back(0);
+  adjacency_.buses.reserve(linked_buses.size());
+  for (const auto &flat_stop : flat_stops) {
+    CheckFlatRange(flat_stop.buses_begin, flat_stop.buses_end,
+                   linked_buses.size());
+    for (uint32_t i = flat_stop.buses_begin; i < flat_stop.buses_end; ++i) {
+      adjacency_.buses.push_back(buses_.at(linked_buses[i]).id);
     }
-    bus_stats.SetUniqueStops(std::move(uniq_stops));
+    adjacency_.bus_offsets.push_back(
+        static_cast<uint32_t>(adjacency_.buses.size()));
+  }
+  BuildBusListsJson();
+  adjacency_ready_ = true;
+
+  const auto answer_offsets = base.GetSection<uint32_t>(Section::AnswerOffsets);
+  if (!answer_offsets.empty()) {
+    const auto answer_text = base.GetSection<char>(Section::AnswerText);
+    SetPrecomputedAnswers({{answer_text.begin(), answer_text.end()},
+                           {answer_offsets.begin(), answer_offsets.end()}});
   }
 }
 
 void TransportCatalogue::ExportDataBase(serialization::Serializer &sr) {
+  UpdateAdjacency();
+  std::vector<data::StopStats> stop_stats;
+  stop_stats.reserve(stops_.size());
+  for (const auto &stop : stops_) {
+    stop_stats.push_back(GetStopStats(stop.id));
+  }
   sr.SerializeStops(stops_);
   sr.SerializeBuses(buses_);
-  sr.SerializeStopStats(stopname_to_stop_stats_);
-  sr.SerializeBusStats(busname_to_bus_stats_);
+  sr.SerializeStopStats(stop_stats);
+  sr.SerializeBusStats(bus_stats_);
+  sr.SerializeStopIndex(stop_index_);
+  if (answers_) {
+    sr.SerializePrecomputedAnswers(*answers_);
+  }
 }
 
 void TransportCatalogue::AddStop(const input_info::Stop &new_stop) {
+  version_ = NextVersion();
+  adjacency_ready_ = false;
+  answers_.reset();
   auto &stop = stops_.emplace_back(
-      data::Stop().SetStopName(new_stop.name).SetCoordinates(new_stop.pos));
-  /* Linked buses and stops are initialized empty, since not every stop
-   * was added to storage at this point of time, can't generate pointers to
-   * structures
-   */
-  stopname_to_stop_stats_[stop.name] = data::StopStats().SetStop(&stop);
+      data::Stop()
+          .SetId(static_cast<data::StopId>(stops_.size()))
+          .SetStopName(new_stop.name)
+          .SetCoordinates(new_stop.pos));
+  stop_index_.Add(stop.pos);
+  stop_ids_[stop.name] = stop.id;
 }
 
 void TransportCatalogue::AddBus(const input_info::Bus &new_bus) {
+  version_ = NextVersion();
+  adjacency_ready_ = false;
+  answers_.reset();
+  // insertion is not concurrent with anything, so links are merged without
+  // locking
+  BuildLinkRows();
   double total_dir_dist{}, total_real_dist{};
-  std::unordered_set<data::Stop *> uniq_stops{};
 
   auto &bus = buses_.emplace_back(
-      data::Bus().SetBusName(new_bus.name).SetCircular(new_bus.is_circular));
+      data::Bus()
+          .SetId(static_cast<data::BusId>(buses_.size()))
+          .SetBusName(new_bus.name)
+          .SetCircular(new_bus.is_circular));
+  bus_ids_[bus.name] = bus.id;
+  std::vector<data::StopId> uniq_stops;
+  uniq_stops.reserve(new_bus.stops.size());
 
   if (!new_bus.stops.empty()) {
-    auto first_stop_name = new_bus.stops.front();
-    stopname_to_stop_stats_.at(first_stop_name).AddLinkedBus(&bus);
-
-    data::Stop *first_stop_ptr =
-        stopname_to_stop_stats_.at(first_stop_name).stop_ptr;
-    bus.AddStop(first_stop_ptr);
-    uniq_stops.insert(first_stop_ptr);
-
-    for (auto it = next(new_bus.stops.begin()), end = new_bus.stops.end();
-         it != end; ++it) {
-      data::StopStats &prev_stop = stopname_to_stop_stats_.at(*prev(it));
-      data::StopStats &curr_stop = stopname_to_stop_stats_.at(*it);
-      double direct_dist = ComputeStopsDirectDist(prev_stop, curr_stop);
-      double real_dist = GetStopsRealDist(prev_stop, curr_stop);
+    // direct distances of all segments are computed at once from cached
+    // unit vectors of stops
+    geo::PointSet path;
+    path.Reserve(new_bus.stops.size());
+    for (const std::string_view stop_name : new_bus.stops) {
+      data::Stop &stop = stops_[stop_ids_.at(stop_name)];
+      bus.AddStop(&stop);
+      uniq_stops.push_back(stop.id);
+      path.AddFrom(stop_index_.GetPoints(), stop.id);
+    }
+    std::vector<double> direct_dists;
+    geo::ComputePathDistances(path, direct_dists);
 
-      bus.AddStop(curr_stop.stop_ptr);
-      uniq_stops.insert(curr_stop.stop_ptr);
-      curr_stop.AddLinkedBus(&bus);
+    for (size_t i = 1; i < bus.stops.size(); ++i) {
+      const data::StopId prev_stop = bus.stops[i - 1]->id;
+      const data::StopId curr_stop = bus.stops[i]->id;
+      double direct_dist = direct_dists[i - 1];
+      double real_dist = GetRoadDistance(prev_stop, curr_stop);
 
       if (!new_bus.is_circular) {
         direct_dist *= 2;
-        real_dist += GetStopsRealDist(curr_stop, prev_stop);
+        real_dist += GetRoadDistance(curr_stop, prev_stop);
       }
 
       total_dir_dist += direct_dist;
       total_real_dist += real_dist;
     }
   }
-  busname_to_bus_stats_[bus.name] =
-      data::BusStats()
-          .SetBus(&bus)
-          .SetTotalStops(GetBusTotalStopsAmount(bus))
-          .SetUniqueStops(std::move(uniq_stops))
-          .SetDirectLength(total_dir_dist)
-          .SetRealLength(total_real_dist);
+  ComputeBusDistances(bus);
+  bus_stats_.emplace_back()
+      .SetBus(&bus)
+      .SetTotalStops(GetBusTotalStopsAmount(bus))
+      .SetUniqueStops(ToUniqueIds(std::move(uniq_stops)))
+      .SetDirectLength(total_dir_dist)
+      .SetRealLength(total_real_dist);
 }
 
 void TransportCatalogue::AddStopLinks(const input_info::StopLink &new_links) {
-  auto &from_stop = stopname_to_stop_stats_.at(new_links.stop_name);
+  version_ = NextVersion();
+  adjacency_ready_ = false;
+  answers_.reset();
+  const data::StopId from = stop_ids_.at(new_links.stop_name);
   for (auto [stop_name, dist] : new_links.neighbours) {
-    data::Stop *to_stop = stopname_to_stop_stats_.at(stop_name).stop_ptr;
-    from_stop.SetLinkedStopDistance(to_stop, dist);
+    pending_links_.push_back({from, stop_ids_.at(stop_name), dist});
   }
 }
 
 const data::BusStats *
 TransportCatalogue::GetBusInfo(std::string_view bus_name) const {
-  if (busname_to_bus_stats_.count(bus_name)) {
-    return &busname_to_bus_stats_.at(bus_name);
+  const auto it = bus_ids_.find(bus_name);
+  if (it == bus_ids_.end()) {
+    return nullptr;
   }
-  return nullptr;
+  return &bus_stats_[it->second];
 }
 
-const data::StopStats *
+std::optional<data::StopStats>
 TransportCatalogue::GetStopInfo(std::string_view stop_name) const {
-  if (stopname_to_stop_stats_.count(stop_name)) {
-    return &stopname_to_stop_stats_.at(stop_name);
+  const auto it = stop_ids_.find(stop_name);
+  if (it == stop_ids_.end()) {
+    return std::nullopt;
   }
-  return nullptr;
+  UpdateAdjacency();
+  return GetStopStats(it->second);
 }
 
-double TransportCatalogue::ComputeStopsDirectDist(const data::StopStats &from,
-                                                  const data::StopStats &to) {
-  return ComputeDistance(from.stop_ptr->pos, to.stop_ptr->pos);
+void TransportCatalogue::Clear() {
+  version_ = NextVersion();
+  answers_.reset();
+  stops_.clear();
+  buses_.clear();
+  bus_stats_.clear();
+  stop_ids_.clear();
+  bus_ids_.clear();
+  adjacency_ = {};
+  pending_links_.clear();
+  adjacency_ready_ = false;
 }
 
-double TransportCatalogue::GetStopsRealDist(const data::StopStats &from,
-                                            const data::StopStats &to) {
-  if (from.linked_stops.count(to.stop_ptr)) {
-    return from.linked_stops.at(to.stop_ptr);
+void TransportCatalogue::UpdateAdjacency() const {
+  if (adjacency_ready_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard guard(adjacency_mutex_);
+  if (adjacency_ready_.load(std::memory_order_relaxed)) {
+    return;
   }
-  return to.linked_stops.at(from.stop_ptr);
+  BuildLinkRows();
+  BuildBusRows();
+  BuildBusListsJson();
+  adjacency_ready_.store(true, std::memory_order_release);
+}
+
+void TransportCatalogue::BuildLinkRows() const {
+  // rows also have to be added for stops that have no links yet
+  if (pending_links_.empty() &&
+      adjacency_.link_offsets.size() == stops_.size() + 1) {
+    return;
+  }
+  std::vector<PendingLink> links;
+  links.reserve(adjacency_.link_stops.size() + pending_links_.size());
+  for (size_t stop = 0; stop + 1 < adjacency_.link_offsets.size(); ++stop) {
+    for (uint32_t i = adjacency_.link_offsets[stop];
+         i < adjacency_.link_offsets[stop + 1]; ++i) {
+      links.push_back({static_cast<data::StopId>(stop),
+                       adjacency_.link_stops[i],
+                       adjacency_.link_distances[i]});
+    }
+  }
+  links.insert(links.end(), pending_links_.begin(), pending_links_.end());
+  pending_links_.clear();
+  // stable sort keeps order of addition among repeated links, the last of
+  // them wins
+  std::stable_sort(links.begin(), links.end(),
+                   [](const PendingLink &lhs, const PendingLink &rhs) {
+                     return std::tie(lhs.from, lhs.to) <
+                            std::tie(rhs.from, rhs.to);
+                   });
+
+  adjacency_.link_offsets.assign(stops_.size() + 1, 0);
+  adjacency_.link_stops.clear();
+  adjacency_.link_distances.clear();
+  for (size_t i = 0; i < links.size(); ++i) {
+    if (i + 1 < links.size() && links[i].from == links[i + 1].from &&
+        links[i].to == links[i + 1].to) {
+      continue;
+    }
+    ++adjacency_.link_offsets[links[i].from + 1];
+    adjacency_.link_stops.push_back(links[i].to);
+    adjacency_.link_distances.push_back(links[i].distance);
+  }
+  std::partial_sum(adjacency_.link_offsets.begin(),
+                   adjacency_.link_offsets.end(),
+                   adjacency_.link_offsets.begin());
+}
+
+void TransportCatalogue::BuildBusRows() const {
+  adjacency_.bus_offsets.assign(stops_.size() + 1, 0);
+  for (const auto &stats : bus_stats_) {
+    for (const data::StopId stop : stats.unique_stops) {
+      ++adjacency_.bus_offsets[stop + 1];
+    }
+  }
+  std::partial_sum(adjacency_.bus_offsets.begin(),
+                   adjacency_.bus_offsets.end(),
+                   adjacency_.bus_offsets.begin());
+  // buses are sorted by name once and visited in that order, so every row
+  // comes out sorted with no string comparisons per stop
+  std::vector<data::BusId> by_name(buses_.size());
+  std::iota(by_name.begin(), by_name.end(), 0);
+  std::sort(by_name.begin(), by_name.end(),
+            [this](data::BusId lhs, data::BusId rhs) {
+              return buses_[lhs].name < buses_[rhs].name;
+            });
+  adjacency_.buses.resize(adjacency_.bus_offsets.back());
+  std::vector<uint32_t> next(adjacency_.bus_offsets.begin(),
+                             std::prev(adjacency_.bus_offsets.end()));
+  for (const data::BusId bus : by_name) {
+    for (const data::StopId stop : bus_stats_[bus].unique_stops) {
+      adjacency_.buses[next[stop]++] = bus;
+    }
+  }
+}
+
+void TransportCatalogue::BuildBusListsJson() const {
+  std::ostringstream pretty, line;
+  adjacency_.json_offsets.assign(1, 0);
+  adjacency_.json_line_offsets.assign(1, 0);
+  // arrays of all stops are written one after another
+  json::Writer pretty_writer{pretty, STOP_BUSES_LEVEL};
+  json::Writer line_writer{line, 0, true};
+  for (size_t stop = 0; stop < stops_.size(); ++stop) {
+    pretty_writer.StartArray();
+    line_writer.StartArray();
+    for (uint32_t i = adjacency_.bus_offsets[stop];
+         i < adjacency_.bus_offsets[stop + 1]; ++i) {
+      const std::string &name = buses_[adjacency_.buses[i]].name;
+      pretty_writer.Value(name);
+      line_writer.Value(name);
+    }
+    pretty_writer.EndArray();
+    line_writer.EndArray();
+    adjacency_.json_offsets.push_back(static_cast<size_t>(pretty.tellp()));
+    adjacency_.json_line_offsets.push_back(static_cast<size_t>(line.tellp()));
+  }
+  adjacency_.buses_json = pretty.str();
+  adjacency_.buses_json_line = line.str();
+}
+
+data::StopStats TransportCatalogue::GetStopStats(data::StopId id) const {
+  const uint32_t buses_begin = adjacency_.bus_offsets[id];
+  const uint32_t links_begin = adjacency_.link_offsets[id];
+  const size_t links_size = adjacency_.link_offsets[id + 1] - links_begin;
+  const std::string_view json{adjacency_.buses_json};
+  const std::string_view json_line{adjacency_.buses_json_line};
+  return {&stops_[id],
+          {adjacency_.buses.data() + buses_begin,
+           adjacency_.bus_offsets[id + 1] - buses_begin},
+          {adjacency_.link_stops.data() + links_begin, links_size},
+          {adjacency_.link_distances.data() + links_begin, links_size},
+          json.substr(adjacency_.json_offsets[id],
+                      adjacency_.json_offsets[id + 1] -
+                          adjacency_.json_offsets[id]),
+          json_line.substr(adjacency_.json_line_offsets[id],
+                           adjacency_.json_line_offsets[id + 1] -
+                               adjacency_.json_line_offsets[id])};
+}
+
+std::optional<double>
+TransportCatalogue::FindLinkDistance(data::StopId from,
+                                     data::StopId to) const {
+  const auto begin =
+      adjacency_.link_stops.begin() + adjacency_.link_offsets[from];
+  const auto end =
+      adjacency_.link_stops.begin() + adjacency_.link_offsets[from + 1];
+  const auto it = std::lower_bound(begin, end, to);
+  if (it == end || *it != to) {
+    return std::nullopt;
+  }
+  return adjacency_.link_distances[it - adjacency_.link_stops.begin()];
+}
+
+double TransportCatalogue::GetRoadDistance(data::StopId from,
+                                           data::StopId to) const {
+  if (const auto distance = FindLinkDistance(from, to)) {
+    return *distance;
+  }
+  if (const auto distance = FindLinkDistance(to, from)) {
+    return *distance;
+  }
+  throw std::out_of_range("Road distance between stops is unknown");
 }
 
 size_t TransportCatalogue::GetBusTotalStopsAmount(const data::Bus &bus) {
@@ -179,25 +547,60 @@ size_t TransportCatalogue::GetBusTotalStopsAmount(const data::Bus &bus) {
   return bus.is_circular ? bus.stops.size() : bus.stops.size() * 2 - 1;
 }
 
+void TransportCatalogue::ComputeBusDistances(data::Bus &bus) const {
+  const size_t stop_count = bus.stops.size();
+  std::vector<double> forward(stop_count, 0.0), backward;
+  for (size_t i = 1; i < stop_count; ++i) {
+    forward[i] = forward[i - 1] +
+                 GetRoadDistance(bus.stops[i - 1]->id, bus.stops[i]->id);
+  }
+  if (!bus.is_circular && stop_count > 0) {
+    backward.assign(stop_count, 0.0);
+    for (size_t i = stop_count - 1; i > 0; --i) {
+      backward[i - 1] =
+          backward[i] + GetRoadDistance(bus.stops[i]->id, bus.stops[i - 1]->id);
+    }
+  }
+  bus.SetDistances(std::move(forward), std::move(backward));
+}
+
 std::optional<double>
 TransportCatalogue::GetStopsRealDist(const std::string_view from,
                                      const std::string_view to) const {
-  if (stopname_to_stop_stats_.count(from) &&
-      stopname_to_stop_stats_.count(to)) {
-    auto &stop1 = stopname_to_stop_stats_.at(from);
-    auto &stop2 = stopname_to_stop_stats_.at(to);
-    if (stop1.linked_stops.count(stop2.stop_ptr)) {
-      return stop1.linked_stops.at(stop2.stop_ptr);
-    }
-    if (stop2.linked_stops.count(stop1.stop_ptr)) {
-      return stop2.linked_stops.at(stop1.stop_ptr);
-    }
+  const auto from_it = stop_ids_.find(from);
+  const auto to_it = stop_ids_.find(to);
+  if (from_it == stop_ids_.end() || to_it == stop_ids_.end()) {
+    return std::nullopt;
+  }
+  UpdateAdjacency();
+  if (const auto distance = FindLinkDistance(from_it->second, to_it->second)) {
+    return distance;
+  }
+  return FindLinkDistance(to_it->second, from_it->second);
+}
+
+uint64_t TransportCatalogue::GetVersion() const { return version_; }
+
+void TransportCatalogue::SetPrecomputedAnswers(
+    data::PrecomputedAnswers answers) {
+  // every bus and stop has an answer in both layouts
+  const size_t expected = 2 * (buses_.size() + stops_.size());
+  if (answers.offsets.size() != 2 * expected + 1 ||
+      answers.offsets.back() != answers.text.size()) {
+    throw std::invalid_argument(
+        "Precomputed answers don't match database contents");
   }
-  return std::nullopt;
+  answers_ = std::move(answers);
+}
+
+const data::PrecomputedAnswers *
+TransportCatalogue::GetPrecomputedAnswers() const {
+  return answers_ ? &*answers_ : nullptr;
 }
 
-const data::BusStorage &TransportCatalogue::GetBusStatsMap() const {
-  return busname_to_bus_stats_;
+const std::vector<data::BusStats> &
+TransportCatalogue::GetAllBusStats() const {
+  return bus_stats_;
 }
 
 std::vector<const data::Stop *> TransportCatalogue::GetAllStops() const {
@@ -207,4 +610,40 @@ std::vector<const data::Stop *> TransportCatalogue::GetAllStops() const {
   }
   return result;
 }
-} // namespace core
\ No newline at end of file
+
+std::vector<const data::Bus *> TransportCatalogue::GetAllBuses() const {
+  std::vector<const data::Bus *> result{};
+  for (auto &bus : buses_) {
+    result.emplace_back(&bus);
+  }
+  return result;
+}
+
+std::vector<std::pair<const data::Stop *, double>>
+TransportCatalogue::GetNearestStops(geo::Coordinates pos, size_t count) const {
+  std::vector<std::pair<const data::Stop *, double>> result;
+  for (const auto &[id, distance] : stop_index_.FindNearest(pos, count)) {
+    result.emplace_back(&stops_[id], distance);
+  }
+  return result;
+}
+
+std::vector<const data::Stop *>
+TransportCatalogue::GetStopsInBox(geo::Coordinates min,
+                                  geo::Coordinates max) const {
+  std::vector<const data::Stop *> result;
+  for (const size_t id : stop_index_.FindInBox(min, max)) {
+    result.push_back(&stops_[id]);
+  }
+  return result;
+}
+
+std::vector<geo::Coordinates> TransportCatalogue::GetStopPositions() const {
+  std::vector<geo::Coordinates> result;
+  result.reserve(stops_.size());
+  for (const auto &stop : stops_) {
+    result.push_back(stop.pos);
+  }
+  return result;
+}
+} // namespace core
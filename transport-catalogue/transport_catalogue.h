@@ -4,27 +4,41 @@
  */
 
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <deque>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "domain.h"
 #include "geo.h"
+#include "grid_index.h"
 #include "serialization.h"
 
 namespace core {
-//! Objects of this type act as stops and routes database
+/*!
+ * \brief Objects of this type act as stops and routes database
+ *
+ * Stops and buses are numbered densely in order of addition. Buses passing
+ * stops and road distances between stops are kept in compressed sparse row
+ * arrays indexed by stop id rather than in per-stop hash containers. Buses
+ * of a stop are kept ordered by name, together with JSON array of their
+ * names, so Stop answers need neither sorting nor formatting.
+ */
 class TransportCatalogue {
 public:
   TransportCatalogue() = default;
 
   void ImportDataBase(const serialization::TrCatalogue &sr_catalogue);
 
+  //! Bulk loads stops and buses from memory-mapped flat database
+  void ImportDataBase(const serialization::FlatBase &base);
+
   void ExportDataBase(serialization::Serializer &sr);
 
   void AddStop(const input_info::Stop &new_stop);
@@ -35,28 +49,138 @@ public:
 
   const data::BusStats *GetBusInfo(std::string_view bus_name) const;
 
-  const data::StopStats *GetStopInfo(std::string_view stop_name) const;
+  //! \return stop with its buses and road distances, std::nullopt if there
+  //! is no such stop
+  std::optional<data::StopStats>
+  GetStopInfo(std::string_view stop_name) const;
 
-  const data::BusStorage &GetBusStatsMap() const;
+  //! \return stats of all buses, in order of ids
+  const std::vector<data::BusStats> &GetAllBusStats() const;
 
+  //! \return stops in order of ids
   std::vector<const data::Stop *> GetAllStops() const;
 
+  //! \return buses in order of ids (order of addition)
+  std::vector<const data::Bus *> GetAllBuses() const;
+
+  /*!
+   * \return up to \p count stops closest to \p pos together with
+   * great-circle distances (in meters), closest first
+   */
+  std::vector<std::pair<const data::Stop *, double>>
+  GetNearestStops(geo::Coordinates pos, size_t count) const;
+
+  //! \return stops inside of coordinates box (borders included), in order of
+  //! addition
+  std::vector<const data::Stop *> GetStopsInBox(geo::Coordinates min,
+                                                geo::Coordinates max) const;
+
   std::optional<double> GetStopsRealDist(std::string_view from,
                                          std::string_view to) const;
 
+  /*!
+   * Stores answers precomputed for current contents (see
+   * core::RequestHandler::PrecomputeAnswers()), they are exported with
+   * database and dropped once anything is added
+   * \throw std::invalid_argument if amount of answers doesn't match
+   */
+  void SetPrecomputedAnswers(data::PrecomputedAnswers answers);
+
+  //! \return nullptr unless answers were precomputed for current contents
+  const data::PrecomputedAnswers *GetPrecomputedAnswers() const;
+
+  //! Changes whenever stops, links or buses are added or imported, so
+  //! results derived from database contents can be cached. Once
+  //! anything is added, version is unique among all catalogues
+  uint64_t GetVersion() const;
+
 private:
+  //! Link added after adjacency_ was built
+  struct PendingLink {
+    data::StopId from;
+    data::StopId to;
+    double distance;
+  };
+
+  /*!
+   * Rows of stops in compressed sparse row layout: row of stop i is
+   * [offsets[i], offsets[i + 1]) of the arrays that follow the offsets
+   */
+  struct Adjacency {
+    std::vector<uint32_t> bus_offsets;
+    //! Buses passing stops, ordered by name within a row
+    std::vector<data::BusId> buses;
+    std::vector<uint32_t> link_offsets;
+    //! Stops with known road distances, ordered by id within a row
+    std::vector<data::StopId> link_stops;
+    std::vector<double> link_distances;
+    //! Names of buses rows as JSON arrays (see data::StopStats::buses_json),
+    //! character ranges of rows are given by offsets in the same way
+    std::string buses_json;
+    std::vector<size_t> json_offsets;
+    std::string buses_json_line;
+    std::vector<size_t> json_line_offsets;
+  };
+
+  //! Index is data::Stop::id
   std::deque<data::Stop> stops_;
+  //! Index is data::Bus::id
   std::deque<data::Bus> buses_;
-  data::BusStorage busname_to_bus_stats_;
-  data::StopStorage stopname_to_stop_stats_;
+  //! Index is data::Bus::id
+  std::vector<data::BusStats> bus_stats_;
+  std::unordered_map<std::string_view, data::StopId> stop_ids_;
+  std::unordered_map<std::string_view, data::BusId> bus_ids_;
+  //! Positions of stops_, point indexes are data::Stop::id; its unit vectors
+  //! serve batch distance computations
+  geo::GridIndex stop_index_;
+  uint64_t version_{0};
+  std::optional<data::PrecomputedAnswers> answers_;
+
+  /*!
+   * Built on first query after anything is added, so that bulk insertion
+   * doesn't rebuild it for every stop or bus. adjacency_ready_ is only
+   * cleared by insertion, which is never concurrent with queries, and set
+   * under adjacency_mutex_
+   */
+  mutable Adjacency adjacency_;
+  mutable std::vector<PendingLink> pending_links_;
+  mutable std::atomic<bool> adjacency_ready_{true};
+  mutable std::mutex adjacency_mutex_;
+
+  //! Removes everything before import
+  void Clear();
+
+  //! Builds adjacency_ unless it is up to date, safe to call concurrently
+  void UpdateAdjacency() const;
+
+  //! Merges pending_links_ into rows of adjacency_, later links override
+  //! earlier ones
+  void BuildLinkRows() const;
+
+  //! Fills stop rows of adjacency_ from unique stops of buses
+  void BuildBusRows() const;
+
+  //! Formats JSON arrays of bus names of all stop rows
+  void BuildBusListsJson() const;
+
+  data::StopStats GetStopStats(data::StopId id) const;
+
+  //! Road distance of link rows built so far, std::nullopt if not known
+  std::optional<double> FindLinkDistance(data::StopId from,
+                                         data::StopId to) const;
+
+  //! Road distance from \p from to \p to, or of reverse direction if the
+  //! former is not known
+  //! \throw std::out_of_range if neither direction is known
+  double GetRoadDistance(data::StopId from, data::StopId to) const;
 
-  static double ComputeStopsDirectDist(const data::StopStats &from,
-                                       const data::StopStats &to);
+  static size_t GetBusTotalStopsAmount(const data::Bus &bus);
 
-  static double GetStopsRealDist(const data::StopStats &from,
-                                 const data::StopStats &to);
+  //! Fills prefix sums of road distances, all stop links must be known
+  void ComputeBusDistances(data::Bus &bus) const;
 
-  static size_t GetBusTotalStopsAmount(const data::Bus &bus);
+  //! Coordinates of stops_ in order of ids, used to restore stop_index_
+  std::vector<geo::Coordinates> GetStopPositions() const;
 };
 
 } // namespace core
\ No newline at end of file
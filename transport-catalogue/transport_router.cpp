@@ -1,98 +1,394 @@
 #include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
 
 #include "domain.h"
+#include "profiler.h"
 #include "transport_router.h"
 namespace core {
+namespace {
+//! Identifies graph edge regardless of its id, buses are matched by names
+struct EdgeKey {
+  graph::VertexId from;
+  graph::VertexId to;
+  std::string_view bus;
+  size_t stop_count;
+
+  bool operator==(const EdgeKey &other) const {
+    return from == other.from && to == other.to && bus == other.bus &&
+           stop_count == other.stop_count;
+  }
+};
+
+struct EdgeKeyHasher {
+  size_t operator()(const EdgeKey &key) const {
+    // fields are combined one by one
+    size_t hash = std::hash<std::string_view>{}(key.bus);
+    hash = hash * 37 + key.from;
+    hash = hash * 37 + key.to;
+    return hash * 37 + key.stop_count;
+  }
+};
+} // namespace
+
+const std::unordered_map<std::string_view, input_info::RoutingAlgorithm>
+    TransportRouter::algorithm_names_ = {
+        {"all_pairs", input_info::RoutingAlgorithm::AllPairs},
+        {"dijkstra", input_info::RoutingAlgorithm::Dijkstra},
+        {"contraction_hierarchies",
+         input_info::RoutingAlgorithm::ContractionHierarchies},
+        {"lazy_all_pairs", input_info::RoutingAlgorithm::LazyAllPairs},
+};
+
 TransportRouter::TransportRouter(const core::TransportCatalogue &catalogue)
     : catalogue_{catalogue} {}
 
 void TransportRouter::ExportState(serialization::Serializer &sr) {
   GenerateGraph();
   sr.SerializeVertexIds(id_to_vertex_);
-  sr.SerializeGraphRouterInternals(router_->GetRoutesInternalData());
+  sr.SerializeRoutingAlgorithm(settings_.algorithm);
+  sr.SerializeRoutingSettings(settings_.bus_wait_time, settings_.bus_velocity);
+  if (auto all_pairs = std::get_if<graph::Router<double>>(&router_)) {
+    sr.SerializeGraphRouterInternals(all_pairs->GetRoutesTable());
+  } else if (auto hierarchy =
+                 std::get_if<graph::ContractionHierarchy<double>>(&router_)) {
+    sr.SerializeContractionHierarchy(*hierarchy);
+  } else if (auto lazy = std::get_if<graph::LazyRouter<double>>(&router_)) {
+    sr.SerializeLazyCacheRows(lazy->GetCapacity());
+  }
   sr.SerializeGraph(graph_);
 }
 
 void TransportRouter::ImportState(
     const serialization::TrCatalogue &sr_catalogue) {
+  profile::ScopedTimer timer{"import_router"};
   ImportGraph(sr_catalogue.router().graph());
   ImportRouter(sr_catalogue.router());
   ImportVertexIds(sr_catalogue);
 }
 
+void TransportRouter::ImportState(const serialization::FlatBase &base) {
+  profile::ScopedTimer timer{"import_router"};
+  ImportGraph(base);
+  ImportRouter(base);
+  ImportVertexIds(base);
+}
+
 std::optional<data::RouteAnswer>
 TransportRouter::FindFastestRoute(std::string_view from, std::string_view to) {
   if (!graph_finished_) {
     GenerateGraph();
   }
 
-  data::Vertex vfrom = data::Vertex()
-                           .SetStop(catalogue_.GetStopInfo(from)->stop_ptr)
-                           .SetWait(true),
-               vto = data::Vertex()
-                         .SetStop(catalogue_.GetStopInfo(to)->stop_ptr)
-                         .SetWait(true);
-  auto fastest_path =
-      router_->BuildRoute(vertex_to_id_.at(vfrom), vertex_to_id_.at(vto));
+  const auto from_info = catalogue_.GetStopInfo(from);
+  const auto to_info = catalogue_.GetStopInfo(to);
+  if (!from_info || !to_info) {
+    return std::nullopt;
+  }
+  const data::Vertex vfrom =
+      data::Vertex().SetStop(from_info->stop_ptr).SetWait(true);
+  const data::Vertex vto =
+      data::Vertex().SetStop(to_info->stop_ptr).SetWait(true);
+  auto fastest_path = std::visit(
+      [from_id = vertex_to_id_.at(vfrom), to_id = vertex_to_id_.at(vto)](
+          const auto &router) -> std::optional<graph::RouteInfo<double>> {
+        if constexpr (std::is_same_v<std::decay_t<decltype(router)>,
+                                     std::monostate>) {
+          throw std::logic_error("Routing engine is not initialized");
+        } else {
+          return router.BuildRoute(from_id, to_id);
+        }
+      },
+      router_);
   if (fastest_path) {
     return GenerateAnswer(fastest_path.value());
   }
   return std::nullopt;
 }
 
-void TransportRouter::GenerateGraph() {
+std::optional<data::RouteAnswer>
+TransportRouter::FindFastestRoute(const Place &from, const Place &to,
+                                  const Walking &walking) {
+  const auto from_stop = std::get_if<std::string_view>(&from);
+  const auto to_stop = std::get_if<std::string_view>(&to);
+  if (from_stop && to_stop) {
+    return FindFastestRoute(*from_stop, *to_stop);
+  }
   if (!graph_finished_) {
-    std::vector<const data::Stop *> stops = catalogue_.GetAllStops();
-    std::vector<const data::Bus *> buses;
-    for (const auto &[_, stats] : catalogue_.GetBusStatsMap()) {
-      buses.push_back(stats.bus_ptr);
+    GenerateGraph();
+  }
+
+  const auto sources = GetTerminals(from, walking);
+  const auto targets = GetTerminals(to, walking);
+  auto path = multi_router_->BuildRoute(sources, targets);
+
+  const auto from_point = std::get_if<geo::Coordinates>(&from);
+  const auto to_point = std::get_if<geo::Coordinates>(&to);
+  if (from_point && to_point) {
+    const double walk_time =
+        geo::ComputeDistance(*from_point, *to_point,
+                             geo::DistanceFormula::Haversine) /
+        (walking.velocity * 1000.0 / 60.0);
+    if (!path || walk_time <= path->route.weight) {
+      data::RouteAnswer answer;
+      answer.items.emplace_back(data::RouteAnswer::Walk()
+                                    .SetFrom(nullptr)
+                                    .SetTo(nullptr)
+                                    .SetTime(walk_time));
+      answer.total_time = walk_time;
+      return answer;
     }
+  }
+  if (!path) {
+    return std::nullopt;
+  }
+
+  // walking times are extra weights of the chosen terminals
+  auto terminal_time = [](const auto &terminals, graph::VertexId vertex) {
+    return std::find_if(terminals.begin(), terminals.end(),
+                        [vertex](const auto &terminal) {
+                          return terminal.first == vertex;
+                        })
+        ->second;
+  };
+  data::RouteAnswer answer;
+  if (from_point) {
+    answer.items.emplace_back(
+        data::RouteAnswer::Walk()
+            .SetFrom(nullptr)
+            .SetTo(id_to_vertex_.at(path->source).GetStop())
+            .SetTime(terminal_time(sources, path->source)));
+  }
+  auto ride = GenerateAnswer(path->route);
+  answer.items.insert(answer.items.end(), ride.items.begin(), ride.items.end());
+  if (to_point) {
+    answer.items.emplace_back(
+        data::RouteAnswer::Walk()
+            .SetFrom(id_to_vertex_.at(path->target).GetStop())
+            .SetTo(nullptr)
+            .SetTime(terminal_time(targets, path->target)));
+  }
+  answer.total_time = path->route.weight;
+  return answer;
+}
 
-    graph_ = graph::DirectedWeightedGraph<double>(2 * stops.size());
-    GenerateVertexes(stops);
-    for (auto bus : buses) {
-      InsertAllEdgesIntoGraph(bus);
+std::vector<std::pair<graph::VertexId, double>>
+TransportRouter::GetTerminals(const Place &place,
+                              const Walking &walking) const {
+  auto wait_vertex = [this](const data::Stop *stop) {
+    return vertex_to_id_.at(data::Vertex().SetStop(stop).SetWait(true));
+  };
+  std::vector<std::pair<graph::VertexId, double>> result;
+  if (const auto stop_name = std::get_if<std::string_view>(&place)) {
+    if (const auto stop_info = catalogue_.GetStopInfo(*stop_name)) {
+      result.emplace_back(wait_vertex(stop_info->stop_ptr), 0.0);
     }
-    router_ = std::make_unique<graph::Router<double>>(graph_);
+    return result;
+  }
+  const double velocity = walking.velocity * 1000.0 / 60.0;
+  for (const auto &[stop, distance] : catalogue_.GetNearestStops(
+           std::get<geo::Coordinates>(place), walking.stops_count)) {
+    result.emplace_back(wait_vertex(stop), distance / velocity);
+  }
+  return result;
+}
+
+void TransportRouter::PrepareRouting() { GenerateGraph(); }
+
+void TransportRouter::PrepareRouting(const TransportRouter &previous) {
+  if (graph_finished_) {
+    return;
+  }
+  settings_ = previous.settings_;
+  if (!(settings_.bus_velocity > 0)) {
+    throw std::runtime_error(
+        "Database has no routing settings, it has to be made anew");
+  }
+  {
+    profile::ScopedTimer timer{"generate_graph"};
+    BuildGraph();
+  }
+  const auto previous_routes = previous.GetRoutesTable();
+  if (previous_routes &&
+      settings_.algorithm == input_info::RoutingAlgorithm::AllPairs) {
+    profile::ScopedTimer timer{"build_router"};
+    const std::vector<uint32_t> vertex_ids = MapVertices(previous);
+    router_.emplace<graph::Router<double>>(graph_, *previous_routes,
+                                           vertex_ids,
+                                           MapEdges(previous, vertex_ids));
+  } else {
+    BuildRouter();
+  }
+  multi_router_.emplace(graph_);
+  graph_finished_ = true;
+}
+
+void TransportRouter::GenerateGraph() {
+  if (!graph_finished_) {
+    profile::ScopedTimer timer{"generate_graph"};
+    BuildGraph();
+    BuildRouter();
+    multi_router_.emplace(graph_);
     graph_finished_ = true;
   }
 }
 
-void TransportRouter::GenerateVertexes(std::vector<const data::Stop *> &stops) {
+void TransportRouter::BuildGraph() {
+  std::vector<const data::Stop *> stops = catalogue_.GetAllStops();
+
+  GraphBuilder builder(2 * stops.size());
+  GenerateVertexes(stops);
+  for (auto bus : catalogue_.GetAllBuses()) {
+    InsertAllEdgesIntoGraph(builder, bus);
+  }
+  graph_ = graph::CsrGraph<double>(builder);
+  profile::Count("graph_vertices", graph_.GetVertexCount());
+  profile::Count("graph_edges", graph_.GetEdgeCount());
+}
+
+void TransportRouter::BuildRouter() {
+  profile::ScopedTimer timer{"build_router"};
+  switch (settings_.algorithm) {
+  case input_info::RoutingAlgorithm::AllPairs:
+    router_.emplace<graph::Router<double>>(graph_);
+    break;
+  case input_info::RoutingAlgorithm::Dijkstra:
+    router_.emplace<graph::DijkstraRouter<double>>(graph_);
+    break;
+  case input_info::RoutingAlgorithm::ContractionHierarchies:
+    router_.emplace<graph::ContractionHierarchy<double>>(graph_);
+    break;
+  case input_info::RoutingAlgorithm::LazyAllPairs:
+    router_.emplace<graph::LazyRouter<double>>(graph_,
+                                               settings_.lazy_cache_rows);
+    break;
+  }
+}
+
+std::optional<graph::RouterView<double>>
+TransportRouter::GetRoutesTable() const {
+  if (const auto all_pairs = std::get_if<graph::Router<double>>(&router_)) {
+    const auto &table = all_pairs->GetRoutesTable();
+    return graph::RouterView<double>(graph_, table.weights.data(),
+                                     table.prev_edges.data());
+  }
+  if (const auto view = std::get_if<graph::RouterView<double>>(&router_)) {
+    return *view;
+  }
+  return std::nullopt;
+}
 
+std::vector<uint32_t>
+TransportRouter::MapVertices(const TransportRouter &previous) const {
+  std::vector<uint32_t> result;
+  result.reserve(previous.id_to_vertex_.size());
+  for (const auto &vertex : previous.id_to_vertex_) {
+    const auto stop_info = catalogue_.GetStopInfo(vertex.GetStop()->name);
+    if (!stop_info) {
+      result.push_back(graph::Router<double>::NO_VERTEX);
+      continue;
+    }
+    result.push_back(static_cast<uint32_t>(
+        vertex.GetWaitStatus() ? GetWaitVertexId(stop_info->stop_ptr)
+                               : GetNormalVertexId(stop_info->stop_ptr)));
+  }
+  return result;
+}
+
+std::vector<uint32_t>
+TransportRouter::MapEdges(const TransportRouter &previous,
+                          const std::vector<uint32_t> &vertex_ids) const {
+  std::unordered_map<EdgeKey, graph::EdgeId, EdgeKeyHasher> edge_ids;
+  edge_ids.reserve(graph_.GetEdgeCount());
+  for (graph::EdgeId id = 0; id < graph_.GetEdgeCount(); ++id) {
+    const auto edge = graph_.GetEdge(id);
+    edge_ids.emplace(EdgeKey{edge.from, edge.to, edge.bus->name,
+                             edge.stop_count},
+                     id);
+  }
+
+  const auto &previous_graph = previous.graph_;
+  std::vector<uint32_t> result(previous_graph.GetEdgeCount(),
+                               graph::Router<double>::NO_EDGE);
+  for (graph::EdgeId id = 0; id < previous_graph.GetEdgeCount(); ++id) {
+    const auto edge = previous_graph.GetEdge(id);
+    const uint32_t from = vertex_ids.at(edge.from);
+    const uint32_t to = vertex_ids.at(edge.to);
+    if (from == graph::Router<double>::NO_VERTEX ||
+        to == graph::Router<double>::NO_VERTEX) {
+      continue;
+    }
+    const auto it =
+        edge_ids.find(EdgeKey{from, to, edge.bus->name, edge.stop_count});
+    if (it != edge_ids.end() &&
+        graph_.GetEdgeWeight(it->second) == edge.weight) {
+      result[id] = static_cast<uint32_t>(it->second);
+    }
+  }
+  return result;
+}
+
+void TransportRouter::GenerateVertexes(std::vector<const data::Stop *> &stops) {
+  id_to_vertex_.resize(2 * stops.size());
   for (auto stop : stops) {
     auto wait = data::Vertex().SetStop(stop).SetWait(true);
     auto normal = data::Vertex().SetStop(stop).SetWait(false);
-    vertex_to_id_[wait] = id_to_vertex_.size();
-    id_to_vertex_.push_back(wait);
-    vertex_to_id_[normal] = id_to_vertex_.size();
-    id_to_vertex_.push_back(normal);
+    vertex_to_id_[wait] = GetWaitVertexId(stop);
+    id_to_vertex_.at(GetWaitVertexId(stop)) = wait;
+    vertex_to_id_[normal] = GetNormalVertexId(stop);
+    id_to_vertex_.at(GetNormalVertexId(stop)) = normal;
   }
 }
 
-void TransportRouter::InsertAllEdgesIntoGraph(const data::Bus *bus) {
+void TransportRouter::InsertAllEdgesIntoGraph(GraphBuilder &builder,
+                                              const data::Bus *bus) {
 
   for (auto stop : bus->stops) {
-    auto wait_id = vertex_to_id_.at(data::Vertex().SetStop(stop).SetWait(true));
-    auto norm_id =
-        vertex_to_id_.at(data::Vertex().SetStop(stop).SetWait(false));
-    graph_.AddEdge(Edge()
-                       .SetFromVertex(wait_id)
-                       .SetToVertex(norm_id)
-                       .SetWeight(settings_.bus_wait_time)
-                       .SetBus(bus)
-                       .SetStopCount(0));
-  }
-  InsertEdgesBetweenStops(bus->stops.begin(), bus->stops.end(), bus);
+    builder.AddEdge(Edge()
+                        .SetFromVertex(GetWaitVertexId(stop))
+                        .SetToVertex(GetNormalVertexId(stop))
+                        .SetWeight(settings_.bus_wait_time)
+                        .SetBus(bus)
+                        .SetStopCount(0));
+  }
+  InsertEdgesBetweenStops(builder, bus, false);
   if (bus->is_circular) {
     return;
   } else {
-    InsertEdgesBetweenStops(bus->stops.rbegin(), bus->stops.rend(), bus);
+    InsertEdgesBetweenStops(builder, bus, true);
+  }
+}
+
+void TransportRouter::InsertEdgesBetweenStops(GraphBuilder &builder,
+                                              const data::Bus *bus,
+                                              bool backward) {
+  const auto &stops = bus->stops;
+  const auto &distances =
+      backward ? bus->backward_distances : bus->forward_distances;
+  const size_t stop_count = stops.size();
+  // stops are visited in travel order: position i is stop_count - 1 - i when
+  // travelling backward
+  auto at = [stop_count, backward](size_t i) {
+    return backward ? stop_count - 1 - i : i;
+  };
+  for (size_t i = 0; i < stop_count; ++i) {
+    const size_t norm_id = GetNormalVertexId(stops[at(i)]);
+    const double start = distances[at(i)];
+    for (size_t j = i + 1; j < stop_count; ++j) {
+      builder.AddEdge(
+          Edge()
+              .SetFromVertex(norm_id)
+              .SetToVertex(GetWaitVertexId(stops[at(j)]))
+              .SetWeight((distances[at(j)] - start) / settings_.bus_velocity)
+              .SetBus(bus)
+              .SetStopCount(j - i));
+    }
   }
 }
 
 data::RouteAnswer
-TransportRouter::GenerateAnswer(const graph::Router<double>::RouteInfo &path) {
+TransportRouter::GenerateAnswer(const graph::RouteInfo<double> &path) {
 
   data::RouteAnswer result;
   for (auto edge_id : path.edges) {
@@ -114,59 +410,78 @@ TransportRouter::GenerateAnswer(const graph::Router<double>::RouteInfo &path) {
 }
 
 void TransportRouter::ImportGraph(const serialization::Graph &sr_graph) {
-  using IncList = graph::DirectedWeightedGraph<double>::IncidenceList;
-
-  const auto &bus_stats = catalogue_.GetBusStatsMap();
-  std::vector<Edge> edges;
-  for (int i = 0; i < sr_graph.edge_size(); ++i) {
-    edges.emplace_back(
-        graph::Edge<double>{}
-            .SetFromVertex(sr_graph.edge(i).from())
-            .SetToVertex(sr_graph.edge(i).to())
-            .SetWeight(sr_graph.edge(i).weight())
-            .SetBus(bus_stats.at(sr_graph.edge(i).bus_name()).bus_ptr)
-            .SetStopCount(sr_graph.edge(i).stop_count()));
-  }
-  std::vector<IncList> inc_lists;
-  for (int i = 0; i < sr_graph.incidence_lists_size(); ++i) {
-    IncList inc_list;
-    for (int k = 0; k < sr_graph.incidence_lists(i).edge_id_size(); ++k) {
-      inc_list.emplace_back(sr_graph.incidence_lists(i).edge_id(k));
-    }
-    inc_lists.emplace_back(inc_list);
+  // edges are stored in CSR order, so freezing keeps their ids intact
+  GraphBuilder builder(sr_graph.vertex_count());
+  for (const auto &sr_edge : sr_graph.edge()) {
+    builder.AddEdge(Edge()
+                        .SetFromVertex(sr_edge.from())
+                        .SetToVertex(sr_edge.to())
+                        .SetWeight(sr_edge.weight())
+                        .SetBus(catalogue_.GetBusInfo(sr_edge.bus_name())
+                                    ->bus_ptr)
+                        .SetStopCount(sr_edge.stop_count()));
   }
-  graph_.SetEdges(std::move(edges)).SetIncidenceLists(std::move(inc_lists));
+  graph_ = graph::CsrGraph<double>(builder);
+  multi_router_.emplace(graph_);
   graph_finished_ = true;
 }
 
 void TransportRouter::ImportRouter(const serialization::Router &sr_router) {
-  using RoutesData = graph::Router<double>::RoutesInternalData;
-  using Data = graph::Router<double>::RouteInternalData;
-
-  RoutesData routes_data{};
-  for (int i = 0; i < sr_router.routes_data_list_size(); ++i) {
-    auto &sr_list = sr_router.routes_data_list(i);
-    std::vector<std::optional<Data>> new_list;
-    for (int j = 0; j < sr_list.route_data_size(); ++j) {
-      auto &sr_data = sr_list.route_data(j);
-      if (sr_data.weight() < 0) {
-        new_list.emplace_back(std::nullopt);
-        continue;
-      }
-      Data new_data{};
-      new_data.weight = sr_data.weight();
-      if (sr_data.has_prev_edge()) {
-        new_data.prev_edge =
-            std::make_optional<graph::EdgeId>(sr_data.prev_edge());
-      } else {
-        new_data.prev_edge = std::nullopt;
-      }
-      new_list.emplace_back(new_data);
-    }
-    routes_data.emplace_back(std::move(new_list));
+  using RoutesTable = graph::Router<double>::RoutesTable;
+
+  settings_.algorithm = DeserializeAlgorithm(sr_router.algorithm());
+  settings_.bus_wait_time = sr_router.bus_wait_time();
+  settings_.bus_velocity = sr_router.bus_velocity();
+  if (settings_.algorithm == input_info::RoutingAlgorithm::Dijkstra) {
+    BuildRouter();
+    return;
+  }
+  if (settings_.algorithm == input_info::RoutingAlgorithm::LazyAllPairs) {
+    settings_.lazy_cache_rows = sr_router.lazy_cache_rows();
+    BuildRouter();
+    return;
+  }
+  if (settings_.algorithm ==
+      input_info::RoutingAlgorithm::ContractionHierarchies) {
+    ImportHierarchy(sr_router.hierarchy());
+    return;
+  }
+
+  RoutesTable routes_table{
+      graph_.GetVertexCount(),
+      {sr_router.route_weight().begin(), sr_router.route_weight().end()},
+      {sr_router.route_prev_edge().begin(), sr_router.route_prev_edge().end()}};
+  router_.emplace<graph::Router<double>>(graph_, std::move(routes_table));
+}
+
+void TransportRouter::ImportHierarchy(
+    const serialization::ContractionHierarchy &sr_hierarchy) {
+  using Hierarchy = graph::ContractionHierarchy<double>;
+
+  std::vector<size_t> ranks(sr_hierarchy.rank().begin(),
+                            sr_hierarchy.rank().end());
+  std::vector<Hierarchy::Shortcut> shortcuts;
+  shortcuts.reserve(sr_hierarchy.shortcut_size());
+  for (const auto &sr_shortcut : sr_hierarchy.shortcut()) {
+    shortcuts.push_back({sr_shortcut.from(), sr_shortcut.to(),
+                         sr_shortcut.weight(), sr_shortcut.first(),
+                         sr_shortcut.second()});
+  }
+  router_.emplace<Hierarchy>(graph_, std::move(ranks), std::move(shortcuts));
+}
+
+input_info::RoutingAlgorithm TransportRouter::DeserializeAlgorithm(
+    serialization::RoutingAlgorithm algorithm) {
+  switch (algorithm) {
+  case serialization::DIJKSTRA:
+    return input_info::RoutingAlgorithm::Dijkstra;
+  case serialization::CONTRACTION_HIERARCHIES:
+    return input_info::RoutingAlgorithm::ContractionHierarchies;
+  case serialization::LAZY_ALL_PAIRS:
+    return input_info::RoutingAlgorithm::LazyAllPairs;
+  default:
+    return input_info::RoutingAlgorithm::AllPairs;
   }
-  router_ = std::make_unique<graph::Router<double>>(graph_);
-  router_->SetRouterInternalData(std::move(routes_data));
 }
 
 void TransportRouter::ImportVertexIds(
@@ -186,4 +501,120 @@ void TransportRouter::ImportVertexIds(
     vertex_to_id_[id_to_vertex_[i]] = i;
   }
 }
-} // namespace core
\ No newline at end of file
+
+void TransportRouter::ImportGraph(const serialization::FlatBase &base) {
+  using serialization::flat::Section;
+  auto copy = [&base](Section section) {
+    const auto view = base.GetSection<uint32_t>(section);
+    return std::vector<uint32_t>(view.begin(), view.end());
+  };
+
+  // edge buses are stored as indexes of Section::Buses
+  const auto flat_buses =
+      base.GetSection<serialization::flat::Bus>(Section::Buses);
+  std::vector<const data::Bus *> bus_ptrs;
+  bus_ptrs.reserve(flat_buses.size());
+  for (const auto &flat_bus : flat_buses) {
+    bus_ptrs.push_back(
+        catalogue_
+            .GetBusInfo(base.GetString(flat_bus.name_offset,
+                                       flat_bus.name_size))
+            ->bus_ptr);
+  }
+  std::vector<const data::Bus *> edge_buses;
+  for (uint32_t bus_index : base.GetSection<uint32_t>(Section::EdgeBuses)) {
+    edge_buses.push_back(bus_ptrs.at(bus_index));
+  }
+
+  const auto weights = base.GetSection<double>(Section::EdgeWeights);
+  graph_ = graph::CsrGraph<double>(
+      copy(Section::EdgeOffsets), copy(Section::EdgeTargets),
+      std::vector<double>(weights.begin(), weights.end()),
+      copy(Section::EdgeSources), std::move(edge_buses),
+      copy(Section::EdgeStopCounts));
+  multi_router_.emplace(graph_);
+  graph_finished_ = true;
+}
+
+void TransportRouter::ImportRouter(const serialization::FlatBase &base) {
+  using serialization::flat::Section;
+
+  settings_.algorithm = DeserializeAlgorithm(
+      static_cast<serialization::RoutingAlgorithm>(
+          base.GetHeader().algorithm));
+  settings_.bus_wait_time = base.GetHeader().bus_wait_time;
+  settings_.bus_velocity = base.GetHeader().bus_velocity;
+  switch (settings_.algorithm) {
+  case input_info::RoutingAlgorithm::AllPairs: {
+    const size_t cell_count = graph_.GetVertexCount() * graph_.GetVertexCount();
+    const auto weights = base.GetSection<double>(Section::RouteWeights);
+    const auto prev_edges = base.GetSection<uint32_t>(Section::RoutePrevEdges);
+    if (weights.size() != cell_count || prev_edges.size() != cell_count) {
+      throw std::runtime_error("Routes table does not match graph");
+    }
+    // table is used in place, so its edges are checked once here
+    const size_t edge_count = graph_.GetEdgeCount();
+    if (std::any_of(prev_edges.begin(), prev_edges.end(),
+                    [edge_count](uint32_t edge) {
+                      return edge != graph::RouterView<double>::NO_EDGE &&
+                             edge >= edge_count;
+                    })) {
+      throw std::runtime_error("Routes table refers to unknown edge");
+    }
+    router_.emplace<graph::RouterView<double>>(graph_, weights.data(),
+                                               prev_edges.data());
+    break;
+  }
+  case input_info::RoutingAlgorithm::Dijkstra:
+    BuildRouter();
+    break;
+  case input_info::RoutingAlgorithm::LazyAllPairs:
+    settings_.lazy_cache_rows = base.GetHeader().lazy_cache_rows;
+    BuildRouter();
+    break;
+  case input_info::RoutingAlgorithm::ContractionHierarchies: {
+    using Hierarchy = graph::ContractionHierarchy<double>;
+    const auto ranks = base.GetSection<uint32_t>(Section::Ranks);
+    std::vector<Hierarchy::Shortcut> shortcuts;
+    for (const auto &flat_shortcut :
+         base.GetSection<serialization::flat::Shortcut>(Section::Shortcuts)) {
+      shortcuts.push_back({flat_shortcut.from, flat_shortcut.to,
+                           flat_shortcut.weight, flat_shortcut.first,
+                           flat_shortcut.second});
+    }
+    router_.emplace<Hierarchy>(graph_,
+                               std::vector<size_t>(ranks.begin(), ranks.end()),
+                               std::move(shortcuts));
+    break;
+  }
+  }
+}
+
+void TransportRouter::ImportVertexIds(const serialization::FlatBase &base) {
+  using serialization::flat::Section;
+
+  const auto flat_stops =
+      base.GetSection<serialization::flat::Stop>(Section::Stops);
+  id_to_vertex_.clear();
+  for (const auto &flat_vertex :
+       base.GetSection<serialization::flat::Vertex>(Section::Vertices)) {
+    if (flat_vertex.stop >= flat_stops.size()) {
+      throw std::out_of_range("Vertex refers to unknown stop");
+    }
+    const auto &flat_stop = flat_stops[flat_vertex.stop];
+    id_to_vertex_.emplace_back(
+        data::Vertex{}
+            .SetStop(catalogue_
+                         .GetStopInfo(base.GetString(flat_stop.name_offset,
+                                                     flat_stop.name_size))
+                         ->stop_ptr)
+            .SetWait(flat_vertex.must_wait));
+  }
+
+  vertex_to_id_.clear();
+  for (size_t i = 0; i < id_to_vertex_.size(); ++i) {
+    vertex_to_id_[id_to_vertex_[i]] = i;
+  }
+}
+
+} // namespace core
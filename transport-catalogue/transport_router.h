@@ -7,12 +7,18 @@
 
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <variant>
+#include <vector>
 
+#include "contraction_hierarchy.h"
+#include "dijkstra_router.h"
 #include "domain.h"
 #include "json.h"
+#include "lazy_router.h"
 #include "router.h"
 #include "serialization.h"
 #include "transport_catalogue.h"
@@ -22,6 +28,18 @@ namespace core {
 class TransportRouter {
 public:
   using Edge = graph::Edge<double>;
+  using GraphBuilder = graph::DirectedWeightedGraph<double>;
+
+  //! Route end: name of existing stop or arbitrary point
+  using Place = std::variant<std::string_view, geo::Coordinates>;
+
+  //! How route ends given by points are connected to stops
+  struct Walking {
+    //! Walking speed (in km/h)
+    double velocity{5.0};
+    //! Amount of nearest stops that are considered for every point
+    size_t stops_count{3};
+  };
   /*!
    * Constructor for the class
    * \param[in] catalogue database whose content will be used to generate
@@ -30,6 +48,11 @@ public:
   TransportRouter(const TransportCatalogue &catalogue);
 
   void ImportState(const serialization::TrCatalogue &sr_catalogue);
+  /*!
+   * Loads graph and routing engine from memory-mapped flat database. All-pairs
+   * table is queried right inside the mapping, so base must outlive router
+   */
+  void ImportState(const serialization::FlatBase &base);
   void ExportState(serialization::Serializer &sr);
 
   /*!
@@ -41,6 +64,14 @@ public:
     settings_.bus_wait_time = settings.at("bus_wait_time").AsDouble();
     settings_.bus_velocity =
         settings.at("bus_velocity").AsDouble() * 1000.0 / 60.0;
+    if (settings.count("routing_algorithm")) {
+      settings_.algorithm =
+          algorithm_names_.at(settings.at("routing_algorithm").AsString());
+    }
+    if (settings.count("lazy_cache_rows")) {
+      settings_.lazy_cache_rows =
+          static_cast<size_t>(settings.at("lazy_cache_rows").AsInt());
+    }
   }
 
   /*!
@@ -52,64 +83,132 @@ public:
   std::optional<data::RouteAnswer> FindFastestRoute(std::string_view from,
                                                     std::string_view to);
 
+  /*!
+   * Find the fastest path between stops or points. Points are connected to
+   * their nearest stops by walks, all of those stops are searched from (or
+   * for) at once. Path between two points may be a single walk
+   * \return Path description, std::nullopt if there is no path or stop is
+   * unknown
+   */
+  std::optional<data::RouteAnswer> FindFastestRoute(const Place &from,
+                                                    const Place &to,
+                                                    const Walking &walking);
+
+  /*!
+   * Builds graph and routing engine unless it is done already, afterwards
+   * FindFastestRoute() only reads router state and may be called concurrently
+   */
+  void PrepareRouting();
+
+  /*!
+   * Builds graph and routing engine for catalogue derived from catalogue of
+   * \p previous (see json::JsonReader::InsertUpdateIntoCatalogue()), with
+   * settings of \p previous. All-pairs table is derived from the previous
+   * one, so only its rows that graph changes may affect are recomputed;
+   * the other engines are built from scratch
+   * \throw std::runtime_error if \p previous has no routing settings (it was
+   * imported from database of older format)
+   */
+  void PrepareRouting(const TransportRouter &previous);
+
 private:
   const TransportCatalogue &catalogue_;
   struct Settings {
     double bus_wait_time{};
     double bus_velocity{};
+    input_info::RoutingAlgorithm algorithm{
+        input_info::RoutingAlgorithm::AllPairs};
+    size_t lazy_cache_rows{graph::LazyRouter<double>::DEFAULT_CAPACITY};
   } settings_;
 
-  graph::DirectedWeightedGraph<double> graph_{};
+  //! Maps "routing_algorithm" setting values to routing engines
+  static const std::unordered_map<std::string_view,
+                                  input_info::RoutingAlgorithm>
+      algorithm_names_;
+
+  // frozen once generated (or imported), routers keep reference to it
+  graph::CsrGraph<double> graph_{};
   bool graph_finished_{false};
 
-  // router needs finished graph as constructor, thus pointer is used
-  std::unique_ptr<graph::Router<double>> router_{};
+  // routers need finished graph as constructor argument, thus they are
+  // emplaced into variant only after graph generation (or import)
+  std::variant<std::monostate, graph::Router<double>,
+               graph::RouterView<double>, graph::DijkstraRouter<double>,
+               graph::ContractionHierarchy<double>,
+               graph::LazyRouter<double>>
+      router_{};
+  //! Answers routes between points regardless of routing algorithm, as the
+  //! other engines only support single source and target
+  std::optional<graph::DijkstraRouter<double>> multi_router_{};
 
   std::unordered_map<data::Vertex, size_t, data::VertexHasher> vertex_to_id_{};
   std::vector<data::Vertex> id_to_vertex_{};
 
   void GenerateGraph();
 
+  //! Fills graph_ and vertex ids from catalogue contents
+  void BuildGraph();
+
   void GenerateVertexes(std::vector<const data::Stop *> &stops);
 
-  void InsertAllEdgesIntoGraph(const data::Bus *bus);
+  void InsertAllEdgesIntoGraph(GraphBuilder &builder, const data::Bus *bus);
+
+  //! Adds ride edges between every pair of bus stops in one direction, works
+  //! on stop ids and bus distance prefix sums only
+  void InsertEdgesBetweenStops(GraphBuilder &builder, const data::Bus *bus,
+                               bool backward);
 
-  template <typename InputIt>
-  void InsertEdgesBetweenStops(InputIt begin, InputIt end,
-                               const data::Bus *bus);
+  //! Vertex ids are derived from dense stop ids: 2 * id and 2 * id + 1
+  static size_t GetWaitVertexId(const data::Stop *stop) {
+    return 2 * static_cast<size_t>(stop->id);
+  }
+  static size_t GetNormalVertexId(const data::Stop *stop) {
+    return 2 * static_cast<size_t>(stop->id) + 1;
+  }
 
-  data::RouteAnswer
-  GenerateAnswer(const graph::Router<double>::RouteInfo &path);
+  //! Constructs routing engine chosen by Settings::algorithm over graph_
+  void BuildRouter();
+
+  //! All-pairs table of routing engine, if it has one
+  std::optional<graph::RouterView<double>> GetRoutesTable() const;
+
+  //! Id in graph_ of every vertex of \p previous graph (Router::NO_VERTEX if
+  //! its stop is gone), stops are matched by names
+  std::vector<uint32_t> MapVertices(const TransportRouter &previous) const;
+
+  /*!
+   * Id in graph_ of every edge of \p previous graph (Router::NO_EDGE if there
+   * is no edge of the same bus, ends, span and weight)
+   * \param[in] vertex_ids result of MapVertices()
+   */
+  std::vector<uint32_t> MapEdges(const TransportRouter &previous,
+                                 const std::vector<uint32_t> &vertex_ids) const;
+
+  data::RouteAnswer GenerateAnswer(const graph::RouteInfo<double> &path);
+
+  /*!
+   * Converts route end to wait vertices of stops with walking time to them
+   * \return empty vector if stop is unknown
+   */
+  std::vector<std::pair<graph::VertexId, double>>
+  GetTerminals(const Place &place, const Walking &walking) const;
 
   void ImportGraph(const serialization::Graph &sr_graph);
 
   void ImportRouter(const serialization::Router &sr_router);
 
+  void ImportHierarchy(const serialization::ContractionHierarchy &sr_hierarchy);
+
   void ImportVertexIds(const serialization::TrCatalogue &sr_catalogue);
-};
 
-template <typename InputIt>
-void TransportRouter::InsertEdgesBetweenStops(InputIt begin, InputIt end,
-                                              const data::Bus *bus) {
-  for (auto it1 = begin; it1 != end; ++it1) {
-    double tot_dist{0};
-    for (auto it2 = next(it1); it2 != end; ++it2) {
-      auto norm_id =
-          vertex_to_id_.at(data::Vertex().SetStop(*it1).SetWait(false));
-      auto wait_id =
-          vertex_to_id_.at(data::Vertex().SetStop(*it2).SetWait(true));
-      auto stops_between = static_cast<size_t>(std::distance(it1, it2));
-      auto curr_dist =
-          catalogue_.GetStopsRealDist((*prev(it2))->name, (*it2)->name).value();
-      tot_dist += curr_dist;
-      graph_.AddEdge(Edge()
-                         .SetFromVertex(norm_id)
-                         .SetToVertex(wait_id)
-                         .SetWeight(tot_dist / settings_.bus_velocity)
-                         .SetBus(bus)
-                         .SetStopCount(stops_between));
-    }
-  }
-}
+  void ImportGraph(const serialization::FlatBase &base);
+
+  void ImportRouter(const serialization::FlatBase &base);
+
+  void ImportVertexIds(const serialization::FlatBase &base);
+
+  static input_info::RoutingAlgorithm
+  DeserializeAlgorithm(serialization::RoutingAlgorithm algorithm);
+};
 
 } // namespace core
\ No newline at end of file